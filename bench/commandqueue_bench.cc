@@ -0,0 +1,183 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Enqueue-to-dispatch latency of the main loop command path.
+ * P producer threads push N commands to one main loop, each command
+ * carries the time it was pushed and the loop records the latency
+ * when it dispatches it. "queue" uses CommandQueue, "idle" is the
+ * former one g_idle_source per call path, for comparison.
+ *
+ *   commandqueue_bench [messages]
+ */
+
+#include <framework/commandqueue.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+inline gint64 now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               Clock::now().time_since_epoch())
+        .count();
+}
+
+struct Command : public MpscNode
+{
+    gint64 stamp;
+    struct Consumer *consumer;
+};
+
+struct Consumer
+{
+    GMainLoop *loop;
+    std::vector<gint64> latency;
+    size_t count;
+    size_t expected;
+};
+
+void record(Command *command)
+{
+    Consumer *consumer = command->consumer;
+    consumer->latency[consumer->count++] = now_ns() - command->stamp;
+    if (consumer->count == consumer->expected) {
+        g_main_loop_quit(consumer->loop);
+    }
+}
+
+void on_command(MpscNode *node, gpointer user_data)
+{
+    record(static_cast<Command *>(node));
+}
+
+gboolean on_idle(gpointer user_data)
+{
+    record(static_cast<Command *>(user_data));
+    return G_SOURCE_REMOVE;
+}
+
+void run(const char *mode, guint producers, size_t messages)
+{
+    bool idle = (mode[0] == 'i');
+    size_t per_producer = messages / producers;
+    messages = per_producer * producers;
+
+    GMainContext *context = g_main_context_new();
+    Consumer consumer;
+    consumer.loop = g_main_loop_new(context, FALSE);
+    consumer.latency.resize(messages);
+    consumer.count = 0;
+    consumer.expected = messages;
+    CommandQueue *queue = idle ? NULL : new CommandQueue(context, on_command, NULL);
+
+    std::vector<Command> commands(messages);
+    for (auto &command : commands) {
+        command.consumer = &consumer;
+    }
+
+    std::thread loop_thread([&]() {
+        g_main_context_push_thread_default(context);
+        g_main_loop_run(consumer.loop);
+        g_main_context_pop_thread_default(context);
+    });
+    while (!g_main_loop_is_running(consumer.loop)) {
+        std::this_thread::yield();
+    }
+
+    std::atomic<bool> go(false);
+    std::vector<std::thread> threads;
+    for (guint p = 0; p < producers; p++) {
+        threads.push_back(std::thread([&, p]() {
+            while (!go.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            Command *begin = &commands[p * per_producer];
+            for (size_t i = 0; i < per_producer; i++) {
+                Command *command = begin + i;
+                command->stamp = now_ns();
+                if (idle) {
+                    GSource *source = g_idle_source_new();
+                    g_source_set_callback(source, on_idle, command, NULL);
+                    g_source_set_priority(source, G_PRIORITY_DEFAULT);
+                    g_source_attach(source, context);
+                    g_source_unref(source);
+                } else {
+                    queue->Push(command);
+                }
+            }
+        }));
+    }
+
+    gint64 start = now_ns();
+    go.store(true, std::memory_order_release);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    loop_thread.join();
+    gint64 elapsed = now_ns() - start;
+
+    std::vector<gint64> &latency = consumer.latency;
+    std::sort(latency.begin(), latency.end());
+    double total = 0;
+    for (auto value : latency) {
+        total += (double)value;
+    }
+    printf("%-6s %9u %10zu %10.0f %10.1f %10.1f %10.1f %10.1f\n",
+           mode,
+           producers,
+           messages,
+           messages / (elapsed / 1e9),
+           latency[messages / 2] / 1e3,
+           latency[messages * 99 / 100] / 1e3,
+           latency[messages - 1] / 1e3,
+           total / messages / 1e3);
+
+    delete queue;
+    g_main_loop_unref(consumer.loop);
+    g_main_context_unref(context);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[])
+{
+    size_t messages = 1 << 20;
+    if (argc > 1) {
+        messages = (size_t)strtoull(argv[1], NULL, 10);
+    }
+    if (messages < 64) {
+        messages = 64;
+    }
+
+    static const guint producers[] = {1, 8, 64};
+    printf("%-6s %9s %10s %10s %10s %10s %10s %10s\n",
+           "mode", "producers", "messages", "msg/s",
+           "p50(us)", "p99(us)", "max(us)", "mean(us)");
+    for (auto p : producers) {
+        run("queue", p, messages);
+        run("idle", p, messages);
+    }
+    return 0;
+}
@@ -0,0 +1,163 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Producer throughput and delivery of the audience joints.
+ * One producer pipeline (fakesrc ! tee ! fakesink) feeds V viewer
+ * pipelines. "proxy" links every viewer through a tee request pad and
+ * a proxysink/proxysrc pair (PipeJoint), "fanout" subscribes a queue
+ * of every viewer to the FanOut on the tee sink pad.
+ *
+ *   fanout_bench [buffers]
+ */
+
+#include <utils/fanout.h>
+#include <utils/pipejoint.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+inline gint64 now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               Clock::now().time_since_epoch())
+        .count();
+}
+
+GstPadProbeReturn on_viewer_buffer(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    static_cast<std::atomic<guint64> *>(user_data)->fetch_add(1, std::memory_order_relaxed);
+    return GST_PAD_PROBE_OK;
+}
+
+void run(const char *mode, guint viewers, guint buffers)
+{
+    bool fanout_mode = (mode[0] == 'f');
+    gchar *desc = g_strdup_printf("fakesrc name=src num-buffers=%u sizetype=fixed sizemax=1024 "
+                                  "filltype=nothing ! tee name=tee ! queue ! fakesink sync=false",
+                                  buffers);
+    GstElement *producer = gst_parse_launch(desc, NULL);
+    g_free(desc);
+    GstElement *tee = gst_bin_get_by_name(GST_BIN(producer), "tee");
+
+    FanOut fanout;
+    if (fanout_mode) {
+        GstPad *pad = gst_element_get_static_pad(tee, "sink");
+        fanout.Attach(pad);
+        gst_object_unref(pad);
+    }
+
+    std::atomic<guint64> delivered(0);
+    std::vector<GstElement *> pipelines;
+    for (guint v = 0; v < viewers; v++) {
+        GstElement *pipeline = gst_pipeline_new(NULL);
+        GstElement *sink = gst_element_factory_make("fakesink", NULL);
+        g_object_set(sink, "sync", FALSE, "async", FALSE, NULL);
+        PipeJoint joint = fanout_mode ? make_fanout_joint("video") : make_pipe_joint("video");
+        gst_bin_add_many(GST_BIN(pipeline), joint.downstream_joint, sink, NULL);
+        gst_element_link(joint.downstream_joint, sink);
+
+        if (fanout_mode) {
+            // nothing may be dropped, it would hide the push cost
+            g_object_set(joint.downstream_joint, "leaky", 0, NULL);
+            GstPad *sinkpad = gst_element_get_static_pad(joint.downstream_joint, "sink");
+            fanout.Subscribe(sinkpad);
+            gst_object_unref(sinkpad);
+        } else {
+            gst_bin_add(GST_BIN(producer), joint.upstream_joint);
+            GstPad *teepad = gst_element_get_request_pad(tee, "src_%u");
+            GstPad *sinkpad = gst_element_get_static_pad(joint.upstream_joint, "sink");
+            gst_pad_link(teepad, sinkpad);
+            gst_object_unref(sinkpad);
+            gst_object_unref(teepad);
+        }
+
+        GstPad *pad = gst_element_get_static_pad(sink, "sink");
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, on_viewer_buffer, &delivered, NULL);
+        gst_object_unref(pad);
+        gst_element_set_state(pipeline, GST_STATE_PLAYING);
+        pipelines.push_back(pipeline);
+    }
+
+    gint64 start = now_ns();
+    gst_element_set_state(producer, GST_STATE_PLAYING);
+    GstBus *bus = gst_element_get_bus(producer);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus,
+                                                 60 * GST_SECOND,
+                                                 (GstMessageType)(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+    gint64 produced = now_ns() - start;
+    if (msg) {
+        gst_message_unref(msg);
+    }
+    gst_object_unref(bus);
+
+    // let the viewer queues drain
+    guint64 expected = (guint64)buffers * viewers;
+    gint64 deadline = now_ns() + 10 * GST_SECOND;
+    while (delivered.load() < expected && now_ns() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    gint64 elapsed = now_ns() - start;
+
+    printf("%-7s %8u %9u %12.0f %12.0f %10.1f %10.3f\n",
+           mode,
+           viewers,
+           buffers,
+           buffers / (produced / 1e9),
+           delivered.load() / (elapsed / 1e9),
+           100.0 * delivered.load() / expected,
+           produced / 1e3 / buffers / viewers);
+
+    gst_element_set_state(producer, GST_STATE_NULL);
+    fanout.Detach();
+    for (auto pipeline : pipelines) {
+        gst_element_set_state(pipeline, GST_STATE_NULL);
+        gst_object_unref(pipeline);
+    }
+    gst_object_unref(tee);
+    gst_object_unref(producer);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[])
+{
+    gst_init(&argc, &argv);
+    guint buffers = 2000;
+    if (argc > 1) {
+        buffers = (guint)strtoul(argv[1], NULL, 10);
+    }
+    if (buffers < 10) {
+        buffers = 10;
+    }
+
+    static const guint viewers[] = {10, 100, 1000};
+    printf("%-7s %8s %9s %12s %12s %10s %10s\n",
+           "mode", "viewers", "buffers", "produced/s",
+           "delivered/s", "delivered%", "us/viewer");
+    for (auto v : viewers) {
+        run("proxy", v, buffers);
+        run("fanout", v, buffers);
+    }
+    return 0;
+}
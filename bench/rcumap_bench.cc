@@ -0,0 +1,132 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Lookups of RcuMap while a writer keeps inserting and erasing.
+ * R reader threads look up random keys, every value is a heap object
+ * the writer frees right after Erase() returns, so a reader still
+ * using an erased value is caught by its poisoned magic (and by ASan,
+ * TSan or UBSan when built with them). Reports lookups/s per reader
+ * count and exits non-zero on any inconsistency.
+ *
+ *   rcumap_bench [seconds]
+ */
+
+#include <utils/rcumap.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const unsigned KEYS = 1024;
+const unsigned MAGIC = 0x52435530u;  // "RCU0"
+
+struct Item
+{
+    unsigned magic;
+    unsigned key;
+};
+
+bool run(unsigned readers, double seconds)
+{
+    RcuMap<unsigned, Item *> map;
+    std::atomic<bool> stop(false);
+    std::atomic<unsigned long long> lookups(0);
+    std::atomic<unsigned long long> errors(0);
+
+    std::vector<std::thread> threads;
+    for (unsigned r = 0; r < readers; r++) {
+        threads.push_back(std::thread([&, r]() {
+            std::minstd_rand random(r + 1);
+            unsigned long long n = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                unsigned key = random() % KEYS;
+                map.Read(key, [&](Item *const &item) {
+                    if (item->magic != MAGIC || item->key != key) {
+                        errors++;
+                    }
+                });
+                n++;
+            }
+            lookups += n;
+        }));
+    }
+
+    unsigned long long writes = 0;
+    std::minstd_rand random(0);
+    Clock::time_point end = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                               std::chrono::duration<double>(seconds));
+    while (Clock::now() < end) {
+        unsigned key = random() % KEYS;
+        Item *old = NULL;
+        if (map.Erase(key, &old)) {
+            // no reader can see it any more
+            old->magic = 0;
+            delete old;
+        } else {
+            Item *item = new Item();
+            item->magic = MAGIC;
+            item->key = key;
+            if (!map.Insert(key, item)) {
+                errors++;
+                delete item;
+            }
+        }
+        writes++;
+    }
+    stop = true;
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    for (auto &it : map.Clear()) {
+        delete it.second;
+    }
+
+    printf("%7u %14.0f %12.0f %8llu\n",
+           readers,
+           lookups.load() / seconds,
+           writes / seconds,
+           errors.load());
+    return errors.load() == 0;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[])
+{
+    double seconds = 2;
+    if (argc > 1) {
+        seconds = atof(argv[1]);
+    }
+    if (seconds <= 0) {
+        seconds = 2;
+    }
+
+    static const unsigned readers[] = {1, 4, 16};
+    printf("%7s %14s %12s %8s\n", "readers", "lookups/s", "writes/s", "errors");
+    bool ok = true;
+    for (auto r : readers) {
+        ok = run(r, seconds) && ok;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,411 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * N live streams x M viewers driven through the plugin interface, as a
+ * host would, without network or camera. Each stream is a RTSPTestServer
+ * (videotestsrc ! x264enc) relayed by a LiveStream over loopback RTSP,
+ * each viewer a RTSP audience of it played by an in-process
+ * rtspsrc ! fakesink client. The streams run alone first, then with
+ * their viewers, and the difference gives:
+ *   - join latency, add_audience to resolve and to the first buffer
+ *     received by the viewer (p50/p90/p99/max),
+ *   - cpu per stream and per viewer (in % of one core),
+ *   - resident memory per stream and per viewer,
+ *   - the sustained throughput received by the viewers.
+ * Viewer clients run in the same process, their cost is part of the
+ * per viewer figures.
+ *
+ *   webstreamer_bench [streams] [viewers] [seconds] [port]
+ */
+
+#include <plugin_interface.h>
+#include <nlohmann/json.hpp>
+#include <gst/gst.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+NODE_PLUGIN_SYMBOL plugin_interface_t *plugin_interface_initialize(void *context, plugin_notify_fn notify);
+NODE_PLUGIN_SYMBOL void plugin_interface_terminate(plugin_interface_t *iface);
+
+namespace {
+
+using json = nlohmann::json;
+typedef std::chrono::steady_clock Clock;
+
+const gint64 JOIN_TIMEOUT_NS = 20 * GST_SECOND;
+
+inline gint64 now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               Clock::now().time_since_epoch())
+        .count();
+}
+
+// user + system time of the process
+gint64 cpu_ns()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return ((gint64)usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * GST_SECOND +
+           ((gint64)usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * GST_USECOND;
+}
+
+gint64 rss_bytes()
+{
+    long pages = 0;
+    long resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f) {
+        if (fscanf(f, "%ld %ld", &pages, &resident) != 2) {
+            resident = 0;
+        }
+        fclose(f);
+    }
+    return (gint64)resident * sysconf(_SC_PAGESIZE);
+}
+
+/*
+ * a plugin call waited for synchronously
+ */
+struct Call
+{
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool done = false;
+    int status = 0;
+    std::string result;
+};
+
+void on_settled(const void *self, const void *context, int status, plugin_buffer_t *data)
+{
+    Call *call = (Call *)context;
+    std::string result;
+    if (data && data->data && data->size) {
+        result.assign((const char *)data->data, data->size);
+    }
+    if (data && data->release) {
+        data->release(data);
+    }
+    std::lock_guard<std::mutex> lock(call->mutex);
+    call->status = status;
+    call->result = result;
+    call->done = true;
+    call->cv.notify_one();
+}
+
+void on_notify(const void *self, plugin_buffer_t *data, plugin_buffer_t *meta)
+{
+    if (data && data->release) {
+        data->release(data);
+    }
+    if (meta && meta->release) {
+        meta->release(meta);
+    }
+}
+
+void wait(Call *call)
+{
+    std::unique_lock<std::mutex> lock(call->mutex);
+    call->cv.wait(lock, [call]() { return call->done; });
+}
+
+void borrow(const std::string &text, plugin_buffer_t *buf)
+{
+    memset(buf, 0, sizeof(plugin_buffer_t));
+    buf->data = (void *)text.data();
+    buf->size = text.size();
+}
+
+plugin_interface_t *_iface = NULL;
+
+bool call(const std::string &action, const std::string &name, const std::string &type,
+          const json &data)
+{
+    json j;
+    j["action"] = action;
+    j["name"] = name;
+    j["type"] = type;
+    std::string meta_text = j.dump();
+    std::string data_text = data.dump();
+    plugin_buffer_t meta;
+    plugin_buffer_t buf;
+    borrow(meta_text, &meta);
+    borrow(data_text, &buf);
+
+    Call c;
+    _iface->call(_iface, &c, &buf, &meta, on_settled);
+    wait(&c);
+    if (c.status != 0) {
+        fprintf(stderr, "%s %s@%s failed: %s\n", action.c_str(), name.c_str(), type.c_str(), c.result.c_str());
+        return false;
+    }
+    return true;
+}
+
+/*
+ * a viewer, rtspsrc ! fakesink counting what reaches the sink
+ */
+struct Viewer
+{
+    GstElement *pipeline = NULL;
+    gint64 requested = 0;  // add_audience called
+    gint64 resolved = 0;   // add_audience resolved
+    std::atomic<gint64> first{0};
+    std::atomic<guint64> buffers{0};
+    std::atomic<guint64> bytes{0};
+};
+
+GstPadProbeReturn on_viewer_buffer(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    Viewer *viewer = (Viewer *)user_data;
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (viewer->buffers.fetch_add(1, std::memory_order_relaxed) == 0) {
+        viewer->first.store(now_ns(), std::memory_order_release);
+    }
+    viewer->bytes.fetch_add(gst_buffer_get_size(buffer), std::memory_order_relaxed);
+    return GST_PAD_PROBE_OK;
+}
+
+bool play(Viewer *viewer, const std::string &url)
+{
+    std::string launch = "rtspsrc location=" + url + " latency=0 protocols=tcp ! fakesink name=sink sync=false";
+    GError *error = NULL;
+    viewer->pipeline = gst_parse_launch(launch.c_str(), &error);
+    if (error) {
+        fprintf(stderr, "viewer %s: %s\n", url.c_str(), error->message);
+        g_error_free(error);
+        if (viewer->pipeline) {
+            gst_object_unref(viewer->pipeline);
+            viewer->pipeline = NULL;
+        }
+        return false;
+    }
+    GstElement *sink = gst_bin_get_by_name(GST_BIN(viewer->pipeline), "sink");
+    GstPad *pad = gst_element_get_static_pad(sink, "sink");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, on_viewer_buffer, viewer, NULL);
+    gst_object_unref(pad);
+    gst_object_unref(sink);
+    gst_element_set_state(viewer->pipeline, GST_STATE_PLAYING);
+    return true;
+}
+
+struct Sample
+{
+    gint64 wall;
+    gint64 cpu;
+    guint64 buffers;
+    guint64 bytes;
+};
+
+Sample sample(const std::vector<Viewer *> &viewers)
+{
+    Sample s;
+    s.wall = now_ns();
+    s.cpu = cpu_ns();
+    s.buffers = 0;
+    s.bytes = 0;
+    for (auto viewer : viewers) {
+        s.buffers += viewer->buffers.load(std::memory_order_relaxed);
+        s.bytes += viewer->bytes.load(std::memory_order_relaxed);
+    }
+    return s;
+}
+
+// cpu load over the window, in % of one core
+double load(const Sample &begin, const Sample &end)
+{
+    return 100.0 * (end.cpu - begin.cpu) / MAX(1, end.wall - begin.wall);
+}
+
+void percentiles(const char *name, std::vector<gint64> values)
+{
+    if (values.empty()) {
+        printf("%-16s %10s %10s %10s %10s\n", name, "-", "-", "-", "-");
+        return;
+    }
+    std::sort(values.begin(), values.end());
+    size_t n = values.size();
+    printf("%-16s %10.1f %10.1f %10.1f %10.1f\n",
+           name,
+           values[n / 2] / 1e6,
+           values[n * 90 / 100] / 1e6,
+           values[n * 99 / 100] / 1e6,
+           values[n - 1] / 1e6);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[])
+{
+    guint streams = argc > 1 ? (guint)strtoul(argv[1], NULL, 10) : 4;
+    guint viewers_per_stream = argc > 2 ? (guint)strtoul(argv[2], NULL, 10) : 8;
+    guint seconds = argc > 3 ? (guint)strtoul(argv[3], NULL, 10) : 10;
+    guint port = argc > 4 ? (guint)strtoul(argv[4], NULL, 10) : 18554;
+    streams = MAX(streams, 1u);
+    seconds = MAX(seconds, 1u);
+
+    gst_init(&argc, &argv);
+
+    const std::string base = "rtsp://127.0.0.1:" + std::to_string(port);
+    json option;
+    option["rtsp_server"] = {{"port", port}, {"max_sessions", 2 * streams * (viewers_per_stream + 1)}};
+    std::string option_text = option.dump();
+    plugin_buffer_t option_buf;
+    borrow(option_text, &option_buf);
+
+    _iface = plugin_interface_initialize(NULL, on_notify);
+    Call init;
+    _iface->init(_iface, &init, &option_buf, on_settled);
+    wait(&init);
+    if (init.status != 0) {
+        fprintf(stderr, "init failed: %s\n", init.result.c_str());
+        plugin_interface_terminate(_iface);
+        return 1;
+    }
+
+    // streams alone
+    gint64 rss_idle = rss_bytes();
+    bool ok = true;
+    for (guint i = 0; ok && i < streams; i++) {
+        std::string source = "source" + std::to_string(i);
+        std::string live = "live" + std::to_string(i);
+        json launch;
+        launch["launch"] =
+            "( videotestsrc is-live=true ! video/x-raw,width=640,height=360,framerate=25/1"
+            " ! x264enc tune=zerolatency speed-preset=ultrafast key-int-max=25"
+            " ! rtph264pay name=pay0 pt=96 )";
+        launch["path"] = "/" + source;
+        json performer;
+        performer["name"] = "performer";
+        performer["url"] = base + "/" + source;
+        performer["video_codec"] = "h264";
+        ok = call("create", source, "RTSPTestServer", json::object()) &&
+             call("startup", source, "RTSPTestServer", launch) &&
+             call("create", live, "LiveStream", json::object()) &&
+             call("add_performer", live, "LiveStream", performer) &&
+             call("startup", live, "LiveStream", json::object());
+    }
+
+    std::vector<Viewer *> viewers;
+    Sample streams_begin = sample(viewers);
+    if (ok) {
+        g_usleep(seconds * G_USEC_PER_SEC);
+    }
+    Sample streams_end = sample(viewers);
+    gint64 rss_streams = rss_bytes();
+
+    // viewers join, one stream after the other
+    for (guint i = 0; ok && i < streams; i++) {
+        std::string live = "live" + std::to_string(i);
+        for (guint v = 0; v < viewers_per_stream; v++) {
+            std::string path = "/" + live + "/viewer" + std::to_string(v);
+            json audience;
+            audience["name"] = "viewer" + std::to_string(v);
+            audience["protocol"] = "rtspserver";
+            audience["path"] = path;
+            Viewer *viewer = new Viewer();
+            viewers.push_back(viewer);
+            viewer->requested = now_ns();
+            if (!call("add_audience", live, "LiveStream", audience)) {
+                continue;
+            }
+            viewer->resolved = now_ns();
+            play(viewer, base + path);
+        }
+    }
+    gint64 deadline = now_ns() + JOIN_TIMEOUT_NS;
+    size_t joined = 0;
+    while (now_ns() < deadline) {
+        joined = 0;
+        for (auto viewer : viewers) {
+            joined += viewer->first.load(std::memory_order_acquire) ? 1 : 0;
+        }
+        if (joined == viewers.size()) {
+            break;
+        }
+        g_usleep(10 * 1000);
+    }
+
+    Sample viewers_begin = sample(viewers);
+    if (ok && !viewers.empty()) {
+        g_usleep(seconds * G_USEC_PER_SEC);
+    }
+    Sample viewers_end = sample(viewers);
+    gint64 rss_viewers = rss_bytes();
+
+    std::vector<gint64> join_call;
+    std::vector<gint64> join_first;
+    for (auto viewer : viewers) {
+        if (viewer->resolved) {
+            join_call.push_back(viewer->resolved - viewer->requested);
+        }
+        gint64 first = viewer->first.load(std::memory_order_acquire);
+        if (first) {
+            join_first.push_back(first - viewer->requested);
+        }
+    }
+
+    double elapsed = MAX(1, viewers_end.wall - viewers_begin.wall) / 1e9;
+    double stream_load = load(streams_begin, streams_end);
+    double viewer_load = load(viewers_begin, viewers_end);
+    guint total = streams * viewers_per_stream;
+    double mbps = (viewers_end.bytes - viewers_begin.bytes) * 8 / elapsed / 1e6;
+    double bps = (viewers_end.buffers - viewers_begin.buffers) / elapsed;
+
+    printf("streams %u, viewers %u/stream, %u s per phase%s\n\n",
+           streams, viewers_per_stream, seconds, ok ? "" : " (setup failed)");
+    printf("%-16s %10s %10s %10s %10s\n", "join(ms)", "p50", "p90", "p99", "max");
+    percentiles("add_audience", join_call);
+    percentiles("first buffer", join_first);
+    printf("\n");
+    printf("%-16s %10zu/%u\n", "joined", joined, total);
+    printf("%-16s %10.1f %%\n", "cpu/stream", stream_load / streams);
+    printf("%-16s %10.1f %%\n", "cpu/viewer", total ? (viewer_load - stream_load) / total : 0.0);
+    printf("%-16s %10.1f KiB\n", "rss/stream", (rss_streams - rss_idle) / 1024.0 / streams);
+    printf("%-16s %10.1f KiB\n", "rss/viewer", total ? (rss_viewers - rss_streams) / 1024.0 / total : 0.0);
+    printf("%-16s %10.2f Mbit/s\n", "throughput", mbps);
+    printf("%-16s %10.1f buffers/s\n", "", bps);
+    printf("%-16s %10.3f Mbit/s\n", "per viewer", total ? mbps / total : 0.0);
+
+    for (auto viewer : viewers) {
+        if (viewer->pipeline) {
+            gst_element_set_state(viewer->pipeline, GST_STATE_NULL);
+            gst_object_unref(viewer->pipeline);
+        }
+        delete viewer;
+    }
+    for (guint i = 0; i < streams; i++) {
+        call("destroy", "live" + std::to_string(i), "LiveStream", json::object());
+        call("destroy", "source" + std::to_string(i), "RTSPTestServer", json::object());
+    }
+    Call terminate;
+    _iface->terminate(_iface, &terminate, on_settled);
+    wait(&terminate);
+    plugin_interface_terminate(_iface);
+    return ok ? 0 : 1;
+}
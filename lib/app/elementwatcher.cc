@@ -41,84 +41,37 @@ bool ElementWatcher::Initialize(Promise *promise)
 
 void ElementWatcher::On(Promise *promise)
 {
-    const json &j = promise->meta();
-    std::string action = j["action"];
-    if (action == "startup") {
-        Startup(promise);
-    } else if (action == "stop") {
-        Stop(promise);
+    if (promise->binary()) {
+        GST_ERROR("[element watcher] binary call is not supported!");
+        promise->reject("binary call is not supported!");
+        return;
     }
-}
-
-gboolean ElementWatcher::on_save_image(gpointer user_data)
-{
-    ElementWatcher *app = static_cast<ElementWatcher *>(user_data);
-
-    GstSample *from_sample;
-    g_object_get(app->sink_, "last-sample", &from_sample, NULL);
-    if (from_sample == NULL) {
-        GST_ERROR("[element watcher] failed getting sample.");
-        return FALSE;
-    }
-    GstCaps *caps = gst_caps_from_string("image/bmp");
-
-    if (caps == NULL) {
-        GST_ERROR("[element watcher] failed getting caps.");
-        return FALSE;
-    }
-
-    GError *err = NULL;
-    GstSample *to_sample = gst_video_convert_sample(from_sample, caps, GST_CLOCK_TIME_NONE, &err);
-    gst_caps_unref(caps);
-    gst_sample_unref(from_sample);
-
-    if (to_sample == NULL && err) {
-        GST_ERROR("[element watcher] failed converting frame.");
-        GST_ERROR("[element watcher] error : %s", err->message);
-        return FALSE;
+    switch (promise->action()) {
+        case PLUGIN_ACTION_STARTUP:
+            Startup(promise);
+            break;
+        case PLUGIN_ACTION_STOP:
+            Stop(promise);
+            break;
+        default:
+            GST_ERROR("[element watcher] action: %s is not supported!", promise->action_name().c_str());
+            promise->reject("action: " + promise->action_name() + " is not supported!");
+            break;
     }
-    GstBuffer *buf = gst_sample_get_buffer(to_sample);
-
-    GstClockTime stream_time = GST_BUFFER_TIMESTAMP(buf);
-    GstClockTime duration = GST_BUFFER_DURATION(buf);
-
-    GstMapInfo map_info;
-    if (!gst_buffer_map(buf, &map_info, GST_MAP_READ)) {
-        GST_ERROR("[element watcher] could not get image data from gstbuffer");
-        gst_sample_unref(to_sample);
-
-        return FALSE;
-    }
-
-    gst_sample_unref(to_sample);
-
-    json data;
-    data["duration"] = duration;
-    data["stream-time"] = stream_time;
-
-    unsigned char *bmp_buffer = new unsigned char[map_info.size];
-    memcpy(bmp_buffer, map_info.data, map_info.size);
-    app->bmps_.push_back(bmp_buffer);
-    uint64_t pointer = reinterpret_cast<uint64_t>(bmp_buffer);
-    // printf("%p\n%ld\n%p\n",bmp_buffer,pointer,reinterpret_cast<unsigned char *>(pointer));
-
-    data["data"] = pointer;
-    data["size"] = map_info.size;
-
-    json meta;
-    meta["topic"] = "image_data";
-    meta["origin"] = app->uname();
-
-    app->Notify(data, meta);
-    return TRUE;
 }
 
 GstPadProbeReturn ElementWatcher::on_have_data(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
 {
     ElementWatcher *app = static_cast<ElementWatcher *>(user_data);
     if (app->cur_frame_ <= (app->frame_ * 2)) {
-        if (++app->cur_frame_ % 2 == 0)
-            app->on_save_image(user_data);
+        if (++app->cur_frame_ % 2 == 0) {
+            // only a ref is taken here, never blocks the source
+            GstCaps *caps = gst_pad_get_current_caps(pad);
+            if (caps) {
+                app->snapshot_.Post(gst_sample_new(GST_PAD_PROBE_INFO_BUFFER(info), caps, NULL, NULL));
+                gst_caps_unref(caps);
+            }
+        }
         return GST_PAD_PROBE_OK;
     } else {
         return GST_PAD_PROBE_REMOVE;
@@ -126,15 +79,37 @@ GstPadProbeReturn ElementWatcher::on_have_data(GstPad *pad, GstPadProbeInfo *inf
 }
 void ElementWatcher::Startup(Promise *promise)
 {
-    GError *error = NULL;
-
     const json &j = promise->data();
     const std::string &launch = j["launch"];
 
+    // options are checked first, a rejected startup leaves nothing running
+    SnapshotWorker::Options options;
+    json::const_iterator snapshot = j.find("snapshot");
+    if (snapshot != j.cend() &&
+        !SnapshotWorker::ParseOptions(*snapshot, &options)) {
+        promise->reject("invalid snapshot option.");
+        return;
+    }
+    json::const_iterator frame = j.find("frame");
+    if (frame != j.cend() && !frame->is_number_integer()) {
+        promise->reject("invalid frame option.");
+        return;
+    }
+
     /* Build the pipeline */
+    // user launches (a location per request...) are not worth a recipe
+    GError *error = NULL;
+    GstElement *bin = gst_parse_launch(launch.c_str(), &error);
+    if (error) {
+        std::string err = error->message;
+        g_error_free(error);
+        g_clear_object(&bin);
+        GST_ERROR("[element watcher] failed to parse launch: %s", err.c_str());
+        promise->reject("failed to parse launch: " + err);
+        return;
+    }
     const char *name = this->uname().c_str();
     pipeline_ = gst_pipeline_new(name);
-    GstElement *bin = gst_parse_launch(launch.c_str(), &error);
     gst_bin_add(GST_BIN(pipeline_), bin);
 
     gst_element_set_state(pipeline_, GST_STATE_PLAYING);
@@ -148,7 +123,18 @@ void ElementWatcher::Startup(Promise *promise)
         GST_INFO("[element watcher] use multifilesink for test.");
     } else {
         GST_INFO("[element watcher] use raw image data for test.");
-        frame_ = j["frame"];
+        if (frame != j.cend()) {
+            frame_ = frame->get<int>();
+        }
+        gchar *tag = g_strdup_printf("%u", id());
+        options.tag = tag;
+        g_free(tag);
+        snapshot_.Start(options, [this](const json &data) {
+            json meta;
+            meta["topic"] = "image_data";
+            meta["origin"] = uname();
+            Notify(data, meta);
+        });
         GstPad *pad = gst_element_get_static_pad(sink_, "sink");
         gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, ElementWatcher::on_have_data, this, NULL);
         gst_object_unref(pad);
@@ -162,15 +148,14 @@ void ElementWatcher::Stop(Promise *promise)
     if (time_id_ != -1) {
         g_source_remove(time_id_);
     }
-    for (auto it : bmps_) {
-        delete[] it;
-    }
+    snapshot_.Stop();
     promise->resolve();
 }
 
 bool ElementWatcher::Destroy(Promise *promise)
 {
     // IApp::Destroy(promise);
+    snapshot_.Stop();
     return true;
 }
 void ElementWatcher::OnMessage(GstBus *bus, GstMessage *message)
@@ -18,6 +18,7 @@
 #define _LIBWEBSTREAMER_ELEMENT_WATCHER_H_
 
 #include <framework/app.h>
+#include <utils/snapshotworker.h>
 
 
 class ElementWatcher : public IApp
@@ -50,7 +51,6 @@ class ElementWatcher : public IApp
     void OnMultifilesink(const std::string &name,
                          const GstStructure *message);
 
-    static gboolean on_save_image(gpointer user_data);
     static GstPadProbeReturn on_have_data(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
     void set_sink(GstElement *sink) { sink_ = sink; }
 
@@ -59,9 +59,10 @@ class ElementWatcher : public IApp
     nlohmann::json watch_list_;
     int time_id_;
     GstElement *sink_;
-    std::vector<unsigned char *> bmps_;
     int frame_;
     int cur_frame_;
+    // images are converted off the streaming thread
+    SnapshotWorker snapshot_;
 };
 
 
@@ -18,6 +18,8 @@
 #include <endpoint/filesource.h>
 #include <endpoint/hlsservice.h>
 #include <utils/typedef.h>
+#include <utils/elementfactory.h>
+#include <utils/trace.h>
 
 using json = nlohmann::json;
 
@@ -42,11 +44,19 @@ HLStream::~HLStream()
 bool HLStream::Initialize(Promise *promise)
 {
     IApp::Initialize(promise);
-    video_tee_ = gst_element_factory_make("tee", "video_tee");
-    audio_tee_ = gst_element_factory_make("tee", "audio_tee");
+    video_tee_ = ElementFactory::Make("tee", "video_tee");
+    audio_tee_ = ElementFactory::Make("tee", "audio_tee");
 
     g_warn_if_fail(gst_bin_add(GST_BIN(pipeline()), video_tee_));
     g_warn_if_fail(gst_bin_add(GST_BIN(pipeline()), audio_tee_));
+    video_detacher_.Attach(video_tee_);
+    audio_detacher_.Attach(audio_tee_);
+    GstPad *tee_sink = gst_element_get_static_pad(video_tee_, "sink");
+    performer_video_stats_.Attach(tee_sink);
+    gst_object_unref(tee_sink);
+    tee_sink = gst_element_get_static_pad(audio_tee_, "sink");
+    performer_audio_stats_.Attach(tee_sink);
+    gst_object_unref(tee_sink);
 
     GST_DEBUG_CATEGORY_INIT(my_category, "webstreamer", 2, "libWebStreamer");
 
@@ -56,6 +66,9 @@ bool HLStream::Initialize(Promise *promise)
 bool HLStream::Destroy(Promise *promise)
 { 
     bool ret = true;  
+    startup_.Cancel();
+    performer_video_stats_.Detach();
+    performer_audio_stats_.Detach();
     if ( fake_pad_video_tee_ ) {
         gst_element_release_request_pad(video_tee_, fake_pad_video_tee_);
         gst_object_unref(fake_pad_video_tee_);
@@ -67,6 +80,8 @@ bool HLStream::Destroy(Promise *promise)
         fake_pad_audio_tee_ = NULL;
     }
 
+    video_detacher_.Flush();
+    audio_detacher_.Flush();
     for(auto handle : joint_handles_)
     {
         GST_DEBUG("----------------------");
@@ -80,22 +95,34 @@ bool HLStream::Destroy(Promise *promise)
 /////////////////////////////////////////////////////////////////////////////////////////
 void HLStream::On(Promise *promise)
 {
-    const json &j = promise->meta();
-    std::string action = j["action"];
-    if (action == "add_performer") {
-        add_performer(promise);
-    } else if (action == "add_audience") {
-        add_audience(promise);
-    } else if (action == "remove_audience") {
-        remove_audience(promise);
-    } else if (action == "startup") {
-        Startup(promise);
-    } else if (action == "stop") {
-        Stop(promise);
-    } else {
-        GST_ERROR("[hlstream: %s] action: %s is not supported!", 
-                  uname().c_str(), action.c_str());
-        promise->reject("action: " + action + " is not supported!");
+    if (promise->binary()) {
+        GST_ERROR("[hlstream: %s] binary call is not supported!", uname().c_str());
+        promise->reject("binary call is not supported!");
+        return;
+    }
+    switch (promise->action()) {
+        case PLUGIN_ACTION_ADD_PERFORMER:
+            add_performer(promise);
+            break;
+        case PLUGIN_ACTION_ADD_AUDIENCE:
+            add_audience(promise);
+            break;
+        case PLUGIN_ACTION_REMOVE_AUDIENCE:
+            remove_audience(promise);
+            break;
+        case PLUGIN_ACTION_STARTUP:
+            Startup(promise);
+            break;
+        case PLUGIN_ACTION_STOP:
+            Stop(promise);
+            break;
+        case PLUGIN_ACTION_STATS:
+            stats(promise);
+            break;
+        default:
+            GST_ERROR("[hlstream: %s] action: %s is not supported!",
+                      uname().c_str(), promise->action_name().c_str());
+            promise->reject("action: " + promise->action_name() + " is not supported!");
     }
 }
 /**
@@ -124,7 +151,9 @@ void HLStream::add_performer(Promise *promise)
     const std::string &name = j["name"];
     performer_ = new FileSource(this, name);
     //initialize endpoint and add it to the pipeline
+    TRACE_SPAN(initialize_span, "hlstream.performer.initialize");
     bool rc = performer_->initialize(promise);
+    initialize_span.Stop();
     if(rc) {
         // link endpoint to video/audio tee
         if (on_add_endpoint(performer_)) {
@@ -204,12 +233,36 @@ void HLStream::add_audience(Promise *promise)
     }
     ep->protocol() = protocol;
      // add endpoint to pipeline and link with tee
+    TRACE_SPAN(initialize_span, "hlstream.audience.initialize");
     bool rc = ep->initialize(promise);
+    initialize_span.Stop();
     if (rc) {
         audiences_.push_back(ep);
+        ep->count_as_audience();
         GST_INFO("[hlstream: %s] add audience: %s (type: %s)",
                  uname().c_str(), name.c_str(), protocol.c_str());
-        promise->resolve();
+        bool started = ep->startup([this, promise, name](const std::string &error) {
+            if (error.empty()) {
+                promise->resolve();
+            } else {
+                GST_ERROR("[hlstream: %s] audience: %s %s.",
+                          uname().c_str(), name.c_str(), error.c_str());
+                promise->reject("[hlstream] audience: " + name + " " + error);
+                auto it = find_audience(name);
+                if (it != audiences_.end()) {
+                    IEndpoint *ep = *it;
+                    audiences_.erase(it);
+                    ep->terminate();
+                    delete ep;
+                }
+            }
+            delete promise;
+        });
+        if (started) {
+            promise->Defer();
+        } else {
+            promise->resolve();
+        }
         return;
     }
     ep->terminate();
@@ -225,8 +278,8 @@ bool HLStream::add_fake_endpoint(bool video)
     static bool audio_added = false;
 
     if(!video_added && video) {//video
-        GstElement *queue = gst_element_factory_make("queue", "fake_video_queue");
-        GstElement *sink = gst_element_factory_make("fakesink", "fake_video_sink");
+        GstElement *queue = ElementFactory::Make("queue", "fake_video_queue");
+        GstElement *sink = ElementFactory::Make("fakesink", "fake_video_sink");
         g_object_set( sink, "sync", FALSE, NULL );
         gst_bin_add_many( GST_BIN(pipeline()), queue, sink, NULL );
         gst_element_link_many(queue, sink, NULL);
@@ -243,8 +296,8 @@ bool HLStream::add_fake_endpoint(bool video)
     } 
     
     if(!audio_added && !video) {//audio
-        GstElement *queue = gst_element_factory_make("queue", "fake_audio_queue");
-        GstElement *sink = gst_element_factory_make("fakesink", "fake_audio_sink");
+        GstElement *queue = ElementFactory::Make("queue", "fake_audio_queue");
+        GstElement *sink = ElementFactory::Make("fakesink", "fake_audio_sink");
         g_object_set( sink, "sync", FALSE, NULL );
         gst_bin_add_many( GST_BIN(pipeline()), queue, sink, NULL );
         gst_element_link_many(queue, sink, NULL);
@@ -312,12 +365,13 @@ void HLStream::remove_audience(Promise *promise)
         return;
     }
     IEndpoint *ep = *it;
-    ep->terminate();
-    delete ep;
+    // unlisted first, a pending startup is cancelled by terminate
     audiences_.erase(it);
 
     GST_INFO("[hlstream: %s] remove audience: %s (type: %s)", 
               uname().c_str(), ep->name().c_str(), ep->protocol().c_str());
+    ep->terminate();
+    delete ep;
     
     promise->resolve();
 }
@@ -329,15 +383,41 @@ void HLStream::Startup(Promise *promise)
         promise->reject("there's no performer now, can't startup!");
         return;
     }
-    gst_element_set_state(pipeline(), GST_STATE_PLAYING);
-
     GST_INFO("[hlstream: %s] startup", uname().c_str());
 
-    promise->resolve();
+    promise->Defer();
+    startup_.Start(pipeline(), GST_STATE_PLAYING, ASYNC_STATE_CHANGE_TIMEOUT, context(),
+                   [this, promise](const std::string &error) {
+                       if (error.empty()) {
+                           promise->resolve();
+                       } else {
+                           GST_ERROR("[hlstream: %s] startup: %s.", uname().c_str(), error.c_str());
+                           promise->reject("startup: " + error);
+                       }
+                       delete promise;
+                   });
+}
+
+void HLStream::stats(Promise *promise)
+{
+    json result;
+    json performer;
+    performer["video"] = performer_video_stats_.stats();
+    performer["audio"] = performer_audio_stats_.stats();
+    if (performer_) {
+        performer["name"] = performer_->name();
+        performer["rtp"] = performer_->stats();
+    }
+    result["performer"] = performer;
+    result["audiences"] = audiences_.size();
+    result["bus"] = bus_monitor().stats();
+    result["tee"] = {{"video", video_detacher_.stats()}, {"audio", audio_detacher_.stats()}};
+    promise->resolve(result);
 }
 
 void HLStream::Stop(Promise *promise)
 {
+    startup_.Cancel();
     gst_element_set_state(pipeline(), GST_STATE_NULL);
     if (performer_) {
         GST_DEBUG("[hlstream: %s] remove performer: %s (type: %s)",
@@ -348,14 +428,15 @@ void HLStream::Stop(Promise *promise)
         delete performer_;
         performer_ = NULL;
     }
-    for (auto audience : audiences_) {
+    std::list<IEndpoint *> audiences;
+    audiences.swap(audiences_);
+    for (auto audience : audiences) {
         GST_DEBUG("[hlstream: %s] remove audience: %s (type: %s)",
                   uname().c_str(), audience->name().c_str(),
                   audience->protocol().c_str());
         audience->terminate();
         delete audience;
     }
-    audiences_.clear();
 
     promise->resolve();
 }
@@ -410,24 +491,9 @@ void HLStream::remove_pipe_joint(GstElement *upstream_joint)
 
     GST_DEBUG("[hlstream: %s] remove pipe joint", uname().c_str());
 
-    gst_pad_add_probe(handle->tee_srcpad, GST_PAD_PROBE_TYPE_IDLE, 
-                      on_tee_srcpad_remove_probe, handle, NULL);
-}
-
-GstPadProbeReturn HLStream::on_tee_srcpad_remove_probe(GstPad *srcpad, 
-                                                       GstPadProbeInfo *probe_info,
-                                                       gpointer joint_handle)
-{
-    PipeJointHandle *handle = static_cast<PipeJointHandle *>(joint_handle);
-    g_return_val_if_fail(handle->tee_srcpad == srcpad, GST_PAD_PROBE_OK);
-
-    HLStream * pipeline = static_cast<HLStream *>(handle->pipeline);
-    bool ret = pipeline->remove_pipejoint_handle(handle);
-    g_return_val_if_fail(ret, GST_PAD_PROBE_OK);
-
-    GST_DEBUG("[hlstream: %s] on_tee_srcpad_remove_probe", pipeline->uname().c_str());
-
-    return GST_PAD_PROBE_REMOVE;
+    gchar *media_type = (gchar *)g_object_get_data(G_OBJECT(upstream_joint), "media-type");
+    TeeDetacher &detacher = g_str_equal(media_type, "audio") ? audio_detacher_ : video_detacher_;
+    detacher.Schedule([this, handle]() { remove_pipejoint_handle(handle); });
 }
 
 bool HLStream::remove_pipejoint_handle(PipeJointHandle *handle)
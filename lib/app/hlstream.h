@@ -18,6 +18,9 @@
 #define _LIBWEBSTREAMER_APP_HLS_STREAM_H_
 
 #include <framework/app.h>
+#include <utils/teedetacher.h>
+#include <utils/asyncstatechange.h>
+#include <utils/padstats.h>
 #include <mutex>
 
 struct PipeJointHandle
@@ -54,6 +57,7 @@ protected:
     void remove_audience(Promise *promise);
     void Startup(Promise *promise);
     void Stop(Promise *promise);
+    void stats(Promise *promise);
 
 private:
     bool on_add_endpoint(IEndpoint *endpoint);
@@ -61,11 +65,6 @@ private:
     std::list<IEndpoint *>::iterator
         find_audience(const std::string &name);
     
-    static GstPadProbeReturn
-    on_tee_srcpad_remove_probe(GstPad *srcpad, 
-                               GstPadProbeInfo *probe_info,
-                               gpointer joint_handle);
-    
     bool remove_pipejoint_handle(PipeJointHandle *handle);
 
 private:
@@ -76,8 +75,13 @@ private:
     GstPad *fake_pad_audio_tee_;
     
     IEndpoint *performer_;
+    AsyncStateChange startup_;
     std::list<IEndpoint *> audiences_;
     std::list<PipeJointHandle *> joint_handles_;
+    TeeDetacher video_detacher_;
+    TeeDetacher audio_detacher_;
+    PadStats performer_video_stats_;
+    PadStats performer_audio_stats_;
     std::mutex joint_mutex_;
 };
 
@@ -16,18 +16,19 @@
 
 #include "livestream.h"
 #include <endpoint/rtspclient.h>
+#include <endpoint/sharedrtspclient.h>
 #include <endpoint/rtspservice.h>
 #include <endpoint/webrtc.h>
 #include <webstreamer.h>
 #include <utils/typedef.h>
+#include <utils/elementfactory.h>
+#include <utils/trace.h>
 
 using json = nlohmann::json;
 
 GST_DEBUG_CATEGORY_STATIC(my_category);
 #define GST_CAT_DEFAULT my_category
 
-std::mutex LiveStream::joint_mutex_;
-
 LiveStream::LiveStream(const std::string &name, WebStreamer *ws)
     : IApp(name, ws)
     , performer_(NULL)
@@ -37,6 +38,11 @@ LiveStream::LiveStream(const std::string &name, WebStreamer *ws)
     , audio_tee_pad_(NULL)
     , fake_audio_queue_(NULL)
     , fake_audio_sink_(NULL)
+    , fanout_(false)
+    , keyframe_source_(NULL)
+    , disconnect_source_(NULL)
+    , snapshot_tap_(NULL)
+    , snapshot_timer_(NULL)
 {
 }
 
@@ -46,32 +52,157 @@ LiveStream::~LiveStream()
 bool LiveStream::Initialize(Promise *promise)
 {
     IApp::Initialize(promise);
-    video_tee_ = gst_element_factory_make("tee", "video_tee");
-    audio_tee_ = gst_element_factory_make("tee", "audio_tee");
+    video_tee_ = ElementFactory::Make("tee", "video_tee");
+    audio_tee_ = ElementFactory::Make("tee", "audio_tee");
     g_warn_if_fail(gst_bin_add(GST_BIN(pipeline()), video_tee_));
     g_warn_if_fail(gst_bin_add(GST_BIN(pipeline()), audio_tee_));
+    video_detacher_.Attach(video_tee_);
+    audio_detacher_.Attach(audio_tee_);
+    video_latency_ = std::make_shared<LatencyRing>();
+    audio_latency_ = std::make_shared<LatencyRing>();
+    GstPad *tee_sink = gst_element_get_static_pad(video_tee_, "sink");
+    performer_video_stats_.Attach(tee_sink, PadStats::INGEST, video_latency_);
+    gst_object_unref(tee_sink);
+    tee_sink = gst_element_get_static_pad(audio_tee_, "sink");
+    performer_audio_stats_.Attach(tee_sink, PadStats::INGEST, audio_latency_);
+    gst_object_unref(tee_sink);
+    latency_tracer().Hop(video_tee_, "sink", "performer", "video.tee");
+    latency_tracer().Hop(audio_tee_, "sink", "performer", "audio.tee");
 
     GST_DEBUG_CATEGORY_INIT(my_category, "webstreamer", 2, "libWebStreamer");
 
+    const json &j = promise->data();
+    if (j.is_object() && j.find("queue") != j.end()) {
+        std::string error;
+        if (!AudienceQueue::ParseOptions(j["queue"], &queue_options_, &error)) {
+            GST_ERROR("[livestream] %s: %s", uname().c_str(), error.c_str());
+            return false;
+        }
+    }
+    gint window = 1000;
+    if (j.is_object() && j.find("keyframe_request") != j.end() && j["keyframe_request"].is_object()) {
+        window = MAX(0, j["keyframe_request"].value("window", window));
+    }
+    keyunit_relay_ = KeyUnitRelay::Create(window * GST_MSECOND, [this]() {
+        // streaming threads, the performer belongs to the app loop
+        std::lock_guard<std::mutex> lock(keyframe_mutex_);
+        if (!keyframe_source_) {
+            keyframe_source_ = g_idle_source_new();
+            g_source_set_callback(keyframe_source_, on_forward_keyframe_request, this, NULL);
+            g_source_attach(keyframe_source_, context());
+        }
+    });
+    if (j.is_object() && j.find("gop_cache") != j.end()) {
+        const json &gop = j["gop_cache"];
+        if (!gop.is_boolean() || gop.get<bool>()) {
+            gint max_bytes = gop.is_object() ? gop.value("max_bytes", 8 * 1024 * 1024) : 8 * 1024 * 1024;
+            GstPad *pad = gst_element_get_static_pad(video_tee_, "sink");
+            gop_cache_.Attach(pad, (gsize)MAX(0, max_bytes));
+            gst_object_unref(pad);
+        }
+    }
+    if (j.is_object() && j.value("joint", std::string("proxy")) == "fanout") {
+        GstPad *pad = gst_element_get_static_pad(video_tee_, "sink");
+        video_fanout_.Attach(pad);
+        gst_object_unref(pad);
+        pad = gst_element_get_static_pad(audio_tee_, "sink");
+        audio_fanout_.Attach(pad);
+        gst_object_unref(pad);
+        fanout_ = true;
+        GST_INFO("[livestream] %s uses fan-out joints.", uname().c_str());
+    }
+
     return true;
 }
 bool LiveStream::Destroy(Promise *promise)
 {
+    startup_.Cancel();
+    // destroyed without stop: their pending startups are cancelled, the
+    // callbacks must not come back to this app once deleted
+    terminate_audiences();
     gst_element_set_state(pipeline(), GST_STATE_NULL);
+    performer_video_stats_.Detach();
+    performer_audio_stats_.Detach();
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        audience_stats_.clear();
+    }
+    video_fanout_.Detach();
+    audio_fanout_.Detach();
+    gop_cache_.Detach();
+    if (keyunit_relay_) {
+        keyunit_relay_->Disarm();
+    }
+    {
+        std::lock_guard<std::mutex> lock(keyframe_mutex_);
+        if (keyframe_source_) {
+            g_source_destroy(keyframe_source_);
+            g_source_unref(keyframe_source_);
+            keyframe_source_ = NULL;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        for (auto &it : audience_queues_) {
+            it.second->Disarm();
+        }
+        audience_queues_.clear();
+        audience_queue_options_.clear();
+    }
+    {
+        std::lock_guard<std::mutex> lock(disconnect_mutex_);
+        disconnects_.clear();
+        if (disconnect_source_) {
+            g_source_destroy(disconnect_source_);
+            g_source_unref(disconnect_source_);
+            disconnect_source_ = NULL;
+        }
+    }
+    if (performer_) {
+        // destroyed without stop, a shared source must still be released;
+        // detached first, a pending add_performer is cancelled meanwhile
+        IEndpoint *performer = performer_;
+        performer_ = NULL;
+        performer->terminate();
+        delete performer;
+    }
+    if (snapshot_timer_) {
+        g_source_destroy(snapshot_timer_);
+        g_source_unref(snapshot_timer_);
+        snapshot_timer_ = NULL;
+    }
+    if (snapshot_tap_) {
+        // the elements go with the pipeline
+        gst_element_release_request_pad(video_tee_, snapshot_tap_->tee_pad);
+        gst_object_unref(snapshot_tap_->tee_pad);
+        delete snapshot_tap_;
+        snapshot_tap_ = NULL;
+    }
+    for (auto &request : snapshot_requests_) {
+        request.promise->reject("livestream destroyed.");
+        delete request.promise;
+    }
+    snapshot_requests_.clear();
     if (video_tee_pad_) {
         gst_element_release_request_pad(video_tee_, video_tee_pad_);
     }
     if (audio_tee_pad_) {
         gst_element_release_request_pad(audio_tee_, audio_tee_pad_);
     }
+    // joints removed since the last idle probe
+    video_detacher_.Flush();
+    audio_detacher_.Flush();
     if (!sinks_.empty()) {
-        for (auto info : sinks_) {
+        for (auto &it : sinks_) {
+            sink_link *info = it.second;
             GstElement *upstream_joint = info->upstream_joint;
             LiveStream *pipeline = static_cast<LiveStream *>(info->pipeline);
 
             // remove pipeline dynamicly
             g_warn_if_fail(gst_bin_remove(GST_BIN(pipeline->pipeline()), upstream_joint));
-            gst_element_unlink(pipeline->video_tee_, upstream_joint);
+            if (info->queue) {
+                g_warn_if_fail(gst_bin_remove(GST_BIN(pipeline->pipeline()), info->queue));
+            }
 
             gst_element_release_request_pad(pipeline->video_tee_, info->tee_pad);
             gst_object_unref(info->tee_pad);
@@ -84,26 +215,84 @@ bool LiveStream::Destroy(Promise *promise)
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 void LiveStream::On(Promise *promise)
 {
-    const json &j = promise->meta();
-    std::string action = j["action"];
-    if (action == "add_performer") {
-        add_performer(promise);
-    } else if (action == "add_audience") {
-        add_audience(promise);
-    } else if (action == "remove_audience") {
-        remove_audience(promise);
-    } else if (action == "startup") {
-        Startup(promise);
-    } else if (action == "stop") {
-        Stop(promise);
-    } else if (action == "remote_sdp") {
-        set_remote_description(promise);
-    } else if (action == "remote_candidate") {
-        set_remote_candidate(promise);
-    } else {
-        GST_ERROR("[livestream] action: %s is not supported!", action.c_str());
-        promise->reject("action: " + action + " is not supported!");
+    if (promise->binary() &&
+        (promise->action() == PLUGIN_ACTION_ADD_PERFORMER ||
+         promise->action() == PLUGIN_ACTION_ADD_AUDIENCE ||
+         promise->action() == PLUGIN_ACTION_REMOVE_AUDIENCES)) {
+        GST_ERROR("[livestream] action: %s is not supported by binary call!", promise->action_name().c_str());
+        promise->reject("action: " + promise->action_name() + " is not supported by binary call!");
+        return;
+    }
+    switch (promise->action()) {
+        case PLUGIN_ACTION_ADD_PERFORMER:
+            add_performer(promise);
+            break;
+        case PLUGIN_ACTION_ADD_AUDIENCE:
+            add_audience(promise);
+            break;
+        case PLUGIN_ACTION_REMOVE_AUDIENCE:
+            remove_audience(promise);
+            break;
+        case PLUGIN_ACTION_REMOVE_AUDIENCES:
+            remove_audiences(promise);
+            break;
+        case PLUGIN_ACTION_STATS:
+            stats(promise);
+            break;
+        case PLUGIN_ACTION_STARTUP:
+            Startup(promise);
+            break;
+        case PLUGIN_ACTION_STOP:
+            Stop(promise);
+            break;
+        case PLUGIN_ACTION_REMOTE_SDP:
+            set_remote_description(promise);
+            break;
+        case PLUGIN_ACTION_REMOTE_CANDIDATE:
+            set_remote_candidate(promise);
+            break;
+        case PLUGIN_ACTION_SNAPSHOT:
+            snapshot(promise);
+            break;
+        default:
+            GST_ERROR("[livestream] action: %s is not supported!", promise->action_name().c_str());
+            promise->reject("action: " + promise->action_name() + " is not supported!");
+    }
+}
+bool LiveStream::OpenIngest(const json &performer, std::string *error)
+{
+    // the options travel in promises which are never settled
+    Promise options(NULL, NULL, NULL);
+    if (!Initialize(&options)) {
+        *error = "initialize failed.";
+        return false;
+    }
+    Promise source(NULL, NULL, NULL, json(), performer);
+    performer_ = new RtspClient(this, "ingest");
+    if (!performer_->initialize(&source) || !on_add_endpoint(performer_)) {
+        performer_->terminate();
+        delete performer_;
+        performer_ = NULL;
+        *error = "add performer failed.";
+        return false;
     }
+    performer_->id() = next_endpoint_id();
+    GST_INFO("[livestream] %s ingests %s", uname().c_str(), performer.value("url", std::string()).c_str());
+    return true;
+}
+void LiveStream::StartIngest(const AsyncStateChange::Callback &done)
+{
+    startup_.Start(pipeline(), GST_STATE_PLAYING, ASYNC_STATE_CHANGE_TIMEOUT, context(), done);
+}
+void LiveStream::CancelIngest()
+{
+    startup_.Cancel();
+}
+void LiveStream::CloseIngest()
+{
+    // stops the pipeline and terminates the performer
+    Promise options(NULL, NULL, NULL);
+    Destroy(&options);
 }
 void LiveStream::add_performer(Promise *promise)
 {
@@ -115,14 +304,49 @@ void LiveStream::add_performer(Promise *promise)
     // create endpoint
     const json &j = promise->data();
     const std::string &name = j["name"];
-    performer_ = new RtspClient(this, name);
+    if (j.value("shared", false)) {
+        // one rtsp session per url + codec, whatever the app count
+        performer_ = new SharedRtspClient(this, name);
+    } else {
+        performer_ = new RtspClient(this, name);
+    }
     // initialize endpoint and add it to the pipeline
+    TRACE_SPAN(initialize_span, "livestream.performer.initialize");
     bool rc = performer_->initialize(promise);
+    initialize_span.Stop();
     if (rc) {
+        // a shared source is settled once its ingest plays, on this loop
+        IEndpoint *performer = performer_;
+        bool started = performer_->startup([this, promise, name, performer](const std::string &error) {
+            if (error.empty() && on_add_endpoint(performer)) {
+                performer->id() = next_endpoint_id();
+                GST_INFO("[livestream] add performer: %s (type: %s)", name.c_str(), performer->protocol().c_str());
+                json result;
+                result["id"] = performer->id();
+                promise->resolve(result);
+            } else {
+                GST_ERROR("[livestream] add performer: %s failed! %s", name.c_str(), error.c_str());
+                promise->reject("add performer " + name + " failed!");
+                // not there anymore when it is being stopped
+                if (performer_ == performer) {
+                    performer_ = NULL;
+                    performer->terminate();
+                    delete performer;
+                }
+            }
+            delete promise;
+        });
+        if (started) {
+            promise->Defer();
+            return;
+        }
         // link endpoint to video/audio tee
         if (on_add_endpoint(performer_)) {
+            performer_->id() = next_endpoint_id();
             GST_INFO("[livestream] add performer: %s (type: %s)", name.c_str(), performer_->protocol().c_str());
-            promise->resolve();
+            json result;
+            result["id"] = performer_->id();
+            promise->resolve(result);
             return;
         }
     }
@@ -132,13 +356,40 @@ void LiveStream::add_performer(Promise *promise)
     GST_ERROR("[livestream] add performer: %s failed!", name.c_str());
     promise->reject("add performer " + name + " failed!");
 }
-std::list<IEndpoint *>::iterator LiveStream::find_audience(const std::string &name)
+IEndpoint *LiveStream::find_audience(const std::string &name)
+{
+    guint32 id = 0;
+    IEndpoint *ep = NULL;
+    if (audience_ids_.Find(name, &id)) {
+        audiences_.Find(id, &ep);
+    }
+    return ep;
+}
+IEndpoint *LiveStream::find_audience(Promise *promise, std::string *name)
 {
-    return std::find_if(audiences_.begin(),
-                        audiences_.end(),
-                        [&name](IEndpoint *ep) {
-                            return ep->name() == name;
-                        });
+    if (promise->binary()) {
+        guint32 id = promise->endpoint_id();
+        *name = "#" + std::to_string(id);
+        IEndpoint *ep = NULL;
+        audiences_.Find(id, &ep);
+        return ep;
+    }
+    const json &j = promise->data();
+    *name = j["name"].get<std::string>();
+    return find_audience(*name);
+}
+void LiveStream::register_audience(IEndpoint *ep)
+{
+    ep->id() = next_endpoint_id();
+    audiences_.Insert(ep->id(), ep);
+    audience_ids_.Insert(ep->name(), ep->id());
+    ep->count_as_audience();
+}
+void LiveStream::unregister_audience(IEndpoint *ep)
+{
+    // readers are out once this returns, ep may be deleted
+    audience_ids_.Erase(ep->name());
+    audiences_.Erase(ep->id());
 }
 
 void LiveStream::add_audience(Promise *promise)
@@ -152,11 +403,25 @@ void LiveStream::add_audience(Promise *promise)
     }
     const std::string &name = j["name"];
     const std::string protocol = j["protocol"];
-    if (find_audience(name) != audiences_.end()) {
+    if (find_audience(name)) {
         GST_ERROR("[livestream] audience: %s has been added.", name.c_str());
         promise->reject("[livestream] audience: " + name + " has been added.");
         return;
     }
+    AudienceQueue::Options queue_options = queue_options_;
+    if (j.find("queue") != j.end()) {
+        std::string error;
+        if (!AudienceQueue::ParseOptions(j["queue"], &queue_options, &error)) {
+            GST_ERROR("[livestream] audience: %s, %s", name.c_str(), error.c_str());
+            promise->reject("[livestream] audience: " + name + ", " + error);
+            return;
+        }
+    }
+    {
+        // the joints are made while the endpoint initializes
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        audience_queue_options_[name] = queue_options;
+    }
     // create endpoint
     IEndpoint *ep;
     switch (get_endpoint_type(protocol)) {
@@ -179,43 +444,161 @@ void LiveStream::add_audience(Promise *promise)
         } break;
         default: {
             GST_ERROR("[livestream] protocol: %s not supported.", protocol.c_str());
+            release_audience_queues(name);
             promise->reject("[livestream] protocol: " + protocol + " not supported.");
             return;
         }
     }
     ep->protocol() = protocol;
+    TRACE_SPAN(initialize_span, "livestream.audience.initialize");
     bool rc = ep->initialize(promise);
+    initialize_span.Stop();
     if (rc) {
         // add endpoint to pipeline and link with tee
-        audiences_.push_back(ep);
+        register_audience(ep);
         GST_INFO("[livestream] add audience: %s (type: %s)", name.c_str(), protocol.c_str());
-        promise->resolve();
+        json result;
+        result["id"] = ep->id();
+        // settled once the audience pipeline plays, on this loop
+        bool started = ep->startup([this, promise, name, result](const std::string &error) {
+            if (error.empty()) {
+                promise->resolve(result);
+            } else {
+                GST_ERROR("[livestream] audience: %s %s.", name.c_str(), error.c_str());
+                promise->reject("[livestream] audience: " + name + " " + error);
+                // not there anymore when it is being removed
+                IEndpoint *ep = find_audience(name);
+                if (ep) {
+                    unregister_audience(ep);
+                    release_audience_queues(name);
+                    ep->terminate();
+                    delete ep;
+                }
+            }
+            delete promise;
+        });
+        if (started) {
+            promise->Defer();
+        } else {
+            promise->resolve(result);
+        }
         return;
     }
     ep->terminate();
     delete ep;
     ep = NULL;
+    release_audience_queues(name);
     GST_ERROR("[livestream] add audience: %s failed!", name.c_str());
     promise->reject("add audience " + name + " failed!");
 }
 void LiveStream::remove_audience(Promise *promise)
 {
-    const json &j = promise->data();
-    const std::string &name = j["name"];
-    auto it = find_audience(name);
-    if (it == audiences_.end()) {
+    std::string name;
+    IEndpoint *ep = find_audience(promise, &name);
+    if (!ep) {
         GST_ERROR("[livestream] audience: %s has not been added.", name.c_str());
         promise->reject("[livestream] audience: " + name + " has not been added.");
         return;
     }
-    IEndpoint *ep = *it;
+    unregister_audience(ep);
+    // counters are taken before the joints go away
+    json result;
+    result["queue"] = release_audience_queues(ep->name());
     ep->terminate();
-    audiences_.erase(it);
 
     GST_INFO("[livestream] remove audience: %s (type: %s)", ep->name().c_str(), ep->protocol().c_str());
 
     delete ep;
-    promise->resolve();
+    promise->resolve(result);
+}
+void LiveStream::remove_audiences(Promise *promise)
+{
+    const json &j = promise->data();
+    if (!j.is_object() || j.find("names") == j.end() || !j["names"].is_array()) {
+        GST_ERROR("[livestream] remove audiences: names is not an array.");
+        promise->reject("[livestream] remove audiences: names is not an array.");
+        return;
+    }
+    std::vector<IEndpoint *> leaving;
+    json missing = json::array();
+    for (auto &name : j["names"]) {
+        IEndpoint *ep = name.is_string() ? find_audience(name.get<std::string>()) : NULL;
+        if (ep) {
+            unregister_audience(ep);
+            leaving.push_back(ep);
+        } else {
+            missing.push_back(name);
+        }
+    }
+
+    // every joint of the batch leaves its tee in the same idle probe
+    video_detacher_.Hold();
+    audio_detacher_.Hold();
+    json removed = json::object();
+    for (auto ep : leaving) {
+        removed[ep->name()] = {{"queue", release_audience_queues(ep->name())}};
+        ep->terminate();
+        GST_INFO("[livestream] remove audience: %s (type: %s)", ep->name().c_str(), ep->protocol().c_str());
+        delete ep;
+    }
+    video_detacher_.Release();
+    audio_detacher_.Release();
+
+    json result;
+    result["removed"] = removed;
+    result["missing"] = missing;
+    result["tee"] = {{"video", video_detacher_.stats()}, {"audio", audio_detacher_.stats()}};
+    promise->resolve(result);
+}
+
+void LiveStream::stats(Promise *promise)
+{
+    json result;
+    json performer;
+    performer["video"] = performer_video_stats_.stats();
+    performer["audio"] = performer_audio_stats_.stats();
+    if (performer_) {
+        performer["name"] = performer_->name();
+        performer["rtp"] = performer_->stats();
+    }
+    result["performer"] = performer;
+    json audiences = json::object();
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        for (auto &it : audience_stats_) {
+            audiences[it.first][it.second.first] = it.second.second->stats();
+        }
+    }
+    for (auto it = audiences.begin(); it != audiences.end(); ++it) {
+        IEndpoint *ep = find_audience(it.key());
+        if (ep) {
+            it.value()["transport"] = ep->stats();
+        }
+    }
+    result["audiences"] = audiences;
+    result["bus"] = bus_monitor().stats();
+    result["tee"] = {{"video", video_detacher_.stats()}, {"audio", audio_detacher_.stats()}};
+    json queues = json::object();
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        for (auto &it : audience_queues_) {
+            if (queues.find(it.first) == queues.end()) {
+                queues[it.first] = json::array();
+            }
+            queues[it.first].push_back(it.second->stats());
+        }
+    }
+    result["queue"] = queues;
+    if (gop_cache_.attached()) {
+        result["gop_cache"] = {{"buffers", gop_cache_.buffers()}, {"bytes", gop_cache_.bytes()}};
+    }
+    if (keyunit_relay_) {
+        result["keyframe_request"] = keyunit_relay_->stats();
+    }
+    if (LatencyTracer::enabled()) {
+        result["latency"] = latency_tracer().stats();
+    }
+    promise->resolve(result);
 }
 
 void LiveStream::Startup(Promise *promise)
@@ -225,82 +608,256 @@ void LiveStream::Startup(Promise *promise)
         promise->reject("there's no performer now, can't startup!");
         return;
     }
-    gst_element_set_state(pipeline(), GST_STATE_PLAYING);
-    promise->resolve();
+    const json &j = promise->data();
+    gint timeout = j.is_object() ? j.value("timeout", 0) : 0;
+    promise->Defer();
+    startup_.Start(pipeline(),
+                   GST_STATE_PLAYING,
+                   timeout > 0 ? timeout * GST_MSECOND : ASYNC_STATE_CHANGE_TIMEOUT,
+                   context(),
+                   [this, promise](const std::string &error) {
+                       if (error.empty()) {
+                           promise->resolve();
+                       } else {
+                           GST_ERROR("[livestream] %s startup: %s.", uname().c_str(), error.c_str());
+                           promise->reject("startup: " + error);
+                       }
+                       delete promise;
+                   });
 }
 void LiveStream::Stop(Promise *promise)
 {
+    startup_.Cancel();
     gst_element_set_state(pipeline(), GST_STATE_NULL);
     if (performer_) {
         GST_DEBUG("[livestream] remove performer: %s (type: %s)",
                   performer_->name().c_str(),
                   performer_->protocol().c_str());
-        performer_->terminate();
-        delete performer_;
+        IEndpoint *performer = performer_;
+        performer_ = NULL;
+        performer->terminate();
+        delete performer;
     }
-    for (auto audience : audiences_) {
+    terminate_audiences();
+    promise->resolve();
+}
+void LiveStream::terminate_audiences()
+{
+    audience_ids_.Clear();
+    for (auto &it : audiences_.Clear()) {
+        IEndpoint *audience = it.second;
         GST_DEBUG("[livestream] remove audience: %s (type: %s)",
                   audience->name().c_str(),
                   audience->protocol().c_str());
+        release_audience_queues(audience->name());
         audience->terminate();
         delete audience;
     }
-    promise->resolve();
 }
 
 void LiveStream::set_remote_description(Promise *promise)
 {
-    const json &j = promise->data();
-
-    const std::string &name = j["name"];
-    auto it = find_audience(name);
-    if (it == audiences_.end()) {
+    std::string name;
+    IEndpoint *audience = find_audience(promise, &name);
+    if (!audience) {
         GST_ERROR("[livestream] audience: %s has not been added.", name.c_str());
         promise->reject("[livestream] audience: " + name + " has not been added.");
         return;
     }
-    WebRTC *ep = static_cast<WebRTC *>(*it);
-    ep->set_remote_description(promise);
-
+    WebRTC *ep = static_cast<WebRTC *>(audience);
+    if (!ep->set_remote_description(promise)) {
+        promise->reject("[livestream] audience: " + name + " invalid remote description.");
+        return;
+    }
     promise->resolve();
 }
 void LiveStream::set_remote_candidate(Promise *promise)
 {
-    const json &j = promise->data();
-
-    const std::string &name = j["name"];
-    auto it = find_audience(name);
-    if (it == audiences_.end()) {
+    std::string name;
+    IEndpoint *audience = find_audience(promise, &name);
+    if (!audience) {
         GST_ERROR("[livestream] audience: %s has not been added.", name.c_str());
         promise->reject("[livestream] audience: " + name + " has not been added.");
         return;
     }
-    WebRTC *ep = static_cast<WebRTC *>(*it);
-    ep->set_remote_candidate(promise);
-
+    WebRTC *ep = static_cast<WebRTC *>(audience);
+    if (!ep->set_remote_candidate(promise)) {
+        promise->reject("[livestream] audience: " + name + " invalid remote candidate.");
+        return;
+    }
     promise->resolve();
 }
 ///////////////////////////////////////////////////////////////////////////////////////////////////
+// keyframe snapshot
+void LiveStream::snapshot(Promise *promise)
+{
+    if (!performer_ || video_encoding().empty()) {
+        GST_ERROR("[livestream] there's no video to snapshot!");
+        promise->reject("there's no video to snapshot!");
+        return;
+    }
+    KeyframeSnapshot::Request request;
+    if (!KeyframeSnapshot::ParseRequest(promise->binary() ? json() : promise->data(), &request)) {
+        GST_ERROR("[livestream] invalid snapshot option!");
+        promise->reject("invalid snapshot option!");
+        return;
+    }
+    request.promise = promise;
+    promise->Defer();
+    {
+        std::lock_guard<std::mutex> lock(snapshot_mutex_);
+        snapshot_requests_.push_back(request);
+    }
+    if (!snapshot_tap_) {
+        install_snapshot_tap();
+    }
+    if (!snapshot_timer_) {
+        snapshot_timer_ = g_timeout_source_new(200);
+        g_source_set_callback(snapshot_timer_, LiveStream::on_snapshot_tick, this, NULL);
+        g_source_attach(snapshot_timer_, context());
+    }
+}
+void LiveStream::install_snapshot_tap()
+{
+    SnapshotTap *tap = new SnapshotTap;
+    tap->app = this;
+    tap->queue = ElementFactory::Make("queue", NULL);
+    tap->sink = ElementFactory::Make("fakesink", NULL);
+    // never holds back the tee, only the newest buffer is kept
+    g_object_set(tap->queue,
+                 "leaky", 2,
+                 "max-size-buffers", 1,
+                 "max-size-bytes", 0,
+                 "max-size-time", (guint64)0,
+                 NULL);
+    g_object_set(tap->sink, "sync", FALSE, "async", FALSE, NULL);
+    gst_bin_add_many(GST_BIN(pipeline()), tap->queue, tap->sink, NULL);
+    g_warn_if_fail(gst_element_link(tap->queue, tap->sink));
+
+    GstPad *pad = gst_element_get_static_pad(tap->queue, "src");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, LiveStream::on_snapshot_keyframe, this, NULL);
+    gst_object_unref(pad);
+    gst_element_sync_state_with_parent(tap->sink);
+    gst_element_sync_state_with_parent(tap->queue);
+
+    GstPadTemplate *templ = gst_element_class_get_pad_template(GST_ELEMENT_GET_CLASS(video_tee_), "src_%u");
+    tap->tee_pad = gst_element_request_pad(video_tee_, templ, NULL, NULL);
+    GstPad *sinkpad = gst_element_get_static_pad(tap->queue, "sink");
+    g_warn_if_fail(gst_pad_link(tap->tee_pad, sinkpad) == GST_PAD_LINK_OK);
+    gst_object_unref(sinkpad);
+
+    snapshot_tap_ = tap;
+    GST_DEBUG("[livestream] snapshot tap installed.");
+}
+void LiveStream::remove_snapshot_tap()
+{
+    SnapshotTap *tap = snapshot_tap_;
+    snapshot_tap_ = NULL;
+    gst_pad_add_probe(tap->tee_pad, GST_PAD_PROBE_TYPE_IDLE, LiveStream::on_snapshot_tap_idle, tap, NULL);
+}
+GstPadProbeReturn LiveStream::on_snapshot_tap_idle(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    SnapshotTap *tap = static_cast<SnapshotTap *>(user_data);
+    LiveStream *app = tap->app;
+
+    GstPad *sinkpad = gst_element_get_static_pad(tap->queue, "sink");
+    gst_pad_unlink(tap->tee_pad, sinkpad);
+    gst_object_unref(sinkpad);
+    gst_element_set_state(tap->queue, GST_STATE_NULL);
+    gst_element_set_state(tap->sink, GST_STATE_NULL);
+    g_warn_if_fail(gst_bin_remove(GST_BIN(app->pipeline()), tap->queue));
+    g_warn_if_fail(gst_bin_remove(GST_BIN(app->pipeline()), tap->sink));
+
+    gst_element_release_request_pad(app->video_tee_, tap->tee_pad);
+    gst_object_unref(tap->tee_pad);
+    delete tap;
+    GST_DEBUG("[livestream] snapshot tap removed.");
+    return GST_PAD_PROBE_REMOVE;
+}
+GstPadProbeReturn LiveStream::on_snapshot_keyframe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    LiveStream *app = static_cast<LiveStream *>(user_data);
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    // a keyframe, codec headers sent apart (sps/pps) and gaps
+    // have no delta flag either and are not decodable alone
+    if (GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT) ||
+        GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_HEADER) ||
+        GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_GAP) ||
+        gst_buffer_get_size(buffer) == 0) {
+        return GST_PAD_PROBE_DROP;
+    }
+    // the decoder needs the codec caps, wait for the next keyframe
+    GstCaps *caps = gst_pad_get_current_caps(pad);
+    if (!caps) {
+        return GST_PAD_PROBE_DROP;
+    }
+
+    std::vector<KeyframeSnapshot::Request> requests;
+    {
+        std::lock_guard<std::mutex> lock(app->snapshot_mutex_);
+        requests.swap(app->snapshot_requests_);
+    }
+    if (!requests.empty()) {
+        // one decode serves every request waiting for this keyframe
+        KeyframeSnapshot::Submit(gst_sample_new(buffer, caps, NULL, NULL), requests);
+    }
+    gst_caps_unref(caps);
+    return GST_PAD_PROBE_DROP;
+}
+gboolean LiveStream::on_snapshot_tick(gpointer user_data)
+{
+    LiveStream *app = static_cast<LiveStream *>(user_data);
+    gint64 now = g_get_monotonic_time();
+    std::vector<KeyframeSnapshot::Request> expired;
+    bool idle;
+    {
+        std::lock_guard<std::mutex> lock(app->snapshot_mutex_);
+        auto &requests = app->snapshot_requests_;
+        auto it = std::partition(requests.begin(), requests.end(),
+                                 [now](const KeyframeSnapshot::Request &r) {
+                                     return r.deadline > now;
+                                 });
+        expired.assign(it, requests.end());
+        requests.erase(it, requests.end());
+        idle = requests.empty();
+    }
+    for (auto &request : expired) {
+        GST_ERROR("[livestream] no keyframe for snapshot in time!");
+        request.promise->reject("no keyframe for snapshot in time!");
+        delete request.promise;
+    }
+    if (!idle) {
+        return G_SOURCE_CONTINUE;
+    }
+    // nothing waits any more, stop tapping the tee
+    if (app->snapshot_tap_) {
+        app->remove_snapshot_tap();
+    }
+    g_source_unref(app->snapshot_timer_);
+    app->snapshot_timer_ = NULL;
+    return G_SOURCE_REMOVE;
+}
+///////////////////////////////////////////////////////////////////////////////////////////////////
 // for rtspclient
 bool LiveStream::on_add_endpoint(IEndpoint *endpoint)
 {
     switch (get_endpoint_type(endpoint->protocol())) {
         case EndpointType::RTSP_CLIENT: {
             if (!video_encoding().empty()) {
-                GstElement *parse = gst_bin_get_by_name_recurse_up(GST_BIN(pipeline()), "parse");
+                GstElement *parse = endpoint->video_output();
                 g_warn_if_fail(parse);
 
                 g_warn_if_fail(gst_element_link(parse, video_tee_));
-                fake_video_queue_ = gst_element_factory_make("queue", "fake_video_queue");
+                fake_video_queue_ = ElementFactory::Make("queue", "fake_video_queue");
 
 #ifdef USE_AUTO_SINK
-                fake_video_decodec_ = gst_element_factory_make("avdec_h264", "fake_video_decodec");
-                fake_video_sink_ = gst_element_factory_make("autovideosink", "fake_video_sink");
+                fake_video_decodec_ = ElementFactory::Make("avdec_h264", "fake_video_decodec");
+                fake_video_sink_ = ElementFactory::Make("autovideosink", "fake_video_sink");
                 g_object_set(fake_video_sink_, "sync", FALSE, NULL);
                 gst_bin_add_many(GST_BIN(pipeline()), fake_video_decodec_, fake_video_queue_, fake_video_sink_, NULL);
                 gst_element_link_many(fake_video_queue_, fake_video_decodec_, fake_video_sink_, NULL);
 #else
-                fake_video_sink_ = gst_element_factory_make("fakesink", "fake_video_sink");
+                fake_video_sink_ = ElementFactory::Make("fakesink", "fake_video_sink");
                 g_object_set(fake_video_sink_, "sync", FALSE, NULL);
                 gst_bin_add_many(GST_BIN(pipeline()), fake_video_queue_, fake_video_sink_, NULL);
                 gst_element_link_many(fake_video_queue_, fake_video_sink_, NULL);
@@ -318,17 +875,17 @@ bool LiveStream::on_add_endpoint(IEndpoint *endpoint)
                 // gst_object_unref(pad);
             }
             if (!audio_encoding().empty()) {
-                GstElement *audio_depay = gst_bin_get_by_name_recurse_up(GST_BIN(pipeline()), "audio-depay");
+                GstElement *audio_depay = endpoint->audio_output();
                 g_warn_if_fail(audio_depay);
 
                 g_warn_if_fail(gst_element_link(audio_depay, audio_tee_));
-                fake_audio_queue_ = gst_element_factory_make("queue", "fake_audio_queue");
+                fake_audio_queue_ = ElementFactory::Make("queue", "fake_audio_queue");
 
 #ifdef USE_AUTO_SINK
-                fake_audio_decodec_ = gst_element_factory_make("alawdec", "fake_audio_decodec");
-                fake_audio_sink_ = gst_element_factory_make("autoaudiosink", "fake_audio_sink");
-                fake_audio_convert_ = gst_element_factory_make("audioconvert", "fake_audio_convert");
-                fake_audio_resample_ = gst_element_factory_make("audioresample", "fake_audio_resample");
+                fake_audio_decodec_ = ElementFactory::Make("alawdec", "fake_audio_decodec");
+                fake_audio_sink_ = ElementFactory::Make("autoaudiosink", "fake_audio_sink");
+                fake_audio_convert_ = ElementFactory::Make("audioconvert", "fake_audio_convert");
+                fake_audio_resample_ = ElementFactory::Make("audioresample", "fake_audio_resample");
                 g_object_set(fake_audio_sink_, "sync", FALSE, NULL);
                 gst_bin_add_many(GST_BIN(pipeline()),
                                  fake_audio_decodec_,
@@ -344,7 +901,7 @@ bool LiveStream::on_add_endpoint(IEndpoint *endpoint)
                                       fake_audio_sink_,
                                       NULL);
 #else
-                fake_audio_sink_ = gst_element_factory_make("fakesink", "fake_audio_sink");
+                fake_audio_sink_ = ElementFactory::Make("fakesink", "fake_audio_sink");
                 g_object_set(fake_audio_sink_, "sync", FALSE, NULL);
                 gst_bin_add_many(GST_BIN(pipeline()), fake_audio_queue_, fake_audio_sink_, NULL);
                 gst_element_link_many(fake_audio_queue_, fake_audio_sink_, NULL);
@@ -391,129 +948,290 @@ bool LiveStream::on_add_endpoint(IEndpoint *endpoint)
 }
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // for other endpoint
-void LiveStream::add_pipe_joint(GstElement *upstream_joint)
+// the audience a joint belongs to, set by make_joint
+struct AudienceJointConfig
 {
-    joint_mutex_.lock();
+    std::string audience;
+    AudienceQueue::Options options;
+};
+static void free_audience_joint_config(gpointer data)
+{
+    delete static_cast<AudienceJointConfig *>(data);
+}
+PipeJoint LiveStream::make_joint(IEndpoint *endpoint,
+                                 const std::string &media_type,
+                                 const std::string &name)
+{
+    TRACE_SPAN(span, "livestream.make_joint");
+    PipeJoint joint = fanout_ ? make_fanout_joint(media_type, name)
+                              : make_pipe_joint(media_type, name);
+    AudienceJointConfig *config = new AudienceJointConfig();
+    config->options = queue_options_;
+    if (endpoint) {
+        config->audience = endpoint->name();
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        auto it = audience_queue_options_.find(config->audience);
+        if (it != audience_queue_options_.end()) {
+            config->options = it->second;
+        }
+    }
+    if (media_type == "video" && keyunit_relay_) {
+        // upstream events can't cross the joint, catch them before it
+        GstPad *pad = gst_element_get_static_pad(joint.downstream_joint, "src");
+        keyunit_relay_->Watch(pad, config->audience);
+        gst_object_unref(pad);
+    }
+    if (endpoint) {
+        // what the audience pipeline gets, after queue and joint
+        std::shared_ptr<PadStats> stats = std::make_shared<PadStats>();
+        GstPad *pad = gst_element_get_static_pad(joint.downstream_joint, "src");
+        stats->Attach(pad, PadStats::EGRESS, media_type == "video" ? video_latency_ : audio_latency_);
+        gst_object_unref(pad);
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        audience_stats_.insert(std::make_pair(config->audience, std::make_pair(media_type, stats)));
+        // fan-out joints are a single queue, in and out are its pads
+        latency_tracer().Hop(joint.upstream_joint, "sink", config->audience, media_type + ".joint.in");
+        latency_tracer().Hop(joint.downstream_joint, "src", config->audience, media_type + ".joint.out");
+    }
+    g_object_set_data_full(G_OBJECT(joint.upstream_joint),
+                           "audience-joint-config",
+                           config,
+                           free_audience_joint_config);
+    return joint;
+}
+void LiveStream::install_audience_queue(GstElement *queue, GstElement *upstream_joint)
+{
+    AudienceJointConfig *config =
+        (AudienceJointConfig *)g_object_get_data(G_OBJECT(upstream_joint), "audience-joint-config");
     gchar *media_type = (gchar *)g_object_get_data(G_OBJECT(upstream_joint), "media-type");
-    if (g_str_equal(media_type, "video")) {
-        GST_DEBUG("[livestream] add pipe joint: video");
-        GstPadTemplate *templ = gst_element_class_get_pad_template(GST_ELEMENT_GET_CLASS(video_tee_), "src_%u");
-        GstPad *pad = gst_element_request_pad(video_tee_, templ, NULL, NULL);
-        sink_link *info = new sink_link(pad, upstream_joint, this);
+    AudienceQueue::Options options = config ? config->options : queue_options_;
+    std::string audience = config ? config->audience : std::string();
+    auto queue_ref = AudienceQueue::Install(queue,
+                                            options,
+                                            audience,
+                                            media_type,
+                                            [this](AudienceQueue *q) {
+                                                request_disconnect(q->audience());
+                                            });
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    audience_queues_.insert(std::make_pair(audience, queue_ref));
+}
+sink_link *LiveStream::link_pipe_joint(GstElement *tee, GstElement *upstream_joint)
+{
+    GstPadTemplate *templ = gst_element_class_get_pad_template(GST_ELEMENT_GET_CLASS(tee), "src_%u");
+    GstPad *pad = gst_element_request_pad(tee, templ, NULL, NULL);
+    sink_link *info = new sink_link(pad, upstream_joint, this);
 
-        g_warn_if_fail(gst_bin_add(GST_BIN(pipeline()), upstream_joint));
-        gst_element_sync_state_with_parent(upstream_joint);
+    // the tee pushes synchronously, the queue keeps a congested
+    // audience from blocking it (and every other audience)
+    gchar *name = g_strdup_printf("%s_queue", GST_ELEMENT_NAME(upstream_joint));
+    info->queue = ElementFactory::Make("queue", name);
+    g_free(name);
+    install_audience_queue(info->queue, upstream_joint);
 
+    g_warn_if_fail(gst_bin_add(GST_BIN(pipeline()), info->queue));
+    g_warn_if_fail(gst_bin_add(GST_BIN(pipeline()), upstream_joint));
+    g_warn_if_fail(gst_element_link(info->queue, upstream_joint));
+    gst_element_sync_state_with_parent(upstream_joint);
+    gst_element_sync_state_with_parent(info->queue);
+
+    GstPad *sinkpad = gst_element_get_static_pad(info->queue, "sink");
+    if (tee == video_tee_ && gop_cache_.attached()) {
+        gop_cache_.Prime(sinkpad);
+    }
+    GstPadLinkReturn ret = gst_pad_link(pad, sinkpad);
+    g_warn_if_fail(ret == GST_PAD_LINK_OK);
+    gst_object_unref(sinkpad);
+    return info;
+}
+void LiveStream::request_keyframe(const std::string &origin)
+{
+    if (keyunit_relay_) {
+        keyunit_relay_->Request(origin);
+    }
+}
+gboolean LiveStream::on_forward_keyframe_request(gpointer user_data)
+{
+    LiveStream *app = static_cast<LiveStream *>(user_data);
+    {
+        std::lock_guard<std::mutex> lock(app->keyframe_mutex_);
+        g_source_unref(app->keyframe_source_);
+        app->keyframe_source_ = NULL;
+    }
+    if (app->performer_) {
+        app->performer_->request_keyframe();
+    }
+    return G_SOURCE_REMOVE;
+}
+void LiveStream::add_pipe_joint(GstElement *upstream_joint)
+{
+    gchar *joint_media_type = (gchar *)g_object_get_data(G_OBJECT(upstream_joint), "media-type");
+    if (g_str_equal(joint_media_type, "video") && !gop_cache_.attached()) {
+        // a new viewer can't decode anything before the next keyframe
+        AudienceJointConfig *config =
+            (AudienceJointConfig *)g_object_get_data(G_OBJECT(upstream_joint), "audience-joint-config");
+        request_keyframe(config ? config->audience : std::string());
+    }
+    if (is_fanout_joint(upstream_joint)) {
+        gchar *media_type = (gchar *)g_object_get_data(G_OBJECT(upstream_joint), "media-type");
+        FanOut &fanout = g_str_equal(media_type, "audio") ? audio_fanout_ : video_fanout_;
+        // the joint is the audience queue itself
+        install_audience_queue(upstream_joint, upstream_joint);
         GstPad *sinkpad = gst_element_get_static_pad(upstream_joint, "sink");
-        GstPadLinkReturn ret = gst_pad_link(pad, sinkpad);
-        g_warn_if_fail(ret == GST_PAD_LINK_OK);
+        if (&fanout == &video_fanout_ && gop_cache_.attached()) {
+            gop_cache_.Prime(sinkpad);
+        }
+        g_warn_if_fail(fanout.Subscribe(sinkpad));
         gst_object_unref(sinkpad);
-
-        sinks_.push_back(info);
+        GST_DEBUG("[livestream] add fan-out joint: %s", media_type);
+        return;
+    }
+    joint_mutex_.lock();
+    gchar *media_type = (gchar *)g_object_get_data(G_OBJECT(upstream_joint), "media-type");
+    if (g_str_equal(media_type, "video")) {
+        GST_DEBUG("[livestream] add pipe joint: video");
+        sinks_[upstream_joint] = link_pipe_joint(video_tee_, upstream_joint);
     } else if (g_str_equal(media_type, "audio")) {
         GST_DEBUG("[livestream] add pipe joint: audio");
-        GstPadTemplate *templ = gst_element_class_get_pad_template(GST_ELEMENT_GET_CLASS(audio_tee_), "src_%u");
-        GstPad *pad = gst_element_request_pad(audio_tee_, templ, NULL, NULL);
-        sink_link *info = new sink_link(pad, upstream_joint, this);
-
-        g_warn_if_fail(gst_bin_add(GST_BIN(pipeline()), upstream_joint));
-        gst_element_sync_state_with_parent(upstream_joint);
-
-        GstPad *sinkpad = gst_element_get_static_pad(upstream_joint, "sink");
-        GstPadLinkReturn ret = gst_pad_link(pad, sinkpad);
-        g_warn_if_fail(ret == GST_PAD_LINK_OK);
-        gst_object_unref(sinkpad);
-
-        sinks_.push_back(info);
+        sinks_[upstream_joint] = link_pipe_joint(audio_tee_, upstream_joint);
     }
     joint_mutex_.unlock();
 }
-GstPadProbeReturn LiveStream::on_tee_pad_remove_video_probe(GstPad *teepad, GstPadProbeInfo *probe_info, gpointer data)
+void LiveStream::unlink_pipe_joint(sink_link *info, GstElement *tee)
 {
-    sink_link *info = static_cast<sink_link *>(data);
-    if (!g_atomic_int_compare_and_exchange(&info->video_probe_invoke_control, TRUE, FALSE)) {
-        return GST_PAD_PROBE_OK;
-    }
-
     GstElement *upstream_joint = info->upstream_joint;
     LiveStream *pipeline = static_cast<LiveStream *>(info->pipeline);
 
     // remove pipeline dynamicaly
-    GstPad *sinkpad = gst_element_get_static_pad(upstream_joint, "sink");
+    GstPad *sinkpad = gst_element_get_static_pad(info->queue, "sink");
     gst_pad_unlink(info->tee_pad, sinkpad);
     gst_object_unref(sinkpad);
+    gst_element_set_state(info->queue, GST_STATE_NULL);
     gst_element_set_state(upstream_joint, GST_STATE_NULL);
+    g_warn_if_fail(gst_bin_remove(GST_BIN(pipeline->pipeline()), info->queue));
     g_warn_if_fail(gst_bin_remove(GST_BIN(pipeline->pipeline()), upstream_joint));
 
-    gst_element_release_request_pad(pipeline->video_tee_, info->tee_pad);
+    gst_element_release_request_pad(tee, info->tee_pad);
     gst_object_unref(info->tee_pad);
-    delete static_cast<sink_link *>(data);
-    GST_DEBUG("[livestream] remove video joint from tee pad");
-    return GST_PAD_PROBE_REMOVE;
+    delete info;
 }
-GstPadProbeReturn LiveStream::on_tee_pad_remove_audio_probe(GstPad *pad, GstPadProbeInfo *probe_info, gpointer data)
+void LiveStream::remove_pipe_joint(GstElement *upstream_joint)
 {
-    sink_link *info = static_cast<sink_link *>(data);
-    if (!g_atomic_int_compare_and_exchange(&info->audio_probe_invoke_control, TRUE, FALSE)) {
-        return GST_PAD_PROBE_OK;
+    if (is_fanout_joint(upstream_joint)) {
+        // the queue itself belongs to the audience pipeline
+        gchar *media_type = (gchar *)g_object_get_data(G_OBJECT(upstream_joint), "media-type");
+        FanOut &fanout = g_str_equal(media_type, "audio") ? audio_fanout_ : video_fanout_;
+        forget_audience_queue(upstream_joint);
+        GstPad *sinkpad = gst_element_get_static_pad(upstream_joint, "sink");
+        g_warn_if_fail(fanout.Unsubscribe(sinkpad));
+        gst_object_unref(sinkpad);
+        GST_DEBUG("[livestream] remove fan-out joint: %s", media_type);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(joint_mutex_);
+    auto it = sinks_.find(upstream_joint);
+    if (it == sinks_.end()) {
+        g_warn_if_reached();
+        // TODO(yuanjunjie) notify application
+        return;
+    }
+    sink_link *info = it->second;
+    sinks_.erase(it);
+    forget_audience_queue(info->queue);
+    gchar *media_type = (gchar *)g_object_get_data(G_OBJECT(upstream_joint), "media-type");
+    if (g_str_equal(media_type, "video")) {
+        GstElement *tee = video_tee_;
+        video_detacher_.Schedule([info, tee]() { unlink_pipe_joint(info, tee); });
+        GST_DEBUG("[livestream] remove video joint scheduled");
+    } else {
+        GstElement *tee = audio_tee_;
+        audio_detacher_.Schedule([info, tee]() { unlink_pipe_joint(info, tee); });
+        GST_DEBUG("[livestream] remove audio joint scheduled");
     }
+}
 
-    GstElement *upstream_joint = info->upstream_joint;
-    LiveStream *pipeline = static_cast<LiveStream *>(info->pipeline);
 
-    // remove pipeline dynamicaly
-    GstPad *sinkpad = gst_element_get_static_pad(upstream_joint, "sink");
-    gst_pad_unlink(info->tee_pad, sinkpad);
-    gst_object_unref(sinkpad);
-    gst_element_set_state(upstream_joint, GST_STATE_NULL);
-    g_warn_if_fail(gst_bin_remove(GST_BIN(pipeline->pipeline()), upstream_joint));
 
-    gst_element_release_request_pad(pipeline->audio_tee_, info->tee_pad);
-    gst_object_unref(info->tee_pad);
-    delete static_cast<sink_link *>(data);
-    GST_DEBUG("[livestream] remove audio joint from tee pad");
-    return GST_PAD_PROBE_REMOVE;
+json LiveStream::release_audience_queues(const std::string &audience)
+{
+    json stats = json::array();
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    auto range = audience_queues_.equal_range(audience);
+    for (auto it = range.first; it != range.second; ++it) {
+        it->second->Disarm();
+        stats.push_back(it->second->stats());
+    }
+    audience_queues_.erase(range.first, range.second);
+    audience_queue_options_.erase(audience);
+    // the egress counters of its joints go with the queues
+    release_audience_stats(audience);
+    return stats;
 }
-void LiveStream::remove_pipe_joint(GstElement *upstream_joint)
+void LiveStream::release_audience_stats(const std::string &audience)
 {
-    joint_mutex_.lock();
-    gchar *media_type = (gchar *)g_object_get_data(G_OBJECT(upstream_joint), "media-type");
-    if (g_str_equal(media_type, "video")) {
-        auto it = sinks_.begin();
-        for (; it != sinks_.end(); ++it) {
-            if ((*it)->upstream_joint == upstream_joint) {
-                break;
-            }
-        }
-        if (it == sinks_.end()) {
-            g_warn_if_reached();
-            // TODO(yuanjunjie) notify application
-            return;
-        }
-        (*it)->video_probe_invoke_control = TRUE;
-        gst_pad_add_probe((*it)->tee_pad, GST_PAD_PROBE_TYPE_IDLE, on_tee_pad_remove_video_probe, *it, NULL);
-        sinks_.erase(it);
-        GST_DEBUG("[livestream] remove video joint completed");
-    } else if (g_str_equal(media_type, "audio")) {
-        auto it = sinks_.begin();
-        for (; it != sinks_.end(); ++it) {
-            if ((*it)->upstream_joint == upstream_joint) {
-                break;
-            }
-        }
-        if (it == sinks_.end()) {
-            g_warn_if_reached();
-            // TODO(yuanjunjie) notify application
+    latency_tracer().Forget(audience);
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    audience_stats_.erase(audience);
+}
+void LiveStream::forget_audience_queue(GstElement *queue)
+{
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    for (auto it = audience_queues_.begin(); it != audience_queues_.end(); ++it) {
+        if (it->second->element() == queue) {
+            it->second->Disarm();
+            audience_queues_.erase(it);
             return;
         }
-        (*it)->audio_probe_invoke_control = TRUE;
-        gst_pad_add_probe((*it)->tee_pad, GST_PAD_PROBE_TYPE_IDLE, on_tee_pad_remove_audio_probe, *it, NULL);
-        sinks_.erase(it);
-        GST_DEBUG("[livestream] remove audio joint completed");
     }
-    joint_mutex_.unlock();
 }
+void LiveStream::request_disconnect(const std::string &audience)
+{
+    // from the streaming thread, the audience is removed on the app loop
+    if (!audience_ids_.Contains(audience)) {
+        return;  // not an audience of ours (a shared ingest client) or gone
+    }
+    // not queue_mutex_, held by the app loop while it disarms the queues
+    std::lock_guard<std::mutex> lock(disconnect_mutex_);
+    disconnects_.push_back(audience);
+    if (!disconnect_source_) {
+        disconnect_source_ = g_idle_source_new();
+        g_source_set_callback(disconnect_source_, on_disconnect_audiences, this, NULL);
+        g_source_attach(disconnect_source_, context());
+    }
+}
+gboolean LiveStream::on_disconnect_audiences(gpointer user_data)
+{
+    LiveStream *app = static_cast<LiveStream *>(user_data);
+    std::vector<std::string> names;
+    {
+        std::lock_guard<std::mutex> lock(app->disconnect_mutex_);
+        names.swap(app->disconnects_);
+        g_source_unref(app->disconnect_source_);
+        app->disconnect_source_ = NULL;
+    }
+    for (auto &name : names) {
+        IEndpoint *ep = app->find_audience(name);
+        if (!ep) {
+            continue;  // removed meanwhile, or a second joint of it
+        }
+        app->unregister_audience(ep);
+        json data;
+        data["reason"] = "congested";
+        data["queue"] = app->release_audience_queues(name);
+        ep->terminate();
+        GST_WARNING("[livestream] audience: %s (type: %s) disconnected, it can't keep up.",
+                    ep->name().c_str(), ep->protocol().c_str());
 
+        json meta;
+        meta["topic"] = "livestream";
+        meta["origin"] = app->uname();
+        meta["type"] = "audience_disconnected";
+        meta["endpoint"] = name;
+        app->Notify(data, meta);
+        delete ep;
+    }
+    return G_SOURCE_REMOVE;
+}
 
 
 GstPadProbeReturn LiveStream::on_monitor_data(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
@@ -18,23 +18,34 @@
 #define _LIBWEBSTREAMER_APPLICATION_LIVESTREAM_H_
 
 #include <framework/app.h>
+#include <utils/keyframesnapshot.h>
+#include <utils/fanout.h>
+#include <utils/audiencequeue.h>
+#include <utils/gopcache.h>
+#include <utils/keyunitrelay.h>
+#include <utils/rcumap.h>
+#include <utils/teedetacher.h>
+#include <utils/asyncstatechange.h>
+#include <utils/padstats.h>
+#include <unordered_map>
+#include <map>
+#include <memory>
 #include <mutex>  // NOLINT
+#include <vector>
 
 // #define USE_AUTO_SINK 1
 struct sink_link
 {
     GstElement *upstream_joint;
+    GstElement *queue;  // audience queue between tee pad and joint
     GstPad *tee_pad;
     void *pipeline;
-    gboolean video_probe_invoke_control;
-    gboolean audio_probe_invoke_control;
 
     sink_link(GstPad *pad, GstElement *joint, void *pipe)
         : upstream_joint(joint)
+        , queue(NULL)
         , tee_pad(pad)
         , pipeline(pipe)
-        , video_probe_invoke_control(FALSE)
-        , audio_probe_invoke_control(FALSE)
     {
     }
 };
@@ -46,8 +57,20 @@ class LiveStream : public IApp
 
     LiveStream(const std::string &name, WebStreamer *ws);
     ~LiveStream();
+    PipeJoint make_joint(IEndpoint *endpoint,
+                         const std::string &media_type,
+                         const std::string &name);
     void add_pipe_joint(GstElement *upstream_joint);
     void remove_pipe_joint(GstElement *upstream_joint);
+    void request_keyframe(const std::string &origin);
+
+    // hidden ingest of the SourceRegistry, only called on its context:
+    // opened with the add_performer data, started, then closed once.
+    // Not a call of the host, no promise is settled.
+    bool OpenIngest(const nlohmann::json &performer, std::string *error);
+    void StartIngest(const AsyncStateChange::Callback &done);
+    void CancelIngest();  // done gets "cancelled" at once
+    void CloseIngest();
 
     virtual void On(Promise *promise);
     virtual bool Initialize(Promise *promise);
@@ -57,37 +80,69 @@ class LiveStream : public IApp
     void add_performer(Promise *promise);
     void add_audience(Promise *promise);
     void remove_audience(Promise *promise);
+    void remove_audiences(Promise *promise);
     void Startup(Promise *promise);
     void Stop(Promise *promise);
     void set_remote_description(Promise *promise);
     void set_remote_candidate(Promise *promise);
+    void snapshot(Promise *promise);
+    void stats(Promise *promise);
 
     bool on_add_endpoint(IEndpoint *endpoint);
     virtual bool MessageHandler(GstMessage *msg);
 
  private:
-    static GstPadProbeReturn
-    on_tee_pad_remove_video_probe(GstPad *pad,
-                                  GstPadProbeInfo *probe_info,
-                                  gpointer data);
-
-    static GstPadProbeReturn
-    on_tee_pad_remove_audio_probe(GstPad *pad,
-                                  GstPadProbeInfo *probe_info,
-                                  gpointer data);
-
     static GstPadProbeReturn on_monitor_data(GstPad *pad,
                                              GstPadProbeInfo *info,
                                              gpointer user_data);
-    std::list<IEndpoint *>::iterator find_audience(const std::string &name);
+    // video tee -> leaky queue -> fakesink, only while snapshots wait
+    struct SnapshotTap
+    {
+        LiveStream *app;
+        GstPad *tee_pad;
+        GstElement *queue;
+        GstElement *sink;
+    };
+    void install_snapshot_tap();
+    void remove_snapshot_tap();
+    static GstPadProbeReturn on_snapshot_keyframe(GstPad *pad,
+                                                  GstPadProbeInfo *info,
+                                                  gpointer user_data);
+    static GstPadProbeReturn on_snapshot_tap_idle(GstPad *pad,
+                                                  GstPadProbeInfo *info,
+                                                  gpointer user_data);
+    static gboolean on_snapshot_tick(gpointer user_data);
+
+    void install_audience_queue(GstElement *queue, GstElement *upstream_joint);
+    sink_link *link_pipe_joint(GstElement *tee, GstElement *upstream_joint);
+    static void unlink_pipe_joint(sink_link *info, GstElement *tee);
+    nlohmann::json release_audience_queues(const std::string &audience);
+    void release_audience_stats(const std::string &audience);
+    void forget_audience_queue(GstElement *queue);
+    void request_disconnect(const std::string &audience);
+    static gboolean on_disconnect_audiences(gpointer user_data);
+    static gboolean on_forward_keyframe_request(gpointer user_data);
+
+    IEndpoint *find_audience(const std::string &name);
+    // by endpoint id for binary calls, by data["name"] otherwise
+    IEndpoint *find_audience(Promise *promise, std::string *name);
+    void register_audience(IEndpoint *ep);
+    void unregister_audience(IEndpoint *ep);
+    void terminate_audiences();
     GstElement *video_tee_;
     GstElement *audio_tee_;
     IEndpoint *performer_;
-    std::list<IEndpoint *> audiences_;
+    AsyncStateChange startup_;  // PLAYING off the app loop
+    // by interned endpoint id and by name, readable from any thread
+    RcuMap<guint32, IEndpoint *> audiences_;
+    RcuMap<std::string, guint32> audience_ids_;
 
-    std::list<sink_link *> sinks_;  // all the request pad of tee,
-                                    // release when removing from
-                                    // pipeline
+    // all the request pad of tee by upstream joint,
+    // release when removing from pipeline
+    std::unordered_map<GstElement *, sink_link *> sinks_;
+    // removed joints leave their tee in batches, one idle probe each
+    TeeDetacher video_detacher_;
+    TeeDetacher audio_detacher_;
 
     GstPad *video_tee_pad_;
     GstElement *fake_video_queue_;
@@ -101,7 +156,48 @@ class LiveStream : public IApp
     GstElement *fake_audio_convert_;
     GstElement *fake_audio_resample_;
 #endif
-    static std::mutex joint_mutex_;
+    std::mutex joint_mutex_;  // sinks_, joints come from several threads
+
+    // create option "joint": "fanout", audiences subscribe to the tee
+    // sink pads instead of getting a tee pad and a proxy pair each
+    bool fanout_;
+    FanOut video_fanout_;
+    FanOut audio_fanout_;
+
+    // create option "gop_cache": {"max_bytes"}, new video joints start
+    // with the current group of pictures
+    GopCache gop_cache_;
+
+    // create option "keyframe_request": {"window": ms}, keyframe requests
+    // of all audiences within the window reach the performer once
+    std::shared_ptr<KeyUnitRelay> keyunit_relay_;
+    std::mutex keyframe_mutex_;
+    GSource *keyframe_source_;
+
+    // bounded queue of every audience joint, create/add_audience "queue"
+    std::mutex queue_mutex_;  // also taken from rtsp server and streaming threads
+    AudienceQueue::Options queue_options_;
+    std::map<std::string, AudienceQueue::Options> audience_queue_options_;
+    std::multimap<std::string, std::shared_ptr<AudienceQueue> > audience_queues_;
+    // taken under AudienceQueue's lock (disconnect requests), so it must
+    // not be held while calling into a queue: nothing else is locked in it
+    std::mutex disconnect_mutex_;
+    std::vector<std::string> disconnects_;
+    GSource *disconnect_source_;
+
+    // ingest counters on the tee sink pads, egress ones on the audience
+    // side of every joint; latency is matched by pts per media
+    PadStats performer_video_stats_;
+    PadStats performer_audio_stats_;
+    std::shared_ptr<LatencyRing> video_latency_;
+    std::shared_ptr<LatencyRing> audio_latency_;
+    std::mutex stats_mutex_;  // joints are made on rtsp server threads too
+    std::multimap<std::string, std::pair<std::string, std::shared_ptr<PadStats> > > audience_stats_;
+
+    std::mutex snapshot_mutex_;  // requests are taken on the tap thread
+    std::vector<KeyframeSnapshot::Request> snapshot_requests_;
+    SnapshotTap *snapshot_tap_;
+    GSource *snapshot_timer_;
 };
 
 #endif
@@ -39,12 +39,20 @@ bool RTSPTestServer::Initialize(Promise* promise)
 
 void RTSPTestServer::On(Promise* promise)
 {
-    const json& j = promise->meta();
-    std::string action = j["action"];
-    if (action == "startup") {
-        Startup(promise);
-    } else if (action == "stop") {
-        Stop(promise);
+    if (promise->binary()) {
+        promise->reject("binary call is not supported!");
+        return;
+    }
+    switch (promise->action()) {
+        case PLUGIN_ACTION_STARTUP:
+            Startup(promise);
+            break;
+        case PLUGIN_ACTION_STOP:
+            Stop(promise);
+            break;
+        default:
+            promise->reject("action: " + promise->action_name() + " is not supported!");
+            break;
     }
 }
 
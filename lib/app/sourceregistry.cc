@@ -0,0 +1,393 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sourceregistry.h"
+#include <app/livestream.h>
+#include <condition_variable>
+
+using json = nlohmann::json;
+
+GST_DEBUG_CATEGORY_STATIC(my_category);
+#define GST_CAT_DEFAULT my_category
+
+// a step run on the ingest loop, settled from there (maybe later)
+struct SourceRegistry::Call
+{
+    Func func;
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool done;
+    std::string error;
+
+    void Done(const std::string &e)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        error = e;
+        done = true;
+        cond.notify_one();
+    }
+};
+
+// an Acquire(), under the registry mutex
+struct SourceRegistry::Waiter
+{
+    std::shared_ptr<Entry> entry;
+    GMainContext *context;
+    Callback callback;
+    bool released;
+};
+
+SourceRegistry::SourceRegistry(WebStreamer *ws)
+    : webstreamer_(ws)
+    , context_(NULL)
+    , loop_(NULL)
+    , thread_(NULL)
+    , seq_(0)
+{
+}
+
+SourceRegistry::~SourceRegistry()
+{
+    Clear();
+}
+
+std::string SourceRegistry::MakeKey(const json &performer)
+{
+    return performer.value("url", std::string()) + "|" +
+           performer.value("video_codec", std::string()) + "|" +
+           performer.value("audio_codec", std::string());
+}
+
+void SourceRegistry::StartLoop()
+{
+    if (thread_) {
+        return;
+    }
+    context_ = g_main_context_new();
+    loop_ = g_main_loop_new(context_, FALSE);
+    thread_ = g_thread_new("webstreamer_ingest", (GThreadFunc)LoopEntry, loop_);
+}
+
+void SourceRegistry::StopLoop()
+{
+    GThread *thread;
+    GMainLoop *loop;
+    GMainContext *context;
+    {
+        // not joined under the lock, the loop may be waiting for it
+        std::lock_guard<std::mutex> lock(mutex_);
+        thread = thread_;
+        loop = loop_;
+        context = context_;
+        thread_ = NULL;
+        loop_ = NULL;
+        context_ = NULL;
+    }
+    if (!thread) {
+        return;
+    }
+    // quit from inside the loop, see ContextPool::Shutdown
+    GSource *source = g_idle_source_new();
+    g_source_set_callback(source, LoopQuit, loop, NULL);
+    g_source_attach(source, context);
+    g_source_unref(source);
+    g_thread_join(thread);
+    g_main_loop_unref(loop);
+    g_main_context_unref(context);
+}
+
+gpointer SourceRegistry::LoopEntry(gpointer data)
+{
+    GMainLoop *loop = static_cast<GMainLoop *>(data);
+    GMainContext *context = g_main_loop_get_context(loop);
+
+    g_main_context_push_thread_default(context);
+    g_main_loop_run(loop);
+    g_main_context_pop_thread_default(context);
+    return NULL;
+}
+
+gboolean SourceRegistry::LoopQuit(gpointer data)
+{
+    g_main_loop_quit(static_cast<GMainLoop *>(data));
+    return G_SOURCE_REMOVE;
+}
+
+void SourceRegistry::Post(GMainContext *context, const std::function<void()> &func)
+{
+    GSource *source = g_idle_source_new();
+    g_source_set_callback(source, on_post, new std::function<void()>(func), free_post);
+    g_source_attach(source, context);
+    g_source_unref(source);
+}
+
+gboolean SourceRegistry::on_post(gpointer data)
+{
+    (*static_cast<std::function<void()> *>(data))();
+    return G_SOURCE_REMOVE;
+}
+
+void SourceRegistry::free_post(gpointer data)
+{
+    delete static_cast<std::function<void()> *>(data);
+}
+
+std::string SourceRegistry::Invoke(const Func &func)
+{
+    // never called from the ingest loop itself, it would wait for itself
+    Call call;
+    call.func = func;
+    call.done = false;
+    GSource *source = g_idle_source_new();
+    g_source_set_callback(source, on_invoke, &call, NULL);
+    g_source_attach(source, context_);
+    g_source_unref(source);
+
+    std::unique_lock<std::mutex> lock(call.mutex);
+    call.cond.wait(lock, [&call]() { return call.done; });
+    return call.error;
+}
+
+gboolean SourceRegistry::on_invoke(gpointer data)
+{
+    Call *call = static_cast<Call *>(data);
+    call->func(call);
+    return G_SOURCE_REMOVE;
+}
+
+void SourceRegistry::OpenIngest(const std::shared_ptr<Entry> &entry,
+                                const std::string &name,
+                                const json &performer)
+{
+    {
+        // released by all its apps before it got here
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (entry->closed) {
+            return;
+        }
+    }
+    LiveStream *ingest = new LiveStream(name, webstreamer_);
+    // this is the ingest loop
+    ingest->set_context(g_main_context_get_thread_default());
+    json data;
+    data["url"] = performer["url"];
+    if (performer.find("video_codec") != performer.end()) {
+        data["video_codec"] = performer["video_codec"];
+    }
+    if (performer.find("audio_codec") != performer.end()) {
+        data["audio_codec"] = performer["audio_codec"];
+    }
+    std::string error;
+    if (!ingest->OpenIngest(data, &error)) {
+        OnIngestStarted(entry, ingest, error);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entry->opening = ingest;
+    }
+    // on this loop once PLAYING (or failed, timed out, cancelled)
+    ingest->StartIngest([this, entry, ingest](const std::string &result) {
+        OnIngestStarted(entry, ingest, result);
+    });
+}
+
+void SourceRegistry::OnIngestStarted(const std::shared_ptr<Entry> &entry,
+                                     LiveStream *ingest,
+                                     const std::string &error)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    entry->opening = NULL;
+    if (!error.empty()) {
+        GST_ERROR("[source-registry] failed to open %s: %s", entry->key.c_str(), error.c_str());
+        entry->error = error;
+        if (!entry->closed) {
+            // the next Acquire tries again
+            entry->closed = true;
+            std::map<std::string, std::shared_ptr<Entry> >::iterator it = entries_.find(entry->key);
+            if (it != entries_.end() && it->second == entry) {
+                entries_.erase(it);
+            }
+        }
+        PostTeardown(ingest);
+    } else if (entry->closed) {
+        PostTeardown(ingest);
+    } else {
+        GST_INFO("[source-registry] %s opened as %s.", entry->key.c_str(), ingest->uname().c_str());
+        entry->ingest = ingest;
+    }
+    for (auto &ticket : entry->waiters) {
+        Deliver(ticket);
+    }
+    entry->waiters.clear();
+}
+
+void SourceRegistry::Deliver(const Ticket &ticket)
+{
+    Post(ticket->context, [this, ticket]() { OnDelivered(ticket); });
+}
+
+void SourceRegistry::OnDelivered(const Ticket &ticket)
+{
+    IApp *ingest = NULL;
+    std::string error;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (ticket->released) {
+            return;
+        }
+        ingest = ticket->entry->ingest;
+        error = ticket->entry->error;
+    }
+    if (!ingest && error.empty()) {
+        error = "shared source closed.";
+    }
+    ticket->callback(ingest, error);
+}
+
+void SourceRegistry::PostTeardown(LiveStream *ingest)
+{
+    // the keyframe forwarding and the bus watch run on the ingest loop too
+    if (!context_) {
+        g_warn_if_reached();
+        return;
+    }
+    Post(context_, [ingest]() {
+        ingest->CloseIngest();
+        delete ingest;
+    });
+}
+
+SourceRegistry::Ticket SourceRegistry::Acquire(const json &performer,
+                                               GMainContext *context,
+                                               const Callback &callback)
+{
+    GST_DEBUG_CATEGORY_INIT(my_category, "webstreamer", 2, "libWebStreamer");
+    json::const_iterator url = performer.find("url");
+    g_return_val_if_fail(url != performer.cend() && url->is_string(), Ticket());
+    std::string key = MakeKey(performer);
+
+    Ticket ticket = std::make_shared<Waiter>();
+    ticket->context = context;
+    ticket->callback = callback;
+    ticket->released = false;
+
+    // never waits: a key being opened is joined, not opened twice
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<std::string, std::shared_ptr<Entry> >::iterator it = entries_.find(key);
+    if (it != entries_.end()) {
+        ticket->entry = it->second;
+        ticket->entry->refcount++;
+        GST_INFO("[source-registry] %s shared by %d apps.", key.c_str(), ticket->entry->refcount);
+        if (ticket->entry->ingest) {
+            Deliver(ticket);
+        } else {
+            ticket->entry->waiters.push_back(ticket);
+        }
+        return ticket;
+    }
+
+    std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+    entry->key = key;
+    entry->ingest = NULL;
+    entry->opening = NULL;
+    entry->refcount = 1;
+    entry->closed = false;
+    entry->waiters.push_back(ticket);
+    entries_[key] = entry;
+    ticket->entry = entry;
+
+    StartLoop();
+    gchar *name = g_strdup_printf("shared-ingest-%u", ++seq_);
+    std::string ingest_name = name;
+    g_free(name);
+    json data = performer;
+    Post(context_, [this, entry, ingest_name, data]() { OpenIngest(entry, ingest_name, data); });
+    return ticket;
+}
+
+void SourceRegistry::Release(const Ticket &ticket)
+{
+    if (!ticket) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (ticket->released) {
+        return;
+    }
+    ticket->released = true;
+    std::shared_ptr<Entry> entry = ticket->entry;
+    entry->waiters.remove(ticket);
+    if (--entry->refcount > 0 || entry->closed) {
+        return;
+    }
+    GST_INFO("[source-registry] %s closed.", entry->key.c_str());
+    entry->closed = true;
+    std::map<std::string, std::shared_ptr<Entry> >::iterator it = entries_.find(entry->key);
+    if (it != entries_.end() && it->second == entry) {
+        entries_.erase(it);
+    }
+    // one being opened is torn down once started
+    if (entry->ingest) {
+        PostTeardown(entry->ingest);
+        entry->ingest = NULL;
+    }
+}
+
+void SourceRegistry::Clear()
+{
+    std::list<std::shared_ptr<Entry> > entries;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!thread_) {
+            return;
+        }
+        for (auto &it : entries_) {
+            entries.push_back(it.second);
+        }
+        entries_.clear();
+    }
+    // the only place waiting for the ingest loop
+    Invoke([this, entries](Call *call) {
+        std::list<LiveStream *> opened;
+        std::list<LiveStream *> opening;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto &entry : entries) {
+                entry->closed = true;
+                if (entry->ingest) {
+                    opened.push_back(entry->ingest);
+                    entry->ingest = NULL;
+                }
+                if (entry->opening) {
+                    opening.push_back(entry->opening);
+                }
+            }
+        }
+        for (auto ingest : opened) {
+            ingest->CloseIngest();
+            delete ingest;
+        }
+        // settled at once, their teardown is posted
+        for (auto ingest : opening) {
+            ingest->CancelIngest();
+        }
+        call->Done(std::string());
+    });
+    // after the teardowns posted so far
+    Invoke([](Call *call) { call->Done(std::string()); });
+    StopLoop();
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBWEBSTREAMER_APPLICATION_SOURCE_REGISTRY_H_
+#define _LIBWEBSTREAMER_APPLICATION_SOURCE_REGISTRY_H_
+
+#include <framework/app.h>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+
+class WebStreamer;
+class LiveStream;
+/*
+ * Process wide registry of shared RTSP ingests.
+ * An ingest is a hidden LiveStream whose performer is the RtspClient
+ * for one url + codec combination. Apps attach to its tees through
+ * PipeJoint (add_pipe_joint), the last one to release it tears it down.
+ * Ingests live on a main loop thread of the registry: they are opened,
+ * started and closed there only, nothing waits for them but Clear().
+ * Acquire() returns at once, the callback runs later on the given
+ * context with the ingest once it plays, or NULL and an error. Acquires
+ * of a key being opened join it. Every ticket is released, the callback
+ * is dropped if it has not run yet.
+ */
+class SourceRegistry
+{
+ public:
+    typedef std::function<void(IApp *ingest, const std::string &error)> Callback;
+    struct Waiter;
+    typedef std::shared_ptr<Waiter> Ticket;
+
+    explicit SourceRegistry(WebStreamer *ws);
+    ~SourceRegistry();
+
+    // performer: the add_performer data (url, video_codec, audio_codec)
+    Ticket Acquire(const nlohmann::json &performer,
+                   GMainContext *context,
+                   const Callback &callback);
+    void Release(const Ticket &ticket);
+    void Clear();
+
+ private:
+    struct Entry
+    {
+        std::string key;
+        LiveStream *ingest;   // once it plays
+        LiveStream *opening;  // until then
+        std::string error;
+        int refcount;
+        bool closed;  // torn down, or will be once opened
+        std::list<Ticket> waiters;
+    };
+    struct Call;
+    typedef std::function<void(Call *call)> Func;
+
+    static std::string MakeKey(const nlohmann::json &performer);
+    void OpenIngest(const std::shared_ptr<Entry> &entry,
+                    const std::string &name,
+                    const nlohmann::json &performer);
+    void OnIngestStarted(const std::shared_ptr<Entry> &entry,
+                         LiveStream *ingest,
+                         const std::string &error);
+    void Deliver(const Ticket &ticket);
+    void OnDelivered(const Ticket &ticket);
+    void PostTeardown(LiveStream *ingest);
+
+    // runs func on context, does not wait
+    static void Post(GMainContext *context, const std::function<void()> &func);
+    static gboolean on_post(gpointer data);
+    static void free_post(gpointer data);
+    // runs func on the ingest loop, waits until it calls Done()
+    std::string Invoke(const Func &func);
+    static gboolean on_invoke(gpointer data);
+    void StartLoop();
+    void StopLoop();
+    static gpointer LoopEntry(gpointer data);
+    static gboolean LoopQuit(gpointer data);
+
+    WebStreamer *webstreamer_;
+    GMainContext *context_;
+    GMainLoop *loop_;
+    GThread *thread_;
+    std::mutex mutex_;
+    std::map<std::string, std::shared_ptr<Entry> > entries_;
+    guint seq_;
+};
+
+
+#endif  // _LIBWEBSTREAMER_APPLICATION_SOURCE_REGISTRY_H_
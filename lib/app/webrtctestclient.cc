@@ -39,16 +39,28 @@ bool WebRTCTestClient::Destroy(Promise *promise)
 
 void WebRTCTestClient::On(Promise *promise)
 {
-    const json &j = promise->meta();
-    std::string action = j["action"];
-    if (action == "startup") {
-        Startup(promise);
-    } else if (action == "stop") {
-        Stop(promise);
-    } else if (action == "remote_sdp") {
-        set_remote_description(promise);
-    } else if (action == "remote_candidate") {
-        set_remote_candidate(promise);
+    if (promise->binary()) {
+        GST_ERROR("[webrtc test client] binary call is not supported!");
+        promise->reject("binary call is not supported!");
+        return;
+    }
+    switch (promise->action()) {
+        case PLUGIN_ACTION_STARTUP:
+            Startup(promise);
+            break;
+        case PLUGIN_ACTION_STOP:
+            Stop(promise);
+            break;
+        case PLUGIN_ACTION_REMOTE_SDP:
+            set_remote_description(promise);
+            break;
+        case PLUGIN_ACTION_REMOTE_CANDIDATE:
+            set_remote_candidate(promise);
+            break;
+        default:
+            GST_ERROR("[webrtc test client] action: %s is not supported!", promise->action_name().c_str());
+            promise->reject("action: " + promise->action_name() + " is not supported!");
+            break;
     }
 }
 static gboolean message_handler(GstBus *bus,
@@ -74,9 +86,8 @@ void WebRTCTestClient::Startup(Promise *promise)
         // printf("launch: %s\n", launch.c_str());
         webrtc_ep_->launch() = launch;
         if (webrtc_ep_->initialize(promise)) {
-            GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE(webrtc_ep_->pipeline()));
-            gst_bus_add_watch(bus, message_handler, this);
-            gst_object_unref(bus);
+            // the endpoint pipeline is watched by the bus monitor already
+            bus_monitor().Forward(webrtc_ep_->pipeline(), message_handler, this);
 
             GstElement *sink = gst_bin_get_by_name(GST_BIN(webrtc_ep_->pipeline()), "sink");
             set_sink(sink);
@@ -109,8 +120,7 @@ void WebRTCTestClient::Stop(Promise *promise)
 
 void WebRTCTestClient::set_remote_description(Promise *promise)
 {
-    if (webrtc_ep_) {
-        webrtc_ep_->set_remote_description(promise);
+    if (webrtc_ep_ && webrtc_ep_->set_remote_description(promise)) {
         promise->resolve();
         return;
     }
@@ -118,8 +128,7 @@ void WebRTCTestClient::set_remote_description(Promise *promise)
 }
 void WebRTCTestClient::set_remote_candidate(Promise *promise)
 {
-    if (webrtc_ep_) {
-        webrtc_ep_->set_remote_candidate(promise);
+    if (webrtc_ep_ && webrtc_ep_->set_remote_candidate(promise)) {
         promise->resolve();
         return;
     }
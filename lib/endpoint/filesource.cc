@@ -16,6 +16,7 @@
 
 #include "filesource.h"
 #include <utils/typedef.h>
+#include <utils/elementfactory.h>
 
 using json = nlohmann::json;
 
@@ -47,7 +48,7 @@ bool FileSource::initialize(Promise *promise)
     GST_DEBUG("[filesource : %s] source url: %s", name().c_str(), url.c_str());
     IEndpoint::protocol() = "filesource";
 
-    filesrc_ = gst_element_factory_make("filesrc", "filesrc");
+    filesrc_ = ElementFactory::Make("filesrc", "filesrc");
     g_warn_if_fail(filesrc_);
     g_object_set(G_OBJECT(filesrc_), "location", url.c_str(), NULL);
 
@@ -94,7 +95,7 @@ void FileSource::on_demux_pad_added(GstElement* demux, GstPad* src_pad, gpointer
 bool FileSource::add_to_pipeline()
 {
     if ( !add_to_pipeline_ ) {
-        demux_ = gst_element_factory_make("qtdemux", "demux");
+        demux_ = ElementFactory::Make("qtdemux", "demux");
         gst_bin_add_many(GST_BIN(app()->pipeline()), filesrc_, demux_, NULL);
         g_warn_if_fail(gst_element_link(filesrc_, demux_));
         g_signal_connect(demux_, "pad-added", (GCallback)on_demux_pad_added, this);
@@ -106,8 +107,8 @@ bool FileSource::add_to_pipeline()
         switch(video_codec) {
             case VideoEncodingType::H264:
             {
-                video_queue_ = gst_element_factory_make("queue", "video_queue");
-                video_parse_ = gst_element_factory_make("h264parse", "video_parse");
+                video_queue_ = ElementFactory::Make("queue", "video_queue");
+                video_parse_ = ElementFactory::Make("h264parse", "video_parse");
             }
             break;
 
@@ -126,8 +127,8 @@ bool FileSource::add_to_pipeline()
         switch(audio_codec) {
             case AudioEncodingType::AAC:
             {
-                audio_queue_ = gst_element_factory_make("queue", "audio_queue");
-                audio_parse_ = gst_element_factory_make("aacparse", "audio_parse");
+                audio_queue_ = ElementFactory::Make("queue", "audio_queue");
+                audio_parse_ = ElementFactory::Make("aacparse", "audio_parse");
             }
             break;
 
@@ -15,6 +15,7 @@
  */
 
 #include "hlsservice.h"
+#include <utils/elementfactory.h>
 
 using json = nlohmann::json;
 
@@ -39,7 +40,7 @@ bool HLSService::initialize(Promise *promise)
     GST_DEBUG_CATEGORY_INIT(my_category, "webstreamer", 2, "libWebStreamer");
     IEndpoint::protocol() = "hlsservice";
     
-    hlssink2_ = gst_element_factory_make("hlssink2", "hlssink");
+    hlssink2_ = ElementFactory::Make("hlssink2", "hlssink");
     //gst_util_set_object_arg(G_OBJECT(hlssink2_), "cache-mode", "memory");
     //g_object_set(G_OBJECT(hlssink2_), "cache-mode", 1, NULL);
     const json &j = promise->data();
@@ -60,11 +61,12 @@ bool HLSService::initialize(Promise *promise)
     }
     
     pipeline_ = gst_pipeline_new(NULL);
+    app()->bus_monitor().Watch(pipeline_, name());
     g_warn_if_fail( gst_bin_add(GST_BIN(pipeline_), hlssink2_) );
     //link pipeline_ to app's
     if (!app()->video_encoding().empty()) {
         std::string media_type = "video";
-        video_joint_ = make_pipe_joint(media_type);
+        video_joint_ = app()->make_joint(this, media_type, std::string());
 
         app()->add_pipe_joint( video_joint_.upstream_joint );
         g_warn_if_fail( gst_bin_add(GST_BIN(pipeline_), video_joint_.downstream_joint) );
@@ -77,7 +79,7 @@ bool HLSService::initialize(Promise *promise)
     
     if (!app()->audio_encoding().empty()) {
         std::string media_type = "audio";
-        audio_joint_ = make_pipe_joint(media_type);
+        audio_joint_ = app()->make_joint(this, media_type, std::string());
 
         app()->add_pipe_joint( audio_joint_.upstream_joint );
         g_warn_if_fail( gst_bin_add(GST_BIN(pipeline_), audio_joint_.downstream_joint) );
@@ -88,18 +90,22 @@ bool HLSService::initialize(Promise *promise)
         g_warn_if_fail( gst_pad_link(srcpad, hlssink2_audio_) == GST_PAD_LINK_OK );
     }
     
-    GstStateChangeReturn ret = gst_element_set_state(pipeline_, GST_STATE_PLAYING);
-    if (ret == GST_STATE_CHANGE_FAILURE) {
-        GST_DEBUG("[hlsservice: %s] %p initialize failed.", name().c_str(), hlssink2_);
-        return false;
-    }
+    // PLAYING is reached in startup(), off the app loop
     GST_DEBUG("[hlsservice: %s] %p initialize done.", name().c_str(), hlssink2_);
 
     return true;
 }
 
+bool HLSService::startup(const std::function<void(const std::string &error)> &done)
+{
+    g_return_val_if_fail(pipeline_ != NULL, false);
+    state_change_.Start(pipeline_, GST_STATE_PLAYING, ASYNC_STATE_CHANGE_TIMEOUT, app()->context(), done);
+    return true;
+}
+
 void HLSService::terminate()
 {
+    state_change_.Cancel();
     if (!app()->video_encoding().empty() 
         && video_joint_.upstream_joint != NULL) {
         app()->remove_pipe_joint(video_joint_.upstream_joint);
@@ -120,6 +126,7 @@ void HLSService::terminate()
     }
 
     if (pipeline_) {
+        app()->bus_monitor().Unwatch(pipeline_);
         gst_element_set_state(GST_ELEMENT(pipeline_), GST_STATE_NULL);
         gst_bin_remove(GST_BIN(pipeline_), hlssink2_);
         gst_object_unref(pipeline_);
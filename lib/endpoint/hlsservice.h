@@ -19,6 +19,7 @@
 
 #include <framework/app.h>
 #include <utils/pipejoint.h>
+#include <utils/asyncstatechange.h>
 
 class HLSService : public IEndpoint
 {
@@ -27,6 +28,7 @@ public:
     ~HLSService();
     virtual bool initialize(Promise *promise);
     virtual void terminate();
+    virtual bool startup(const std::function<void(const std::string &error)> &done);
 
 private:
     GstElement *pipeline_;
@@ -35,6 +37,7 @@ private:
     GstPad *hlssink2_video_;
     GstPad *hlssink2_audio_;
 
+    AsyncStateChange state_change_;
     PipeJoint video_joint_;
     PipeJoint audio_joint_;
 };
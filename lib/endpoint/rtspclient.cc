@@ -18,6 +18,9 @@
 
 #include "rtspclient.h"
 #include <utils/typedef.h>
+#include <utils/elementfactory.h>
+#include <utils/padstats.h>
+#include <gst/video/video.h>
 
 using json = nlohmann::json;
 
@@ -47,7 +50,7 @@ bool RtspClient::initialize(Promise *promise)
     GST_DEBUG("[rtsp-client] source url: %s", url.c_str());
     IEndpoint::protocol() = "rtspclient";
 
-    rtspsrc_ = gst_element_factory_make("rtspsrc", "rtspsrc");
+    rtspsrc_ = ElementFactory::Make("rtspsrc", "rtspsrc");
     g_object_set(G_OBJECT(rtspsrc_), "location", url.c_str(), NULL);
     if (j.find("video_codec") != j.end()) {
         const std::string video_codec = j["video_codec"];
@@ -62,6 +65,49 @@ bool RtspClient::initialize(Promise *promise)
 }
 
 
+void RtspClient::request_keyframe()
+{
+    if (!parse_video_) {
+        return;
+    }
+    // parse and depay pass it up to the rtp session of rtspsrc,
+    // which sends a PLI (or FIR) to the camera over RTCP
+    GstPad *pad = gst_element_get_static_pad(parse_video_, "src");
+    GstEvent *event = gst_video_event_new_upstream_force_key_unit(GST_CLOCK_TIME_NONE, TRUE, 0);
+    if (!gst_pad_send_event(pad, event)) {
+        GST_DEBUG("[rtsp-client] keyframe request not handled upstream.");
+    }
+    gst_object_unref(pad);
+}
+
+nlohmann::json RtspClient::stats()
+{
+    nlohmann::json j = nlohmann::json::object();
+    if (!rtspsrc_) {
+        return j;
+    }
+    // the jitterbuffers and sessions of the rtpbin inside rtspsrc
+    GstIterator *it = gst_bin_iterate_recurse(GST_BIN(rtspsrc_));
+    GValue item = G_VALUE_INIT;
+    while (gst_iterator_next(it, &item) == GST_ITERATOR_OK) {
+        GstElement *element = GST_ELEMENT(g_value_get_object(&item));
+        GstElementFactory *factory = gst_element_get_factory(element);
+        const gchar *kind = factory ? GST_OBJECT_NAME(factory) : "";
+        if (g_str_equal(kind, "rtpjitterbuffer") || g_str_equal(kind, "rtpsession")) {
+            GstStructure *s = NULL;
+            g_object_get(element, "stats", &s, NULL);
+            j[GST_ELEMENT_NAME(element)] = structure_to_json(s);
+            if (s) {
+                gst_structure_free(s);
+            }
+        }
+        g_value_reset(&item);
+    }
+    g_value_unset(&item);
+    gst_iterator_free(it);
+    return j;
+}
+
 GstPadProbeReturn RtspClient::on_monitor_data(GstPad *pad,
                                               GstPadProbeInfo *info,
                                               gpointer rtspclient)
@@ -140,22 +186,27 @@ bool RtspClient::add_to_pipeline()
         VideoEncodingType video_codec = get_video_encoding_type(pipeline->video_encoding());
         switch (video_codec) {
             case VideoEncodingType::H264:
-                rtpdepay_video_ = gst_element_factory_make("rtph264depay", "depay");
-                parse_video_ = gst_element_factory_make("h264parse", "parse");
+                rtpdepay_video_ = ElementFactory::Make("rtph264depay", "depay");
+                parse_video_ = ElementFactory::Make("h264parse", "parse");
                 break;
             case VideoEncodingType::H265:
-                rtpdepay_video_ = gst_element_factory_make("rtph265depay", "depay");
-                parse_video_ = gst_element_factory_make("h265parse", "parse");
+                rtpdepay_video_ = ElementFactory::Make("rtph265depay", "depay");
+                parse_video_ = ElementFactory::Make("h265parse", "parse");
                 break;
             default:
                 GST_WARNING("[rtsp-client] invalid Video Codec!");
                 return false;
         }
         g_warn_if_fail(rtpdepay_video_ && parse_video_);
+        // SPS/PPS (VPS) in band with every IDR: a lone keyframe is
+        // decodable, see KeyframeSnapshot
+        g_object_set(parse_video_, "config-interval", -1, NULL);
 
         g_warn_if_fail(app()->pipeline() != NULL);
         gst_bin_add_many(GST_BIN(app()->pipeline()), rtpdepay_video_, parse_video_, NULL);
         g_warn_if_fail(gst_element_link(rtpdepay_video_, parse_video_));
+        app()->latency_tracer().Stamp(rtpdepay_video_, "src");
+        app()->latency_tracer().Hop(parse_video_, "src", "performer", "video.parse");
         GST_DEBUG("[rtsp-client] configured video: %s", pipeline->video_encoding().c_str());
 
         // g_signal_connect(rtspsrc_, "new-manager", (GCallback)on_get_new_rtpbin, this);
@@ -164,13 +215,13 @@ bool RtspClient::add_to_pipeline()
         AudioEncodingType audio_codec = get_audio_encoding_type(pipeline->audio_encoding());
         switch (audio_codec) {
             case AudioEncodingType::PCMA:
-                rtpdepay_audio_ = gst_element_factory_make("rtppcmadepay", "audio-depay");
+                rtpdepay_audio_ = ElementFactory::Make("rtppcmadepay", "audio-depay");
                 break;
             case AudioEncodingType::PCMU:
-                rtpdepay_audio_ = gst_element_factory_make("rtppcmudepay", "audio-depay");
+                rtpdepay_audio_ = ElementFactory::Make("rtppcmudepay", "audio-depay");
                 break;
             case AudioEncodingType::OPUS:
-                rtpdepay_audio_ = gst_element_factory_make("rtpopusdepay", "audio-depay");
+                rtpdepay_audio_ = ElementFactory::Make("rtpopusdepay", "audio-depay");
                 break;
             default:
                 GST_WARNING("[rtsp-client] invalid Audio Codec!");
@@ -179,6 +230,7 @@ bool RtspClient::add_to_pipeline()
 
         g_warn_if_fail(rtpdepay_audio_);
         gst_bin_add_many(GST_BIN(app()->pipeline()), rtpdepay_audio_, NULL);
+        app()->latency_tracer().Stamp(rtpdepay_audio_, "src");
         GST_DEBUG("[rtsp-client] configured audio: %s", pipeline->audio_encoding().c_str());
     }
     GST_DEBUG("[rtsp-client] %s initialize done.", name().c_str());
@@ -28,6 +28,10 @@ class RtspClient : public IEndpoint
 
     virtual bool initialize(Promise *promise);
     virtual void terminate();
+    virtual GstElement *video_output() { return parse_video_; }
+    virtual GstElement *audio_output() { return rtpdepay_audio_; }
+    virtual void request_keyframe();
+    virtual nlohmann::json stats();
 
  private:
     bool add_to_pipeline();
@@ -17,6 +17,8 @@
 #include <webstreamer.h>
 #include "rtspservice.h"
 #include <gst/rtsp-server/rtsp-onvif-server.h>
+#include <utils/trace.h>
+#include <atomic>
 
 GST_DEBUG_CATEGORY_STATIC(my_category);
 #define GST_CAT_DEFAULT my_category
@@ -90,6 +92,7 @@ bool IRTSPService::Launch(const std::string &path,
                           GCallback media_constructed,
                           GCallback media_configure)
 {
+    TRACE_SPAN(span, "rtspservice.launch");
     GstRTSPServer *server = server_->server();
     GstRTSPMountPoints *mount_points =
         gst_rtsp_server_get_mount_points(server);
@@ -173,14 +176,21 @@ bool IRTSPService::initialize(Promise *promise)
 
 void IRTSPService::terminate()
 {
+    PipeJoint video_joint;
+    PipeJoint audio_joint;
+    {
+        std::lock_guard<std::mutex> lock(joint_mutex_);
+        video_joint = video_joint_;
+        audio_joint = audio_joint_;
+    }
     // dynamicly unlink
     if (!app()->video_encoding().empty() &&
-        video_joint_.upstream_joint != NULL) {
-        app()->remove_pipe_joint(video_joint_.upstream_joint);
+        video_joint.upstream_joint != NULL) {
+        app()->remove_pipe_joint(video_joint.upstream_joint);
     }
     if (!app()->audio_encoding().empty() &&
-        audio_joint_.upstream_joint != NULL) {
-        app()->remove_pipe_joint(audio_joint_.upstream_joint);
+        audio_joint.upstream_joint != NULL) {
+        app()->remove_pipe_joint(audio_joint.upstream_joint);
     }
     // stop itself
     Stop();
@@ -210,22 +220,29 @@ void IRTSPService::on_rtsp_media_constructed(GstRTSPMediaFactory *factory, GstRT
     }
     g_object_set(G_OBJECT(gstrtspstream), "sink-false", TRUE, NULL);
 
-    static int session_count = 0;
+    // reentrant, the media of one path may be constructed concurrently
+    static std::atomic<int> session_count(0);
+    int session = session_count++;
     if (!rtspserver->app()->video_encoding().empty()) {
         GST_DEBUG("[rtsp-server] (path: %s) media constructed: video", rtspserver->path_.c_str());
 
-        static std::string media_type = "video";
+        static const std::string media_type = "video";
         std::string pipejoint_name = std::string("rtspserver_video_endpoint_joint_") +
                                      rtspserver->name() +
-                                     std::to_string(session_count);
-        rtspserver->video_joint_ = make_pipe_joint(media_type, pipejoint_name);
+                                     std::to_string(session);
+        PipeJoint video_joint = rtspserver->app()->make_joint(rtspserver, media_type, pipejoint_name);
+        {
+            std::lock_guard<std::mutex> lock(rtspserver->joint_mutex_);
+            rtspserver->video_joint_ = video_joint;
+        }
 
-        rtspserver->app()->add_pipe_joint(rtspserver->video_joint_.upstream_joint);
+        rtspserver->app()->add_pipe_joint(video_joint.upstream_joint);
 
-        g_warn_if_fail(gst_bin_add(GST_BIN(rtsp_server_media_bin), rtspserver->video_joint_.downstream_joint));
+        g_warn_if_fail(gst_bin_add(GST_BIN(rtsp_server_media_bin), video_joint.downstream_joint));
 
         GstElement *video_pay = gst_bin_get_by_name_recurse_up(GST_BIN(rtsp_server_media_bin), "pay0");
-        g_warn_if_fail(gst_element_link(rtspserver->video_joint_.downstream_joint, video_pay));
+        g_warn_if_fail(gst_element_link(video_joint.downstream_joint, video_pay));
+        rtspserver->app()->latency_tracer().Hop(video_pay, "src", rtspserver->name(), "video.pay");
 
         //GstPad *pad = gst_element_get_static_pad(video_pay, "src");
         // gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, cb_have_data, user_data, NULL);
@@ -235,22 +252,26 @@ void IRTSPService::on_rtsp_media_constructed(GstRTSPMediaFactory *factory, GstRT
     if (!rtspserver->app()->audio_encoding().empty()) {
         GST_DEBUG("[rtsp-server] (path: %s) media constructed: audio", rtspserver->path_.c_str());
 
-        static std::string media_type = "audio";
+        static const std::string media_type = "audio";
         std::string pipejoint_name = std::string("rtspserver_audio_endpoint_joint_") +
                                      rtspserver->name() +
-                                     std::to_string(session_count);
-        rtspserver->audio_joint_ = make_pipe_joint(media_type, pipejoint_name);
+                                     std::to_string(session);
+        PipeJoint audio_joint = rtspserver->app()->make_joint(rtspserver, media_type, pipejoint_name);
+        {
+            std::lock_guard<std::mutex> lock(rtspserver->joint_mutex_);
+            rtspserver->audio_joint_ = audio_joint;
+        }
 
-        rtspserver->app()->add_pipe_joint(rtspserver->audio_joint_.upstream_joint);
+        rtspserver->app()->add_pipe_joint(audio_joint.upstream_joint);
 
-        g_warn_if_fail(gst_bin_add(GST_BIN(rtsp_server_media_bin), rtspserver->audio_joint_.downstream_joint));
+        g_warn_if_fail(gst_bin_add(GST_BIN(rtsp_server_media_bin), audio_joint.downstream_joint));
 
         GstElement *audio_pay = gst_bin_get_by_name_recurse_up(GST_BIN(rtsp_server_media_bin), "pay1");
-        g_warn_if_fail(gst_element_link(rtspserver->audio_joint_.downstream_joint, audio_pay));
+        g_warn_if_fail(gst_element_link(audio_joint.downstream_joint, audio_pay));
+        rtspserver->app()->latency_tracer().Hop(audio_pay, "src", rtspserver->name(), "audio.pay");
 
         // GstPad *pad = gst_element_get_static_pad(audio_pay, "src");
         // gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, rtspserver->cb_have_data, user_data, NULL);
         // gst_object_unref(pad);
     }
-    session_count++;
 }
@@ -66,7 +66,8 @@ class IRTSPService : public IEndpoint
     std::map<GstRTSPSession *, GstRTSPClient *> clients_;
     static std::mutex client_mutex_;
 
-
+    // media are constructed by the threads of the rtsp server
+    std::mutex joint_mutex_;
     PipeJoint video_joint_;
     PipeJoint audio_joint_;
 };
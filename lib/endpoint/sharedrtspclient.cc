@@ -0,0 +1,146 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sharedrtspclient.h"
+#include <webstreamer.h>
+
+using json = nlohmann::json;
+
+GST_DEBUG_CATEGORY_STATIC(my_category);
+#define GST_CAT_DEFAULT my_category
+
+SharedRtspClient::SharedRtspClient(IApp *app, const std::string &name)
+    : IEndpoint(app, name)
+    , ingest_(NULL)
+{
+    video_joint_.upstream_joint = NULL;
+    video_joint_.downstream_joint = NULL;
+    audio_joint_.upstream_joint = NULL;
+    audio_joint_.downstream_joint = NULL;
+}
+
+SharedRtspClient::~SharedRtspClient()
+{
+}
+
+bool SharedRtspClient::initialize(Promise *promise)
+{
+    GST_DEBUG_CATEGORY_INIT(my_category, "webstreamer", 2, "libWebStreamer");
+
+    const json &j = promise->data();
+    // links like a rtsp client, only the source is elsewhere
+    IEndpoint::protocol() = "rtspclient";
+    if (j.find("video_codec") != j.end()) {
+        const std::string video_codec = j["video_codec"];
+        app()->video_encoding() = video_codec;
+    }
+    if (j.find("audio_codec") != j.end()) {
+        const std::string audio_codec = j["audio_codec"];
+        app()->audio_encoding() = audio_codec;
+    }
+
+    json::const_iterator url = j.find("url");
+    if (url == j.cend() || !url->is_string()) {
+        GST_ERROR("[shared-rtsp-client] %s: no url for shared source.", name().c_str());
+        return false;
+    }
+    source_ = j;
+    return true;
+}
+
+bool SharedRtspClient::startup(const std::function<void(const std::string &error)> &done)
+{
+    done_ = done;
+    ticket_ = app()->webstreamer().sources().Acquire(
+        source_, app()->context(), [this](IApp *ingest, const std::string &error) {
+            on_acquired(ingest, error);
+        });
+    return true;
+}
+
+void SharedRtspClient::on_acquired(IApp *ingest, const std::string &error)
+{
+    // done may delete this endpoint
+    std::function<void(const std::string &error)> done;
+    done.swap(done_);
+    if (!ingest) {
+        GST_ERROR("[shared-rtsp-client] %s: %s", name().c_str(), error.c_str());
+        done(error);
+        return;
+    }
+    ingest_ = ingest;
+    GST_DEBUG("[shared-rtsp-client] %s joins %s", name().c_str(), ingest_->uname().c_str());
+
+    if ((!app()->video_encoding().empty() && !add_joint("video", &video_joint_)) ||
+        (!app()->audio_encoding().empty() && !add_joint("audio", &audio_joint_))) {
+        done("joining the shared source failed.");
+        return;
+    }
+    done(std::string());
+}
+
+void SharedRtspClient::terminate()
+{
+    remove_joint(&video_joint_);
+    remove_joint(&audio_joint_);
+    // drops the callback if the ingest is not there yet
+    app()->webstreamer().sources().Release(ticket_);
+    ticket_.reset();
+    ingest_ = NULL;
+    if (done_) {
+        std::function<void(const std::string &error)> done;
+        done.swap(done_);
+        done("cancelled");
+    }
+}
+
+void SharedRtspClient::request_keyframe()
+{
+    // merged with the requests of the other apps by the ingest
+    if (ingest_) {
+        ingest_->request_keyframe(app()->uname());
+    }
+}
+
+bool SharedRtspClient::add_joint(const std::string &media_type, PipeJoint *joint)
+{
+    std::string joint_name = "shared_rtsp_" + media_type + "_joint_" + app()->uname() + "_" + name();
+    *joint = ingest_->make_joint(this, media_type, joint_name);
+    if (!gst_bin_add(GST_BIN(app()->pipeline()), joint->downstream_joint)) {
+        GST_ERROR("[shared-rtsp-client] %s: add %s joint failed.", name().c_str(), media_type.c_str());
+        if (joint->upstream_joint != joint->downstream_joint) {
+            gst_object_unref(joint->upstream_joint);
+        }
+        gst_object_unref(joint->downstream_joint);
+        destroy_pipe_joint(joint);
+        return false;
+    }
+    ingest_->add_pipe_joint(joint->upstream_joint);
+    return true;
+}
+
+void SharedRtspClient::remove_joint(PipeJoint *joint)
+{
+    if (joint->upstream_joint) {
+        // the ingest drops (and disposes) the proxysink
+        ingest_->remove_pipe_joint(joint->upstream_joint);
+    }
+    if (joint->downstream_joint) {
+        gst_element_set_state(joint->downstream_joint, GST_STATE_NULL);
+        gst_bin_remove(GST_BIN(app()->pipeline()), joint->downstream_joint);
+    }
+    destroy_pipe_joint(joint);
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBWEBSTREAMER_ENDPOINT_SHARED_RTSP_CLIENT_H_
+#define _LIBWEBSTREAMER_ENDPOINT_SHARED_RTSP_CLIENT_H_
+
+#include <framework/app.h>
+#include <app/sourceregistry.h>
+#include <utils/pipejoint.h>
+
+/*
+ * RTSP performer backed by a shared ingest of the SourceRegistry.
+ * Instead of opening its own session it joins the tees of the ingest
+ * pipeline through PipeJoint, so N apps pulling the same camera cost
+ * one RTSP session and one depay/parse chain. startup() acquires the
+ * ingest without blocking the app loop, the outputs exist once done.
+ */
+class SharedRtspClient : public IEndpoint
+{
+ public:
+    SharedRtspClient(IApp *app, const std::string &name);
+    ~SharedRtspClient();
+
+    virtual bool initialize(Promise *promise);
+    virtual void terminate();
+    virtual bool startup(const std::function<void(const std::string &error)> &done);
+    virtual GstElement *video_output() { return video_joint_.downstream_joint; }
+    virtual GstElement *audio_output() { return audio_joint_.downstream_joint; }
+    virtual void request_keyframe();
+
+ private:
+    bool add_joint(const std::string &media_type, PipeJoint *joint);
+    void remove_joint(PipeJoint *joint);
+    void on_acquired(IApp *ingest, const std::string &error);
+
+    nlohmann::json source_;
+    SourceRegistry::Ticket ticket_;
+    std::function<void(const std::string &error)> done_;
+    IApp *ingest_;
+    PipeJoint video_joint_;
+    PipeJoint audio_joint_;
+};
+#endif
@@ -15,7 +15,10 @@
  */
 
 #include "webrtc.h"
+#include <webstreamer.h>
 #include <utils/typedef.h>
+#include <utils/padstats.h>
+#include <utils/trace.h>
 #include <gst/sdp/sdp.h>
 #include <gst/webrtc/webrtc.h>
 
@@ -29,6 +32,7 @@ WebRTC::WebRTC(IApp *app, const std::string &name)
     , pipeline_(NULL)
     , bin_(NULL)
     , webrtc_(NULL)
+    , stats_cache_(std::make_shared<StatsCache>())
 {
 }
 
@@ -46,14 +50,11 @@ void WebRTC::on_ice_candidate(GstElement *webrtc_element G_GNUC_UNUSED,
     data["candidate"] = candidate;
     data["sdpMLineIndex"] = mlineindex;
 
-    std::string ice_candidate = data.dump();
-
-    // printf("\nice:%s\n", ice_candidate.c_str());
-
     json meta;
     meta["topic"] = "webrtc";
     meta["origin"] = webrtc->app()->uname();
     meta["type"] = "ice";
+    meta["endpoint"] = webrtc->name();
 
     GST_DEBUG("[webrtc] %p (%s) local candidate created.", webrtc->webrtc_, webrtc->role_.c_str());
 
@@ -80,6 +81,7 @@ void WebRTC::on_sdp_created(GstPromise *promise, gpointer user_data)
     meta["topic"] = "webrtc";
     meta["origin"] = webrtc->app()->uname();
     meta["type"] = "sdp";
+    meta["endpoint"] = webrtc->name();
 
     g_signal_emit_by_name(webrtc->webrtc_, "set-local-description", sdp, NULL);
     GST_DEBUG("[webrtc] %p (%s) local description created.", webrtc->webrtc_, webrtc->role_.c_str());
@@ -159,39 +161,22 @@ bool WebRTC::initialize(Promise *promise)
         return false;
     }
     if (launch_.empty()) {
-        launch_ = "webrtcbin name=webrtc ";
-        if (!app()->video_encoding().empty()) {
-            std::string video_enc = app()->video_encoding();
-            // launch += "rtspsrc location=rtsp://172.16.66.65/id=1 ! rtph264depay ! queue ! ";
-            launch_ += "rtp" + video_enc + "pay name=pay0 ! queue ! " +
-                       "application/x-rtp,media=video,encoding-name=" + uppercase(video_enc) +
-                       ",payload=96 ! webrtc. ";
-        }
-        if (!app()->audio_encoding().empty()) {
-            std::string audio_enc = app()->audio_encoding();
-            launch_ += "rtp" + audio_enc + "pay name=pay1 ! queue ! " +
-                       "application/x-rtp,media=audio,encoding-name=" + uppercase(audio_enc);
-            if (uppercase(audio_enc) == "PCMA") {
-                launch_ += ",payload=8 ! webrtc. ";
-            } else {
-                launch_ += ",payload=97 ! webrtc. ";
-            }
-        }
+        launch_ = WebRTCPool::MakeLaunch(app()->video_encoding(), app()->audio_encoding());
     }
     // printf("===============>  %s\n", launch_.c_str());
-    GError *error = NULL;
-    bin_ = gst_parse_launch(launch_.c_str(), &error);
-
-    if (error) {
-        GST_ERROR("[webrtc] Failed to parse launch: %s", error->message);
-        g_error_free(error);
-        g_clear_object(&bin_);
-        bin_ = NULL;
+    // pre-built and READY when the pool has one for this launch
+    WebRTCPool::Prepared prepared;
+    std::string error;
+    TRACE_SPAN(acquire_span, "webrtc.acquire");
+    bool acquired = app()->webstreamer().webrtc_pool().Acquire(launch_, &prepared, &error);
+    acquire_span.Stop();
+    if (!acquired) {
+        GST_ERROR("[webrtc] Failed to parse launch: %s", error.c_str());
         return false;
     }
-    pipeline_ = gst_pipeline_new(NULL);
-    gst_bin_add(GST_BIN(pipeline_), bin_);
-    g_assert_nonnull(pipeline_);
+    pipeline_ = prepared.pipeline;
+    bin_ = prepared.bin;
+    app()->bus_monitor().Watch(pipeline_, name());
     webrtc_ = gst_bin_get_by_name(GST_BIN(pipeline_), "webrtc");
 
     gboolean sync = TRUE;
@@ -228,7 +213,7 @@ bool WebRTC::initialize(Promise *promise)
         std::string pipejoint_name = std::string("webrtc_video_endpoint_joint_") +
                                      name() +
                                      std::to_string(session_count);
-        video_joint_ = make_pipe_joint(media_type, pipejoint_name);
+        video_joint_ = app()->make_joint(this, media_type, pipejoint_name);
 
         app()->add_pipe_joint(video_joint_.upstream_joint);
 
@@ -236,6 +221,7 @@ bool WebRTC::initialize(Promise *promise)
 
         GstElement *video_pay = gst_bin_get_by_name_recurse_up(GST_BIN(pipeline_), "pay0");
         g_warn_if_fail(gst_element_link(video_joint_.downstream_joint, video_pay));
+        app()->latency_tracer().Hop(video_pay, "src", name(), "video.pay");
     }
     if (!app()->audio_encoding().empty()) {
         GST_DEBUG("[webrtc] %p media constructed: audio", webrtc_);
@@ -244,7 +230,7 @@ bool WebRTC::initialize(Promise *promise)
         std::string pipejoint_name = std::string("webrtc_audio_endpoint_joint_") +
                                      name() +
                                      std::to_string(session_count);
-        audio_joint_ = make_pipe_joint(media_type, pipejoint_name);
+        audio_joint_ = app()->make_joint(this, media_type, pipejoint_name);
 
         app()->add_pipe_joint(audio_joint_.upstream_joint);
 
@@ -254,21 +240,30 @@ bool WebRTC::initialize(Promise *promise)
         if (!gst_element_link(audio_joint_.downstream_joint, audio_pay)) {
             GST_ERROR("[webrtc] %p (%s) audio joint pad link failed.", webrtc_, role_.c_str());
         }
+        app()->latency_tracer().Hop(audio_pay, "src", name(), "audio.pay");
     }
     session_count++;
 
-
-    GstStateChangeReturn ret = gst_element_set_state(pipeline_, GST_STATE_PLAYING);
-    if (ret == GST_STATE_CHANGE_FAILURE) {
-        GST_DEBUG("[webrtc] %p initialize failed.", webrtc_);
-    }
+    // PLAYING is reached in startup(), off the app loop
     GST_DEBUG("[webrtc] %p (%s) initialize done.", webrtc_, role_.c_str());
 
     return true;
 }
 
+bool WebRTC::startup(const std::function<void(const std::string &error)> &done)
+{
+    g_return_val_if_fail(pipeline_ != NULL, false);
+    state_change_.Start(pipeline_, GST_STATE_PLAYING, ASYNC_STATE_CHANGE_TIMEOUT, app()->context(), done);
+    return true;
+}
+
 void WebRTC::terminate()
 {
+    // no PLAYING after this, and no signal reaches the deleted endpoint
+    state_change_.Cancel();
+    if (webrtc_) {
+        g_signal_handlers_disconnect_by_data(webrtc_, this);
+    }
     // dynamicly unlink
     if (!app()->video_encoding().empty() &&
         video_joint_.upstream_joint != NULL) {
@@ -279,6 +274,7 @@ void WebRTC::terminate()
         app()->remove_pipe_joint(audio_joint_.upstream_joint);
     }
     if (pipeline_) {
+        app()->bus_monitor().Unwatch(pipeline_);
         gst_element_set_state(GST_ELEMENT(pipeline_), GST_STATE_NULL);
         gst_bin_remove(GST_BIN(pipeline_), bin_);
         gst_object_unref(pipeline_);
@@ -290,11 +286,64 @@ void WebRTC::terminate()
     GST_DEBUG("[webrtc] %p (%s) terminate done.", webrtc_, role_.c_str());
 }
 
-void WebRTC::set_remote_description(Promise *promise)
+json WebRTC::stats()
 {
-    const json &j = promise->data();
-    std::string sdp_info = j["sdp"];
-    std::string type = j["type"];
+    json stats;
+    bool request = false;
+    {
+        std::lock_guard<std::mutex> lock(stats_cache_->mutex);
+        if (webrtc_ && !stats_cache_->pending) {
+            stats_cache_->pending = true;
+            request = true;
+        }
+        stats = stats_cache_->stats;
+    }
+    // not under the lock: webrtcbin replies on this thread when it
+    // cannot queue the task (pipeline not started yet)
+    if (request) {
+        GstPromise *promise = gst_promise_new_with_change_func(WebRTC::on_stats,
+                                                               new std::shared_ptr<StatsCache>(stats_cache_),
+                                                               free_stats_cache);
+        g_signal_emit_by_name(webrtc_, "get-stats", NULL, promise);
+    }
+    return stats;
+}
+
+void WebRTC::on_stats(GstPromise *promise, gpointer user_data)
+{
+    // the unref below may free user_data
+    std::shared_ptr<StatsCache> cache = *static_cast<std::shared_ptr<StatsCache> *>(user_data);
+    json stats;
+    if (gst_promise_wait(promise) == GST_PROMISE_RESULT_REPLIED) {
+        stats = structure_to_json(gst_promise_get_reply(promise));
+    }
+    gst_promise_unref(promise);
+
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    cache->stats = stats;
+    cache->pending = false;
+}
+
+void WebRTC::free_stats_cache(gpointer data)
+{
+    delete static_cast<std::shared_ptr<StatsCache> *>(data);
+}
+
+bool WebRTC::set_remote_description(Promise *promise)
+{
+    std::string sdp_info;
+    std::string type;
+    if (promise->binary()) {
+        if (!promise->GetString(PLUGIN_TLV_SDP, &sdp_info) ||
+            !promise->GetString(PLUGIN_TLV_SDP_TYPE, &type)) {
+            GST_ERROR("[webrtc] %p (%s) invalid remote description.", webrtc_, role_.c_str());
+            return false;
+        }
+    } else {
+        const json &j = promise->data();
+        sdp_info = j["sdp"].get<std::string>();
+        type = j["type"].get<std::string>();
+    }
     // printf("\n%s\n", sdp_info.c_str());
 
     GstWebRTCSessionDescription *sdp;
@@ -313,12 +362,24 @@ void WebRTC::set_remote_description(Promise *promise)
         GstPromise *promise = gst_promise_new_with_change_func(WebRTC::on_sdp_created, this, NULL);
         g_signal_emit_by_name(webrtc_, "create-answer", NULL, promise);
     }
+    return true;
 }
-void WebRTC::set_remote_candidate(Promise *promise)
+bool WebRTC::set_remote_candidate(Promise *promise)
 {
-    const json &j = promise->data();
-    std::string candidate = j["candidate"];
-    int sdpmlineindex = j["sdpMLineIndex"];
+    std::string candidate;
+    guint32 sdpmlineindex = 0;
+    if (promise->binary()) {
+        if (!promise->GetString(PLUGIN_TLV_CANDIDATE, &candidate) ||
+            !promise->GetUint(PLUGIN_TLV_MLINE_INDEX, &sdpmlineindex)) {
+            GST_ERROR("[webrtc] %p (%s) invalid remote candidate.", webrtc_, role_.c_str());
+            return false;
+        }
+    } else {
+        const json &j = promise->data();
+        candidate = j["candidate"].get<std::string>();
+        sdpmlineindex = j["sdpMLineIndex"].get<guint32>();
+    }
     g_signal_emit_by_name(webrtc_, "add-ice-candidate", sdpmlineindex, candidate.c_str());
     GST_DEBUG("[webrtc] %p (%s) set remote candidate.", webrtc_, role_.c_str());
+    return true;
 }
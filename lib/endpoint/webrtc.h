@@ -20,6 +20,9 @@
 
 #include <framework/app.h>
 #include <utils/pipejoint.h>
+#include <utils/asyncstatechange.h>
+#include <memory>
+#include <mutex>  // NOLINT
 
 class WebRTC : public IEndpoint
 {
@@ -29,9 +32,13 @@ class WebRTC : public IEndpoint
 
     virtual bool initialize(Promise *promise);
     virtual void terminate();
+    virtual bool startup(const std::function<void(const std::string &error)> &done);
+    // the reply of the previous get-stats, a new one is requested
+    virtual nlohmann::json stats();
 
-    void set_remote_description(Promise *promise);
-    void set_remote_candidate(Promise *promise);
+    // false if the description (candidate) of the call is invalid
+    bool set_remote_description(Promise *promise);
+    bool set_remote_candidate(Promise *promise);
 
     GstElement *pipeline() { return pipeline_; }
     std::string &launch() { return launch_; }
@@ -44,6 +51,8 @@ class WebRTC : public IEndpoint
     static void on_sdp_created(GstPromise *promise, gpointer user_data);
     static void on_negotiation_needed(GstElement *element, gpointer user_data);
     static void on_webrtc_pad_added(GstElement *webrtc, GstPad *new_pad, gpointer user_data);
+    static void on_stats(GstPromise *promise, gpointer user_data);
+    static void free_stats_cache(gpointer data);
 
 
     bool add_to_pipeline();
@@ -52,6 +61,19 @@ class WebRTC : public IEndpoint
     GstElement *bin_;
     GstElement *webrtc_;
 
+    AsyncStateChange state_change_;
+    // get-stats is answered on the webrtcbin thread, maybe after terminate
+    struct StatsCache
+    {
+        StatsCache()
+            : pending(false)
+        {
+        }
+        std::mutex mutex;
+        nlohmann::json stats;
+        bool pending;
+    };
+    std::shared_ptr<StatsCache> stats_cache_;
     PipeJoint video_joint_;
     PipeJoint audio_joint_;
     std::string role_;
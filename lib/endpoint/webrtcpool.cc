@@ -0,0 +1,215 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "webrtcpool.h"
+#include <utils/typedef.h>
+#include <utils/launchrecipe.h>
+
+GST_DEBUG_CATEGORY_STATIC(my_category);
+#define GST_CAT_DEFAULT my_category
+
+using json = nlohmann::json;
+
+WebRTCPool::WebRTCPool()
+    : thread_(NULL)
+    , stopping_(false)
+    , size_(0)
+    , hits_(0)
+    , misses_(0)
+    , built_(0)
+{
+}
+
+WebRTCPool::~WebRTCPool()
+{
+    Stop();
+}
+
+bool WebRTCPool::Start(const json &option)
+{
+    GST_DEBUG_CATEGORY_INIT(my_category, "webstreamer", 2, "libWebStreamer");
+    g_return_val_if_fail(thread_ == NULL, false);
+    if (!option.is_object()) {
+        return true;
+    }
+    size_ = (guint)CLAMP(option.value("pool_size", 0), 0, 64);
+    if (size_ == 0) {
+        return true;
+    }
+    json::const_iterator prewarm = option.find("prewarm");
+    if (prewarm != option.cend() && prewarm->is_array()) {
+        for (auto &codecs : *prewarm) {
+            if (!codecs.is_object()) {
+                continue;
+            }
+            std::string launch = MakeLaunch(codecs.value("video", std::string()),
+                                            codecs.value("audio", std::string()));
+            idle_[launch];
+        }
+    }
+    stopping_ = false;
+    thread_ = g_thread_new("webstreamer_webrtc_pool", WebRTCPool::Run, this);
+    GST_INFO("[webrtc] pool of %u viewer pipelines per codec.", size_);
+    return thread_ != NULL;
+}
+
+void WebRTCPool::Stop()
+{
+    if (thread_) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cond_.notify_one();
+        g_thread_join(thread_);
+        thread_ = NULL;
+    }
+    for (auto &it : idle_) {
+        for (auto &prepared : it.second) {
+            Free(&prepared);
+        }
+    }
+    idle_.clear();
+}
+
+std::string WebRTCPool::MakeLaunch(const std::string &video_encoding,
+                                   const std::string &audio_encoding)
+{
+    std::string launch = "webrtcbin name=webrtc ";
+    if (!video_encoding.empty()) {
+        launch += "rtp" + video_encoding + "pay name=pay0 ! queue ! " +
+                  "application/x-rtp,media=video,encoding-name=" + uppercase(video_encoding) +
+                  ",payload=96 ! webrtc. ";
+    }
+    if (!audio_encoding.empty()) {
+        launch += "rtp" + audio_encoding + "pay name=pay1 ! queue ! " +
+                  "application/x-rtp,media=audio,encoding-name=" + uppercase(audio_encoding);
+        if (uppercase(audio_encoding) == "PCMA") {
+            launch += ",payload=8 ! webrtc. ";
+        } else {
+            launch += ",payload=97 ! webrtc. ";
+        }
+    }
+    return launch;
+}
+
+bool WebRTCPool::Acquire(const std::string &launch, Prepared *prepared, std::string *error)
+{
+    if (thread_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::deque<Prepared> &idle = idle_[launch];
+        if (!idle.empty()) {
+            *prepared = idle.front();
+            idle.pop_front();
+            hits_++;
+        } else {
+            misses_++;
+        }
+    }
+    // the taken one (or a new key) is refilled in the background
+    cond_.notify_one();
+    if (prepared->pipeline) {
+        return true;
+    }
+    return Build(launch, prepared, error);
+}
+
+bool WebRTCPool::Build(const std::string &launch, Prepared *prepared, std::string *error)
+{
+    // parsed once per launch, replayed afterwards
+    std::shared_ptr<LaunchRecipe> recipe = LaunchRecipe::Get(launch, error);
+    GstElement *bin = recipe ? recipe->Instantiate(error) : NULL;
+    if (!bin) {
+        return false;
+    }
+    prepared->pipeline = gst_pipeline_new(NULL);
+    prepared->bin = bin;
+    gst_bin_add(GST_BIN(prepared->pipeline), bin);
+    // plugin lookups and element setup are done here, not at join
+    if (gst_element_set_state(prepared->pipeline, GST_STATE_READY) == GST_STATE_CHANGE_FAILURE) {
+        *error = "webrtc viewer pipeline failed to reach READY";
+        Free(prepared);
+        return false;
+    }
+    return true;
+}
+
+void WebRTCPool::Free(Prepared *prepared)
+{
+    if (prepared->pipeline) {
+        gst_element_set_state(prepared->pipeline, GST_STATE_NULL);
+        gst_object_unref(prepared->pipeline);
+    }
+    prepared->pipeline = NULL;
+    prepared->bin = NULL;
+}
+
+bool WebRTCPool::Wanted(std::string *launch)
+{
+    for (auto &it : idle_) {
+        if (it.second.size() < size_) {
+            *launch = it.first;
+            return true;
+        }
+    }
+    return false;
+}
+
+gpointer WebRTCPool::Run(gpointer data)
+{
+    WebRTCPool *self = static_cast<WebRTCPool *>(data);
+    for (;;) {
+        std::string launch;
+        {
+            std::unique_lock<std::mutex> lock(self->mutex_);
+            while (!self->stopping_ && !self->Wanted(&launch)) {
+                self->cond_.wait(lock);
+            }
+            if (self->stopping_) {
+                break;
+            }
+        }
+        Prepared prepared;
+        std::string error;
+        if (!Build(launch, &prepared, &error)) {
+            // a broken launch is not retried, viewers build it themselves
+            GST_ERROR("[webrtc] pool: %s: %s", launch.c_str(), error.c_str());
+            std::lock_guard<std::mutex> lock(self->mutex_);
+            self->idle_.erase(launch);
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(self->mutex_);
+        self->idle_[launch].push_back(prepared);
+        self->built_++;
+    }
+    return NULL;
+}
+
+json WebRTCPool::stats()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    json j;
+    j["pool_size"] = size_;
+    j["hits"] = hits_;
+    j["misses"] = misses_;
+    j["built"] = built_;
+    json idle = json::object();
+    for (auto &it : idle_) {
+        idle[it.first] = it.second.size();
+    }
+    j["idle"] = idle;
+    return j;
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBWEBSTREAMER_ENDPOINT_WEBRTC_POOL_H_
+#define _LIBWEBSTREAMER_ENDPOINT_WEBRTC_POOL_H_
+
+#include <gst/gst.h>
+#include <nlohmann/json.hpp>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>  // NOLINT
+#include <string>
+
+/*
+ * Pre-built WebRTC viewer pipelines, set to READY ahead of time.
+ * Pipelines are keyed by their launch string, which follows from the
+ * video + audio codec of the app. A worker thread keeps pool_size of
+ * them per key, so add_audience only links joints and negotiates.
+ * Keys come from the init option or from the first viewer of an app.
+ * init option: "webrtc": {"pool_size": n,
+ *                         "prewarm": [{"video": "h264", "audio": "pcma"}]}
+ */
+class WebRTCPool
+{
+ public:
+    struct Prepared
+    {
+        Prepared()
+            : pipeline(NULL)
+            , bin(NULL)
+        {
+        }
+        GstElement *pipeline;
+        GstElement *bin;  // the parsed launch, owned by the pipeline
+    };
+
+    WebRTCPool();
+    ~WebRTCPool();
+
+    bool Start(const nlohmann::json &option);
+    void Stop();
+
+    static std::string MakeLaunch(const std::string &video_encoding,
+                                  const std::string &audio_encoding);
+    // a pooled pipeline, or one built in the calling thread
+    bool Acquire(const std::string &launch, Prepared *prepared, std::string *error);
+    static bool Build(const std::string &launch, Prepared *prepared, std::string *error);
+    static void Free(Prepared *prepared);
+
+    nlohmann::json stats();
+
+ private:
+    WebRTCPool(const WebRTCPool &);
+    WebRTCPool &operator=(const WebRTCPool &);
+
+    static gpointer Run(gpointer data);
+    // a key below pool_size, false when all are full
+    bool Wanted(std::string *launch);
+
+    GThread *thread_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool stopping_;
+    guint size_;
+    std::map<std::string, std::deque<Prepared> > idle_;
+    guint64 hits_;
+    guint64 misses_;
+    guint64 built_;
+};
+
+#endif  // _LIBWEBSTREAMER_ENDPOINT_WEBRTC_POOL_H_
@@ -16,6 +16,7 @@
 
 #include "app.h"
 #include <webstreamer.h>
+#include <utils/eventbuffer.h>
 
 bool IApp::Initialize(Promise* promise)
 {
@@ -25,6 +26,13 @@ bool IApp::Initialize(Promise* promise)
     }
 
     if (pipeline_) {
+        const nlohmann::json &j = promise->data();
+        if (j.is_object() && j.find("bus") != j.end()) {
+            bus_monitor_.Configure(j["bus"]);
+        } else {
+            bus_monitor_.Configure(nlohmann::json());
+        }
+        bus_monitor_.Watch(pipeline_, std::string());
         // promise->resolve();
         return true;
     } else {
@@ -36,6 +44,7 @@ bool IApp::Initialize(Promise* promise)
 
 bool IApp::Destroy(Promise* promise)
 {
+    bus_monitor_.Stop();
     if (pipeline_) {
         gst_element_set_state(pipeline_, GST_STATE_NULL);
         g_object_unref(pipeline_);
@@ -45,14 +54,31 @@ bool IApp::Destroy(Promise* promise)
     return true;
 }
 
+GMainContext* IApp::context()
+{
+    if (context_) {
+        return context_;
+    }
+    if (!webstreamer_) {
+        return WebStreamer::main_context;
+    }
+    return webstreamer_->GetContext(uname());
+}
 
 void IApp::Notify(const nlohmann::json& data, const nlohmann::json& meta)
 {
-    const std::string& jdata = data.dump();
-    const std::string& jmeta = meta.dump();
+    if (notifier_.Schedule(data, meta)) {
+        return;
+    }
+    NotifyNow(data, meta);
+}
+
+void IApp::NotifyNow(const nlohmann::json& data, const nlohmann::json& meta)
+{
+    // serialized once into pooled buffers, the host releases them
     plugin_buffer_t d;
     plugin_buffer_t m;
-    plugin_buffer_string_set(&d, jdata.c_str());
-    plugin_buffer_string_set(&m, jmeta.c_str());
+    EventBuffer::Serialize(data)->Attach(&d);
+    EventBuffer::Serialize(meta)->Attach(&m);
     this->webstreamer_->Notify(&d, &m);
 }
@@ -20,6 +20,10 @@
 
 
 #include "endpoint.h"
+#include "notifyscheduler.h"
+#include "busmonitor.h"
+#include <utils/pipejoint.h>
+#include <utils/latencytracer.h>
 class WebStreamer;
 class IApp
 {
@@ -28,7 +32,10 @@ class IApp
         : name_(name)
         , pipeline_(NULL)
         , webstreamer_(ws)
-
+        , context_(NULL)
+        , id_(0)
+        , endpoint_seq_(0)
+        , bus_monitor_(this)
     {}
     virtual ~IApp(){}
 
@@ -44,14 +51,38 @@ class IApp
     virtual std::string uname() = 0;
 
     virtual void Notify(const nlohmann::json &data, const nlohmann::json &meta);
+    // hand the event to the host right away, bypassing the scheduler
+    void NotifyNow(const nlohmann::json &data, const nlohmann::json &meta);
+    NotifyScheduler &notifier() { return notifier_; }
+    // endpoints with a pipeline of their own watch it here as well
+    BusMonitor &bus_monitor() { return bus_monitor_; }
+    // ingest to egress hops of the stamped buffers, see LatencyTracer
+    LatencyTracer &latency_tracer() { return latency_tracer_; }
     WebStreamer &webstreamer() { return *webstreamer_; }
+    // the main context this app is pinned to, attach app sources here
+    GMainContext *context();
+    // pins the app to a context outside the pool, before Initialize
+    void set_context(GMainContext *context) { context_ = context; }
     GstElement *pipeline() { return pipeline_; }
     std::string name() { return name_; }
+    // interned ids used by the binary call envelope
+    guint32 id() const { return id_; }
+    guint32 &id() { return id_; }
+    guint32 next_endpoint_id() { return ++endpoint_seq_; }
     const std::string &video_encoding() const { return video_encoding_; }
     std::string &video_encoding() { return video_encoding_; }
     const std::string &audio_encoding() const { return audio_encoding_; }
     std::string &audio_encoding() { return audio_encoding_; }
 
+    // the joint kind is chosen by the app, see make_fanout_joint
+    virtual PipeJoint make_joint(IEndpoint *endpoint,
+                                 const std::string &media_type,
+                                 const std::string &name)
+    {
+        return make_pipe_joint(media_type, name);
+    }
+    // an audience (origin) needs a keyframe, from any thread
+    virtual void request_keyframe(const std::string &origin) {}
     virtual void add_pipe_joint(GstElement *upstream_joint) {}
     virtual void remove_pipe_joint(GstElement *upstream_joint) {}
 
@@ -59,9 +90,15 @@ class IApp
     std::string name_;
     GstElement* pipeline_;
     WebStreamer* webstreamer_;
+    GMainContext* context_;
 
     std::string video_encoding_;
     std::string audio_encoding_;
+    guint32 id_;
+    guint32 endpoint_seq_;
+    NotifyScheduler notifier_;
+    BusMonitor bus_monitor_;
+    LatencyTracer latency_tracer_;
 };
 
 #define APP(klass)                               \
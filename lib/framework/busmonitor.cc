@@ -0,0 +1,236 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "busmonitor.h"
+#include "app.h"
+#include <utils/metrics.h>
+
+GST_DEBUG_CATEGORY_STATIC(my_category);
+#define GST_CAT_DEFAULT my_category
+
+using json = nlohmann::json;
+
+BusMonitor::BusMonitor(IApp *app)
+    : app_(app)
+    , interval_(G_USEC_PER_SEC)
+{
+}
+
+BusMonitor::~BusMonitor()
+{
+    Stop();
+}
+
+void BusMonitor::Configure(const json &option)
+{
+    GST_DEBUG_CATEGORY_INIT(my_category, "webstreamer", 2, "libWebStreamer");
+    if (option.is_object()) {
+        interval_ = (gint64)MAX(0, option.value("interval", 1000)) * 1000;
+    }
+}
+
+void BusMonitor::Watch(GstElement *pipeline, const std::string &endpoint)
+{
+    g_return_if_fail(pipeline != NULL);
+    g_return_if_fail(watches_.find(pipeline) == watches_.end());
+
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GSource *source = gst_bus_create_watch(bus);
+    gst_object_unref(bus);
+
+    WatchData *watch = new WatchData;
+    watch->monitor = this;
+    watch->pipeline = pipeline;
+    watch->endpoint = endpoint;
+    watch->source = source;
+    watch->forward = NULL;
+    watch->forward_data = NULL;
+    g_source_set_callback(source, (GSourceFunc)on_message, watch, free_watch);
+    g_source_attach(source, app_->context());
+    watches_[pipeline] = watch;
+    counters_[endpoint];
+}
+
+void BusMonitor::Unwatch(GstElement *pipeline)
+{
+    auto it = watches_.find(pipeline);
+    if (it == watches_.end()) {
+        return;
+    }
+    // destroying the source frees the watch
+    std::string endpoint = it->second->endpoint;
+    GSource *source = it->second->source;
+    watches_.erase(it);
+    g_source_destroy(source);
+    g_source_unref(source);
+    counters_.erase(endpoint);
+    for (auto t = throttles_.begin(); t != throttles_.end();) {
+        if (t->first.compare(0, endpoint.size() + 1, endpoint + "|") == 0) {
+            t = throttles_.erase(t);
+        } else {
+            ++t;
+        }
+    }
+}
+
+void BusMonitor::Forward(GstElement *pipeline, GstBusFunc func, gpointer user_data)
+{
+    auto it = watches_.find(pipeline);
+    g_return_if_fail(it != watches_.end());
+    it->second->forward = func;
+    it->second->forward_data = user_data;
+}
+
+void BusMonitor::Stop()
+{
+    std::map<GstElement *, WatchData *> watches;
+    watches.swap(watches_);
+    for (auto &it : watches) {
+        GSource *source = it.second->source;
+        g_source_destroy(source);
+        g_source_unref(source);
+    }
+}
+
+gboolean BusMonitor::on_message(GstBus *bus, GstMessage *message, gpointer user_data)
+{
+    WatchData *watch = static_cast<WatchData *>(user_data);
+    watch->monitor->Handle(watch, message);
+    if (watch->forward) {
+        watch->forward(bus, message, watch->forward_data);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+void BusMonitor::free_watch(gpointer data)
+{
+    delete static_cast<WatchData *>(data);
+}
+
+void BusMonitor::Handle(WatchData *watch, GstMessage *message)
+{
+    Counters &counters = counters_[watch->endpoint];
+    const char *type = NULL;
+    json data;
+    gchar *path = GST_MESSAGE_SRC(message) ? gst_object_get_path_string(GST_MESSAGE_SRC(message)) : NULL;
+    std::string source = path ? path : "";
+    g_free(path);
+    switch (GST_MESSAGE_TYPE(message)) {
+        case GST_MESSAGE_ERROR:
+        case GST_MESSAGE_WARNING: {
+            GError *error = NULL;
+            gchar *debug = NULL;
+            if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_ERROR) {
+                gst_message_parse_error(message, &error, &debug);
+                counters.errors++;
+                type = "error";
+            } else {
+                gst_message_parse_warning(message, &error, &debug);
+                counters.warnings++;
+                type = "warning";
+            }
+            data["message"] = error ? error->message : "";
+            data["debug"] = debug ? debug : "";
+            GST_WARNING("[bus] %s %s: %s", app_->uname().c_str(), type, error ? error->message : "");
+            g_clear_error(&error);
+            g_free(debug);
+        } break;
+        case GST_MESSAGE_EOS:
+            counters.eos++;
+            type = "eos";
+            break;
+        case GST_MESSAGE_QOS: {
+            GstFormat format;
+            guint64 processed = 0;
+            guint64 dropped = 0;
+            gint64 jitter = 0;
+            gdouble proportion = 1.0;
+            gst_message_parse_qos_stats(message, &format, &processed, &dropped);
+            gst_message_parse_qos_values(message, &jitter, &proportion, NULL);
+            counters.qos++;
+            if (format == GST_FORMAT_BUFFERS && dropped != (guint64)-1) {
+                guint64 &last = counters.qos_dropped[source];
+                if (dropped > last) {
+                    Metrics::AddDropped("qos", dropped - last);
+                }
+                last = dropped;
+            }
+            data["processed"] = processed;
+            data["dropped"] = dropped;
+            data["jitter"] = jitter;
+            data["proportion"] = proportion;
+            type = "qos";
+        } break;
+        case GST_MESSAGE_LATENCY:
+            gst_bin_recalculate_latency(GST_BIN(watch->pipeline));
+            counters.latency++;
+            type = "latency";
+            break;
+        case GST_MESSAGE_BUFFERING: {
+            gint percent = 0;
+            gst_message_parse_buffering(message, &percent);
+            counters.buffering++;
+            counters.buffering_percent = percent;
+            data["percent"] = percent;
+            type = "buffering";
+        } break;
+        default:
+            return;
+    }
+    data["source"] = source;
+    Emit(watch->endpoint, type, data);
+}
+
+void BusMonitor::Emit(const std::string &endpoint, const char *type, json &data)
+{
+    Throttle &throttle = throttles_[endpoint + "|" + type];
+    gint64 now = g_get_monotonic_time();
+    if (throttle.last != 0 && now - throttle.last < interval_) {
+        throttle.suppressed++;
+        return;
+    }
+    throttle.last = now;
+    data["suppressed"] = throttle.suppressed;
+    throttle.suppressed = 0;
+
+    json meta;
+    meta["topic"] = "bus";
+    meta["origin"] = app_->uname();
+    meta["type"] = type;
+    meta["endpoint"] = endpoint;
+    app_->Notify(data, meta);
+}
+
+json BusMonitor::stats()
+{
+    json j = json::object();
+    for (auto &it : counters_) {
+        const Counters &c = it.second;
+        guint64 dropped = 0;
+        for (auto &d : c.qos_dropped) {
+            dropped += d.second;
+        }
+        j[it.first] = {{"errors", c.errors},
+                       {"warnings", c.warnings},
+                       {"eos", c.eos},
+                       {"qos", c.qos},
+                       {"qos_dropped", dropped},
+                       {"latency", c.latency},
+                       {"buffering", c.buffering},
+                       {"buffering_percent", c.buffering_percent}};
+    }
+    return j;
+}
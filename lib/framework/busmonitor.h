@@ -0,0 +1,113 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBWEBSTREAMER_FRAMEWORK_BUS_MONITOR_H_
+#define _LIBWEBSTREAMER_FRAMEWORK_BUS_MONITOR_H_
+
+#include <gst/gst.h>
+#include <map>
+#include <string>
+#include <nlohmann/json.hpp>
+
+class IApp;
+/*
+ * Per app bus watch of the app pipeline and of the endpoint pipelines.
+ * ERROR, WARNING, EOS, QOS, LATENCY and BUFFERING messages are counted
+ * and notified with meta {"topic": "bus", "origin", "type", "endpoint"}
+ * and data {"source", ...}. A message type is notified at most once per
+ * `interval` ms and endpoint, the next event carries how many were
+ * suppressed in between. LATENCY also redistributes the latency of the
+ * pipeline. Counters of an endpoint go with its watch. Watches run on
+ * the app context, the monitor is used from there only.
+ * A bus dispatches to one watch only: an app wanting the messages of a
+ * watched pipeline has them forwarded instead of adding its own watch.
+ *
+ *   create option "bus": {"interval": 1000}
+ */
+class BusMonitor
+{
+ public:
+    explicit BusMonitor(IApp *app);
+    ~BusMonitor();
+
+    void Configure(const nlohmann::json &option);
+    // endpoint: empty for the app pipeline
+    void Watch(GstElement *pipeline, const std::string &endpoint);
+    void Unwatch(GstElement *pipeline);
+    // func also gets every message of the watched pipeline, until Unwatch
+    void Forward(GstElement *pipeline, GstBusFunc func, gpointer user_data);
+    void Stop();
+
+    // counters by endpoint, "" is the app pipeline
+    nlohmann::json stats();
+
+ private:
+    BusMonitor(const BusMonitor &);
+    BusMonitor &operator=(const BusMonitor &);
+
+    struct Counters
+    {
+        Counters()
+            : errors(0)
+            , warnings(0)
+            , eos(0)
+            , qos(0)
+            , latency(0)
+            , buffering(0)
+            , buffering_percent(100)
+        {
+        }
+        guint64 errors;
+        guint64 warnings;
+        guint64 eos;
+        guint64 qos;
+        std::map<std::string, guint64> qos_dropped;  // cumulative, by source
+        guint64 latency;
+        guint64 buffering;
+        gint buffering_percent;
+    };
+    struct Throttle
+    {
+        Throttle()
+            : last(0)
+            , suppressed(0)
+        {
+        }
+        gint64 last;
+        guint64 suppressed;
+    };
+    struct WatchData
+    {
+        BusMonitor *monitor;
+        GstElement *pipeline;
+        std::string endpoint;
+        GSource *source;  // owns the WatchData
+        GstBusFunc forward;
+        gpointer forward_data;
+    };
+    static gboolean on_message(GstBus *bus, GstMessage *message, gpointer user_data);
+    static void free_watch(gpointer data);
+    void Handle(WatchData *watch, GstMessage *message);
+    void Emit(const std::string &endpoint, const char *type, nlohmann::json &data);
+
+    IApp *app_;
+    gint64 interval_;  // us
+    std::map<GstElement *, WatchData *> watches_;
+    std::map<std::string, Counters> counters_;
+    std::map<std::string, Throttle> throttles_;
+};
+
+#endif  // _LIBWEBSTREAMER_FRAMEWORK_BUS_MONITOR_H_
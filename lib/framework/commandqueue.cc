@@ -0,0 +1,108 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "commandqueue.h"
+
+GSourceFuncs CommandQueue::source_funcs_ = {
+    CommandQueue::prepare,
+    CommandQueue::check,
+    CommandQueue::dispatch,
+    NULL,
+};
+
+CommandQueue::CommandQueue(GMainContext *context,
+                           DispatchFunc func,
+                           gpointer user_data,
+                           guint budget)
+    : depth_(0)
+    , stalled_(false)
+    , context_(context)
+    , source_(NULL)
+    , func_(func)
+    , user_data_(user_data)
+    , budget_(budget ? budget : 1)
+{
+    source_ = g_source_new(&source_funcs_, sizeof(Source));
+    reinterpret_cast<Source *>(source_)->queue = this;
+    g_source_set_priority(source_, G_PRIORITY_DEFAULT);
+    g_source_set_name(source_, "webstreamer command queue");
+    g_source_attach(source_, context_);
+}
+
+CommandQueue::~CommandQueue()
+{
+    g_source_destroy(source_);
+    g_source_unref(source_);
+    source_ = NULL;
+}
+
+void CommandQueue::Push(MpscNode *node)
+{
+    queue_.Push(node);
+    if (depth_.fetch_add(1, std::memory_order_acq_rel) == 0) {
+        // the loop may be sleeping in poll
+        g_main_context_wakeup(context_);
+    }
+}
+
+void CommandQueue::Drain(DispatchFunc func, gpointer user_data)
+{
+    while (depth_.load(std::memory_order_acquire) > 0) {
+        MpscNode *node = queue_.Pop();
+        if (!node) {
+            g_thread_yield();  // a producer is still linking
+            continue;
+        }
+        depth_.fetch_sub(1, std::memory_order_acq_rel);
+        func(node, user_data);
+    }
+}
+
+gboolean CommandQueue::prepare(GSource *source, gint *timeout)
+{
+    CommandQueue *self = reinterpret_cast<Source *>(source)->queue;
+    *timeout = -1;
+    if (self->stalled_) {
+        // the node being linked does not wake the loop up again,
+        // poll for it shortly instead of reporting ready right away
+        self->stalled_ = false;
+        *timeout = 1;
+        return FALSE;
+    }
+    return self->depth_.load(std::memory_order_acquire) > 0;
+}
+
+gboolean CommandQueue::check(GSource *source)
+{
+    CommandQueue *self = reinterpret_cast<Source *>(source)->queue;
+    return self->depth_.load(std::memory_order_acquire) > 0;
+}
+
+gboolean CommandQueue::dispatch(GSource *source, GSourceFunc callback, gpointer user_data)
+{
+    CommandQueue *self = reinterpret_cast<Source *>(source)->queue;
+    for (guint i = 0; i < self->budget_; i++) {
+        MpscNode *node = self->queue_.Pop();
+        if (!node) {
+            // empty, or a producer is still linking
+            self->stalled_ = self->depth_.load(std::memory_order_acquire) > 0;
+            break;
+        }
+        self->depth_.fetch_sub(1, std::memory_order_acq_rel);
+        self->func_(node, self->user_data_);
+    }
+    return G_SOURCE_CONTINUE;
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBWEBSTREAMER_FRAMEWORK_COMMAND_QUEUE_H_
+#define _LIBWEBSTREAMER_FRAMEWORK_COMMAND_QUEUE_H_
+
+#include <glib.h>
+#include <atomic>
+#include <utils/mpscqueue.h>
+
+/*
+ * A GSource fed by a lock-free MPSC queue.
+ * Producers push nodes from any thread, the owner main loop dispatches
+ * them in push order, at most `budget` nodes per iteration so other
+ * sources of the context are not starved. The context is only woken
+ * up when the queue turns non-empty.
+ */
+class CommandQueue
+{
+ public:
+    typedef void (*DispatchFunc)(MpscNode *node, gpointer user_data);
+
+    CommandQueue(GMainContext *context,
+                 DispatchFunc func,
+                 gpointer user_data,
+                 guint budget = 64);
+    ~CommandQueue();
+
+    void Push(MpscNode *node);
+
+    // hands every queued node to `func`, once the owner loop stopped
+    // iterating the context (the caller becomes the consumer)
+    void Drain(DispatchFunc func, gpointer user_data);
+
+    // number of nodes pushed but not dispatched yet
+    gint depth() const { return depth_.load(std::memory_order_relaxed); }
+
+ private:
+    CommandQueue(const CommandQueue &);
+    CommandQueue &operator=(const CommandQueue &);
+
+    struct Source
+    {
+        GSource base;
+        CommandQueue *queue;
+    };
+    static gboolean prepare(GSource *source, gint *timeout);
+    static gboolean check(GSource *source);
+    static gboolean dispatch(GSource *source, GSourceFunc callback, gpointer user_data);
+    static GSourceFuncs source_funcs_;
+
+    MpscQueue queue_;
+    std::atomic<gint> depth_;
+    bool stalled_;  // Pop() missed a node being linked, loop thread only
+    GMainContext *context_;
+    GSource *source_;
+    DispatchFunc func_;
+    gpointer user_data_;
+    guint budget_;
+};
+
+#endif  // _LIBWEBSTREAMER_FRAMEWORK_COMMAND_QUEUE_H_
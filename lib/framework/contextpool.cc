@@ -0,0 +1,174 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "contextpool.h"
+
+GST_DEBUG_CATEGORY_STATIC(my_category);
+#define GST_CAT_DEFAULT my_category
+
+ContextPool::ContextPool()
+    : drop_(NULL)
+    , user_data_(NULL)
+    , open_(false)
+    , producers_(0)
+{
+}
+
+ContextPool::~ContextPool()
+{
+    Shutdown();
+}
+
+bool ContextPool::Startup(GMainContext *primary,
+                          guint size,
+                          CommandQueue::DispatchFunc func,
+                          CommandQueue::DispatchFunc drop,
+                          gpointer user_data)
+{
+    GST_DEBUG_CATEGORY_INIT(my_category, "webstreamer", 2, "libWebStreamer");
+    g_return_val_if_fail(primary != NULL, false);
+    g_return_val_if_fail(workers_.empty(), false);
+
+    drop_ = drop;
+    user_data_ = user_data;
+    if (size == 0) {
+        size = 1;
+    }
+
+    // slot 0 is run by the owner of the primary context
+    Worker main_worker;
+    main_worker.context = g_main_context_ref(primary);
+    main_worker.loop = NULL;
+    main_worker.thread = NULL;
+    main_worker.queue = new CommandQueue(main_worker.context, func, user_data);
+    workers_.push_back(main_worker);
+
+    for (guint i = 1; i < size; i++) {
+        Worker worker;
+        worker.context = g_main_context_new();
+        worker.loop = g_main_loop_new(worker.context, FALSE);
+        worker.queue = new CommandQueue(worker.context, func, user_data);
+        gchar *name = g_strdup_printf("webstreamer_worker_%u", i);
+        worker.thread = g_thread_new(name, (GThreadFunc)WorkerEntry, worker.loop);
+        g_free(name);
+        workers_.push_back(worker);
+    }
+    open_ = true;
+    GST_INFO("[context-pool] started with %u main loop threads.", size);
+    return true;
+}
+
+void ContextPool::Shutdown()
+{
+    // no producer touches a queue past this point, a push takes no time
+    open_ = false;
+    while (producers_.load() > 0) {
+        g_thread_yield();
+    }
+    for (auto &worker : workers_) {
+        if (worker.thread) {
+            // quit from inside the loop, g_main_loop_quit before
+            // g_main_loop_run would be lost.
+            GSource *source = g_idle_source_new();
+            g_source_set_callback(source, WorkerQuit, worker.loop, NULL);
+            g_source_attach(source, worker.context);
+            g_source_unref(source);
+
+            g_thread_join(worker.thread);
+            worker.thread = NULL;
+        }
+        // the loop is gone (slot 0 is shut down after its loop quit),
+        // queued commands are settled here rather than lost
+        if (drop_) {
+            worker.queue->Drain(drop_, user_data_);
+        }
+        delete worker.queue;
+        worker.queue = NULL;
+        if (worker.loop) {
+            g_main_loop_unref(worker.loop);
+            worker.loop = NULL;
+        }
+        g_main_context_unref(worker.context);
+        worker.context = NULL;
+    }
+    workers_.clear();
+}
+
+bool ContextPool::Enter()
+{
+    producers_++;
+    if (!open_.load()) {
+        producers_--;
+        return false;
+    }
+    return true;
+}
+
+void ContextPool::Leave()
+{
+    producers_--;
+}
+
+GMainContext *ContextPool::context(guint index)
+{
+    if (workers_.empty()) {
+        return NULL;
+    }
+    return workers_[index % workers_.size()].context;
+}
+
+GMainContext *ContextPool::context(const std::string &key)
+{
+    return context(index(key));
+}
+
+CommandQueue *ContextPool::queue(guint index)
+{
+    if (workers_.empty()) {
+        return NULL;
+    }
+    return workers_[index % workers_.size()].queue;
+}
+
+CommandQueue *ContextPool::queue(const std::string &key)
+{
+    return queue(index(key));
+}
+
+guint ContextPool::index(const std::string &key) const
+{
+    if (workers_.size() <= 1) {
+        return 0;
+    }
+    return (guint)g_str_hash(key.c_str());
+}
+
+gpointer ContextPool::WorkerEntry(gpointer data)
+{
+    GMainLoop *loop = static_cast<GMainLoop *>(data);
+    GMainContext *context = g_main_loop_get_context(loop);
+
+    g_main_context_push_thread_default(context);
+    g_main_loop_run(loop);
+    g_main_context_pop_thread_default(context);
+    return NULL;
+}
+
+gboolean ContextPool::WorkerQuit(gpointer data)
+{
+    g_main_loop_quit(static_cast<GMainLoop *>(data));
+    return G_SOURCE_REMOVE;
+}
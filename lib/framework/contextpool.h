@@ -0,0 +1,78 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBWEBSTREAMER_FRAMEWORK_CONTEXT_POOL_H_
+#define _LIBWEBSTREAMER_FRAMEWORK_CONTEXT_POOL_H_
+
+#include <gst/gst.h>
+#include <framework/commandqueue.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+/*
+ * A fixed set of GMainContext, each one iterated by its own thread.
+ * Slot 0 is always the webstreamer main context (run by the
+ * webstreamer_main_loop thread), the other slots are owned by the pool.
+ * Apps are pinned to one slot by hashing their uname, every slot
+ * has a CommandQueue through which calls reach that slot.
+ * Commands still queued at Shutdown are handed to `drop`.
+ * Producers push between Enter() and Leave(): Shutdown closes that gate
+ * and waits for the producers inside before the queues go away, Enter()
+ * fails from then on.
+ */
+class ContextPool
+{
+ public:
+    ContextPool();
+    ~ContextPool();
+
+    bool Startup(GMainContext *primary,
+                 guint size,
+                 CommandQueue::DispatchFunc func,
+                 CommandQueue::DispatchFunc drop,
+                 gpointer user_data);
+    void Shutdown();
+
+    bool Enter();
+    void Leave();
+
+    guint size() const { return (guint)workers_.size(); }
+    GMainContext *context(guint index);
+    GMainContext *context(const std::string &key);
+    CommandQueue *queue(guint index);
+    CommandQueue *queue(const std::string &key);
+
+ private:
+    struct Worker
+    {
+        GMainContext *context;
+        GMainLoop *loop;
+        GThread *thread;
+        CommandQueue *queue;
+    };
+    guint index(const std::string &key) const;
+    static gpointer WorkerEntry(gpointer data);
+    static gboolean WorkerQuit(gpointer data);
+
+    std::vector<Worker> workers_;
+    CommandQueue::DispatchFunc drop_;
+    gpointer user_data_;
+    std::atomic<bool> open_;
+    std::atomic<int> producers_;
+};
+
+#endif  // _LIBWEBSTREAMER_FRAMEWORK_CONTEXT_POOL_H_
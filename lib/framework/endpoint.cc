@@ -16,13 +16,27 @@
 
 
 #include "endpoint.h"
+#include <utils/metrics.h>
 
 IEndpoint::IEndpoint(IApp* app, const std::string& name)
     : app_(app)
     , name_(name)
+    , id_(0)
+    , counted_(false)
 {
 }
 
 IEndpoint::~IEndpoint()
 {
+    if (counted_) {
+        Metrics::AddAudience(protocol_, -1);
+    }
+}
+
+void IEndpoint::count_as_audience()
+{
+    if (!counted_) {
+        counted_ = true;
+        Metrics::AddAudience(protocol_, 1);
+    }
 }
@@ -19,6 +19,7 @@
 #define _LIBWEBSTREAMER_FRAMEWORK_ENDPOINT_
 
 #include "promise.h"
+#include <functional>
 
 class IApp;
 class IEndpoint
@@ -29,14 +30,30 @@ class IEndpoint
 
     IApp *app() { return app_; }
     const std::string &name() { return name_; }
+    guint32 id() const { return id_; }
+    guint32 &id() { return id_; }
     virtual bool initialize(Promise *promise) { return true; }
     virtual void terminate() {}
+    // brings the endpoint pipeline up without blocking the app loop,
+    // false when there is nothing to wait for (done is not called then)
+    virtual bool startup(const std::function<void(const std::string &error)> &done) { return false; }
+    // elements the app links its tees to, for performers only
+    virtual GstElement *video_output() { return NULL; }
+    virtual GstElement *audio_output() { return NULL; }
+    // ask the source for a keyframe as soon as possible
+    virtual void request_keyframe() {}
+    // transport counters of the endpoint (rtp, webrtc), for app stats
+    virtual nlohmann::json stats() { return nlohmann::json::object(); }
     const std::string &protocol() const { return protocol_; }
     std::string &protocol() { return protocol_; }
+    // listed in the audiences gauge of Metrics (by protocol) until deleted
+    void count_as_audience();
 
  private:
     IApp *app_;
     std::string name_;
     std::string protocol_;
+    guint32 id_;
+    bool counted_;
 };
 #endif
@@ -0,0 +1,206 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "metricsserver.h"
+#include <gst/gst.h>
+#include <utils/metrics.h>
+
+GST_DEBUG_CATEGORY_STATIC(my_category);
+#define GST_CAT_DEFAULT my_category
+
+#define METRICS_SOCKET_TIMEOUT 2  // seconds
+#define METRICS_REQUEST_MAX 8192
+
+MetricsServer::MetricsServer()
+    : context_(NULL)
+    , loop_(NULL)
+    , thread_(NULL)
+    , started_(NULL)
+    , port_(0)
+{
+}
+
+MetricsServer::~MetricsServer()
+{
+    Stop();
+}
+
+std::string MetricsServer::Start(const nlohmann::json &option, const Collector &collector)
+{
+    GST_DEBUG_CATEGORY_INIT(my_category, "webstreamer", 2, "libWebStreamer");
+    g_return_val_if_fail(thread_ == NULL, "metrics server already started.");
+
+    if (!option.is_object() || option.find("port") == option.end() || !option["port"].is_number()) {
+        return "metrics: no port.";
+    }
+    int port = option["port"];
+    if (port < 0 || port > 65535) {
+        return "metrics: invalid port.";
+    }
+    port_ = (guint16)port;
+    // scraped from the same host unless told otherwise
+    address_ = "127.0.0.1";
+    if (option.find("address") != option.end() && option["address"].is_string()) {
+        address_ = option["address"].get<std::string>();
+    }
+    collector_ = collector;
+
+    context_ = g_main_context_new();
+    loop_ = g_main_loop_new(context_, FALSE);
+    started_ = g_async_queue_new();
+    thread_ = g_thread_new("webstreamer_metrics", (GThreadFunc)Entry, this);
+
+    gchar *error = (gchar *)g_async_queue_pop(started_);
+    std::string result(error);
+    g_free(error);
+    if (!result.empty()) {
+        Stop();
+        return "metrics: " + result;
+    }
+    GST_INFO("[metrics] serving on %s:%u", address_.c_str(), port_);
+    return result;
+}
+
+void MetricsServer::Stop()
+{
+    if (!thread_) {
+        return;
+    }
+    // dispatched by the loop itself, never quits it before it runs
+    GSource *source = g_idle_source_new();
+    g_source_set_callback(source, Quit, loop_, NULL);
+    g_source_attach(source, context_);
+    g_source_unref(source);
+    g_thread_join(thread_);
+    thread_ = NULL;
+    g_main_loop_unref(loop_);
+    loop_ = NULL;
+    g_main_context_unref(context_);
+    context_ = NULL;
+    g_async_queue_unref(started_);
+    started_ = NULL;
+    collector_ = nullptr;
+}
+
+gboolean MetricsServer::Quit(gpointer data)
+{
+    g_main_loop_quit(static_cast<GMainLoop *>(data));
+    return G_SOURCE_REMOVE;
+}
+
+gpointer MetricsServer::Entry(gpointer data)
+{
+    MetricsServer *self = static_cast<MetricsServer *>(data);
+    // the accept source of the service goes to the thread default context
+    g_main_context_push_thread_default(self->context_);
+
+    GSocketService *service = g_socket_service_new();
+    GInetAddress *inet = g_inet_address_new_from_string(self->address_.c_str());
+    GError *error = NULL;
+    bool listening = false;
+    if (!inet) {
+        g_async_queue_push(self->started_, g_strdup_printf("invalid address %s.", self->address_.c_str()));
+    } else {
+        GSocketAddress *address = g_inet_socket_address_new(inet, self->port_);
+        GSocketAddress *effective = NULL;
+        if (g_socket_listener_add_address(G_SOCKET_LISTENER(service), address,
+                                          G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_TCP,
+                                          NULL, &effective, &error)) {
+            // port 0 picks a free one
+            self->port_ = g_inet_socket_address_get_port(G_INET_SOCKET_ADDRESS(effective));
+            g_object_unref(effective);
+            g_signal_connect(service, "incoming", G_CALLBACK(on_incoming), self);
+            g_socket_service_start(service);
+            listening = true;
+            g_async_queue_push(self->started_, g_strdup(""));
+        } else {
+            g_async_queue_push(self->started_, g_strdup(error->message));
+            g_clear_error(&error);
+        }
+        g_object_unref(address);
+        g_object_unref(inet);
+    }
+
+    if (listening) {
+        g_main_loop_run(self->loop_);
+        g_socket_service_stop(service);
+    }
+    g_socket_listener_close(G_SOCKET_LISTENER(service));
+    g_object_unref(service);
+    // sources left behind by the closed connections
+    while (g_main_context_iteration(self->context_, FALSE)) {
+    }
+    g_main_context_pop_thread_default(self->context_);
+    return NULL;
+}
+
+gboolean MetricsServer::on_incoming(GSocketService *service,
+                                    GSocketConnection *connection,
+                                    GObject *source,
+                                    gpointer user_data)
+{
+    static_cast<MetricsServer *>(user_data)->Serve(connection);
+    return TRUE;
+}
+
+void MetricsServer::Serve(GSocketConnection *connection)
+{
+    GSocket *socket = g_socket_connection_get_socket(connection);
+    g_socket_set_timeout(socket, METRICS_SOCKET_TIMEOUT);
+    GInputStream *input = g_io_stream_get_input_stream(G_IO_STREAM(connection));
+    GOutputStream *output = g_io_stream_get_output_stream(G_IO_STREAM(connection));
+
+    // only the request line matters, the headers are read to be polite
+    std::string request;
+    gchar buf[1024];
+    while (request.size() < METRICS_REQUEST_MAX &&
+           request.find("\r\n\r\n") == std::string::npos &&
+           request.find("\n\n") == std::string::npos) {
+        gssize n = g_input_stream_read(input, buf, sizeof(buf), NULL, NULL);
+        if (n <= 0) {
+            break;
+        }
+        request.append(buf, n);
+    }
+
+    const char *status = "404 Not Found";
+    std::string body;
+    size_t eol = request.find_first_of("\r\n");
+    std::string line = request.substr(0, eol);
+    if (line.compare(0, 4, "GET ") != 0) {
+        status = "405 Method Not Allowed";
+    } else {
+        std::string path = line.substr(4, line.find(' ', 4) - 4);
+        if (path == "/metrics" || path.compare(0, 9, "/metrics?") == 0) {
+            status = "200 OK";
+            Metrics::Render(&body);
+            if (collector_) {
+                collector_(&body);
+            }
+        }
+    }
+
+    std::string response = std::string("HTTP/1.1 ") + status + "\r\n" +
+                           "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n" +
+                           "Content-Length: " + std::to_string(body.size()) + "\r\n" +
+                           "Connection: close\r\n\r\n" + body;
+    GError *error = NULL;
+    if (!g_output_stream_write_all(output, response.data(), response.size(), NULL, NULL, &error)) {
+        GST_DEBUG("[metrics] write failed: %s", error->message);
+        g_clear_error(&error);
+    }
+    g_io_stream_close(G_IO_STREAM(connection), NULL, NULL);
+}
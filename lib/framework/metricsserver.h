@@ -0,0 +1,69 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBWEBSTREAMER_FRAMEWORK_METRICS_SERVER_H_
+#define _LIBWEBSTREAMER_FRAMEWORK_METRICS_SERVER_H_
+
+#include <gio/gio.h>
+#include <nlohmann/json.hpp>
+#include <functional>
+#include <string>
+
+/*
+ * Prometheus scrape endpoint, init option
+ *   "metrics": {"port": 9100, "address": "127.0.0.1"}
+ * A GSocketService iterated by a thread of its own, GET /metrics
+ * renders Metrics plus the collector of the owner. A scrape only reads
+ * atomics, it never goes through the command queues or the app loops.
+ * Connections are served one at a time with a short socket timeout.
+ */
+class MetricsServer
+{
+ public:
+    typedef std::function<void(std::string *out)> Collector;
+
+    MetricsServer();
+    ~MetricsServer();
+
+    // empty on success, the error otherwise
+    std::string Start(const nlohmann::json &option, const Collector &collector);
+    void Stop();
+
+    bool running() const { return thread_ != NULL; }
+    guint16 port() const { return port_; }
+
+ private:
+    MetricsServer(const MetricsServer &);
+    MetricsServer &operator=(const MetricsServer &);
+
+    static gpointer Entry(gpointer data);
+    static gboolean Quit(gpointer data);
+    static gboolean on_incoming(GSocketService *service,
+                                GSocketConnection *connection,
+                                GObject *source,
+                                gpointer user_data);
+    void Serve(GSocketConnection *connection);
+
+    Collector collector_;
+    std::string address_;
+    GMainContext *context_;
+    GMainLoop *loop_;
+    GThread *thread_;
+    GAsyncQueue *started_;  // the listen error, or "" once listening
+    guint16 port_;
+};
+
+#endif  // _LIBWEBSTREAMER_FRAMEWORK_METRICS_SERVER_H_
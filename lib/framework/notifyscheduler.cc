@@ -0,0 +1,240 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "notifyscheduler.h"
+
+GST_DEBUG_CATEGORY_STATIC(my_category);
+#define GST_CAT_DEFAULT my_category
+
+using json = nlohmann::json;
+
+NotifyScheduler::NotifyScheduler()
+    : context_(NULL)
+    , timer_(NULL)
+    , interval_(100)
+    , max_batch_(64)
+    , pending_(0)
+    , urgent_(false)
+    , enabled_(false)
+{
+}
+
+NotifyScheduler::~NotifyScheduler()
+{
+    if (timer_) {
+        g_source_destroy(timer_);
+        g_source_unref(timer_);
+        timer_ = NULL;
+    }
+}
+
+void NotifyScheduler::Configure(const json &option,
+                                const std::string &origin,
+                                GMainContext *context,
+                                const Emitter &emitter)
+{
+    GST_DEBUG_CATEGORY_INIT(my_category, "webstreamer", 2, "libWebStreamer");
+    std::lock_guard<std::mutex> lock(mutex_);
+    origin_ = origin;
+    context_ = context;
+    emitter_ = emitter;
+    if (!option.is_object()) {
+        return;
+    }
+
+    json::const_iterator it = option.find("interval");
+    if (it != option.cend() && it->is_number_unsigned()) {
+        interval_ = MAX(1u, it->get<guint>());
+    }
+    it = option.find("max_batch");
+    if (it != option.cend() && it->is_number_unsigned()) {
+        max_batch_ = MAX(1u, it->get<size_t>());
+    }
+    it = option.find("topics");
+    if (it == option.cend() || !it->is_object()) {
+        return;
+    }
+    for (json::const_iterator t = it->cbegin(); t != it->cend(); ++t) {
+        Topic topic;
+        topic.mode = BATCH;
+        if (t->is_object()) {
+            json::const_iterator mode = t->find("mode");
+            if (mode != t->cend() && mode->is_string() && *mode == "latest") {
+                topic.mode = LATEST;
+            }
+            json::const_iterator key = t->find("key");
+            if (key != t->cend() && key->is_string()) {
+                topic.key = key->get<std::string>();
+            }
+        }
+        topics_[t.key()] = topic;
+    }
+    enabled_ = !topics_.empty();
+    GST_INFO("[notify] %s coalesces %u topics every %u ms.",
+             origin_.c_str(), (guint)topics_.size(), interval_);
+}
+
+void NotifyScheduler::Stop()
+{
+    std::vector<std::pair<std::string, Topic>> pending;
+    {
+        // one critical section, a Schedule() can't slip in between
+        std::lock_guard<std::mutex> lock(mutex_);
+        enabled_ = false;
+        Take(&pending);
+        if (timer_) {
+            g_source_destroy(timer_);
+            g_source_unref(timer_);
+            timer_ = NULL;
+        }
+    }
+    Emit(pending);
+}
+
+bool NotifyScheduler::Schedule(const json &data, const json &meta)
+{
+    if (!enabled_) {
+        return false;
+    }
+    json::const_iterator topic_name = meta.find("topic");
+    if (topic_name == meta.cend() || !topic_name->is_string()) {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::map<std::string, Topic>::iterator it = topics_.find(*topic_name);
+        if (!enabled_ || it == topics_.end()) {
+            return false;
+        }
+        Topic &topic = it->second;
+
+        if (topic.mode == LATEST) {
+            std::string key;
+            const json *value = NULL;
+            json::const_iterator k = meta.find(topic.key);
+            if (k != meta.cend()) {
+                value = &*k;
+            } else if ((k = data.find(topic.key)) != data.cend()) {
+                value = &*k;
+            }
+            if (value) {
+                key = value->is_string() ? value->get<std::string>() : value->dump();
+            }
+            auto latest = topic.latest.find(key);
+            if (latest != topic.latest.end()) {
+                // superseded, replaced in place to keep the order
+                latest->second->first = data;
+                latest->second->second = meta;
+                return true;
+            }
+            topic.events.push_back(std::make_pair(data, meta));
+            topic.latest[key] = --topic.events.end();
+        } else {
+            topic.events.push_back(std::make_pair(data, meta));
+        }
+
+        // always emitted from the app context, so batches keep their order
+        if (++pending_ >= max_batch_ && !urgent_) {
+            Arm(0);
+            urgent_ = true;
+        } else if (!timer_) {
+            Arm(interval_);
+        }
+    }
+    return true;
+}
+
+void NotifyScheduler::Arm(guint interval)
+{
+    if (!context_) {
+        return;
+    }
+    if (timer_) {
+        g_source_destroy(timer_);
+        g_source_unref(timer_);
+    }
+    timer_ = g_timeout_source_new(interval);
+    g_source_set_callback(timer_, NotifyScheduler::OnTimeout, this, NULL);
+    g_source_attach(timer_, context_);
+}
+
+void NotifyScheduler::Take(std::vector<std::pair<std::string, Topic>> *pending)
+{
+    for (auto &it : topics_) {
+        Topic &topic = it.second;
+        if (topic.events.empty()) {
+            continue;
+        }
+        pending->push_back(std::make_pair(it.first, Topic()));
+        Topic &taken = pending->back().second;
+        taken.mode = topic.mode;
+        taken.events.swap(topic.events);
+        topic.latest.clear();
+    }
+    pending_ = 0;
+    urgent_ = false;
+}
+
+void NotifyScheduler::Emit(std::vector<std::pair<std::string, Topic>> &pending)
+{
+    // outside the lock, the host may call back into the plugin
+    for (auto &it : pending) {
+        json data = json::array();
+        for (auto &event : it.second.events) {
+            json item;
+            item["meta"] = std::move(event.second);
+            item["data"] = std::move(event.first);
+            data.push_back(std::move(item));
+        }
+        json meta;
+        meta["topic"] = it.first;
+        meta["origin"] = origin_;
+        meta["batch"] = data.size();
+        emitter_(data, meta);
+    }
+}
+
+void NotifyScheduler::Flush()
+{
+    std::vector<std::pair<std::string, Topic>> pending;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Take(&pending);
+        if (timer_) {
+            g_source_destroy(timer_);
+            g_source_unref(timer_);
+            timer_ = NULL;
+        }
+    }
+    Emit(pending);
+}
+
+gboolean NotifyScheduler::OnTimeout(gpointer user_data)
+{
+    NotifyScheduler *self = static_cast<NotifyScheduler *>(user_data);
+    std::vector<std::pair<std::string, Topic>> pending;
+    {
+        std::lock_guard<std::mutex> lock(self->mutex_);
+        self->Take(&pending);
+        if (self->timer_ == g_main_current_source()) {
+            g_source_unref(self->timer_);
+            self->timer_ = NULL;
+        }
+    }
+    self->Emit(pending);
+    return G_SOURCE_REMOVE;
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBWEBSTREAMER_FRAMEWORK_NOTIFY_SCHEDULER_H_
+#define _LIBWEBSTREAMER_FRAMEWORK_NOTIFY_SCHEDULER_H_
+
+#include <gst/gst.h>
+#include <atomic>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <nlohmann/json.hpp>
+
+/*
+ * Per app notify coalescing.
+ * Topics listed in the option are queued and emitted as one notify
+ * every `interval` ms, or as soon as `max_batch` events are pending,
+ * always from the app context:
+ *
+ *   "notify": {
+ *       "interval": 100, "max_batch": 64,
+ *       "topics": {
+ *           "spectrum": { "mode": "latest", "key": "name" },
+ *           "webrtc":   { "mode": "batch" }
+ *       }
+ *   }
+ *
+ * "batch" keeps every event, "latest" keeps only the last event per
+ * `key` (looked up in meta, then in data). The coalesced notify has
+ * meta {"topic", "origin", "batch": n} and data [{"meta", "data"}, ...]
+ * in arrival order. Other topics are passed through untouched.
+ */
+class NotifyScheduler
+{
+ public:
+    typedef std::function<void(const nlohmann::json &data,
+                               const nlohmann::json &meta)>
+        Emitter;
+
+    NotifyScheduler();
+    ~NotifyScheduler();
+
+    void Configure(const nlohmann::json &option,
+                   const std::string &origin,
+                   GMainContext *context,
+                   const Emitter &emitter);
+    // flush what is pending and pass everything through afterwards
+    void Stop();
+
+    // false if the topic is not coalesced, the caller emits it
+    bool Schedule(const nlohmann::json &data, const nlohmann::json &meta);
+    // must be called on the app context
+    void Flush();
+
+ private:
+    enum Mode
+    {
+        BATCH,
+        LATEST
+    };
+    struct Topic
+    {
+        Mode mode;
+        std::string key;
+        std::list<std::pair<nlohmann::json, nlohmann::json>> events;
+        std::map<std::string, std::list<std::pair<nlohmann::json, nlohmann::json>>::iterator> latest;
+    };
+    static gboolean OnTimeout(gpointer user_data);
+    void Arm(guint interval);
+    void Take(std::vector<std::pair<std::string, Topic>> *pending);
+    void Emit(std::vector<std::pair<std::string, Topic>> &pending);
+
+    std::mutex mutex_;
+    std::map<std::string, Topic> topics_;
+    std::string origin_;
+    GMainContext *context_;
+    GSource *timer_;
+    Emitter emitter_;
+    guint interval_;
+    size_t max_batch_;
+    size_t pending_;
+    bool urgent_;
+    std::atomic<bool> enabled_;
+};
+
+#endif  // _LIBWEBSTREAMER_FRAMEWORK_NOTIFY_SCHEDULER_H_
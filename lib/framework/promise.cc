@@ -13,3 +13,67 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+
+#include "promise.h"
+#include <utils/typedef.h>
+
+void Promise::ParseAction()
+{
+    nlohmann::json::const_iterator it = jmeta_.find("action");
+    if (it != jmeta_.cend() && it->is_string()) {
+        action_ = get_action_type(it->get<std::string>());
+    }
+}
+
+std::string Promise::action_name() const
+{
+    if (!binary_) {
+        nlohmann::json::const_iterator it = jmeta_.find("action");
+        if (it != jmeta_.cend() && it->is_string()) {
+            return it->get<std::string>();
+        }
+    }
+    return "#" + std::to_string(action_);
+}
+
+bool Promise::FindTLV(guint16 tag, const char** value, guint32* length) const
+{
+    size_t offset = 0;
+    while (offset + sizeof(plugin_tlv_t) <= payload_.size()) {
+        plugin_tlv_t tlv;
+        memcpy(&tlv, payload_.data() + offset, sizeof(plugin_tlv_t));
+        offset += sizeof(plugin_tlv_t);
+        if (tlv.length > payload_.size() - offset) {
+            return false;  // truncated
+        }
+        if (tlv.tag == tag) {
+            *value = payload_.data() + offset;
+            *length = tlv.length;
+            return true;
+        }
+        offset += tlv.length;
+    }
+    return false;
+}
+
+bool Promise::GetString(guint16 tag, std::string* value) const
+{
+    const char* v = NULL;
+    guint32 length = 0;
+    if (!FindTLV(tag, &v, &length)) {
+        return false;
+    }
+    value->assign(v, length);
+    return true;
+}
+
+bool Promise::GetUint(guint16 tag, guint32* value) const
+{
+    const char* v = NULL;
+    guint32 length = 0;
+    if (!FindTLV(tag, &v, &length) || length != sizeof(guint32)) {
+        return false;
+    }
+    memcpy(value, v, sizeof(guint32));
+    return true;
+}
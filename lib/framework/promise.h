@@ -17,6 +17,7 @@
 #ifndef _LIBWEBSTREAMER_PROMISE_H_
 #define _LIBWEBSTREAMER_PROMISE_H_
 
+#include <atomic>
 #include <vector>
 #include <list>
 #include <map>
@@ -24,10 +25,15 @@
 #include <gst/gst.h>
 #include <plugin_interface.h>
 #include <nlohmann/json.hpp>
+#include <utils/mpscqueue.h>
+#include <utils/eventbuffer.h>
+#include <utils/metrics.h>
+#include <utils/trace.h>
 
 class WebStreamer;
 class IApp;
-class Promise
+// queued to the pinned main loop through its CommandQueue
+class Promise : public MpscNode
 {
  public:
     Promise(void* iface, const void* context, plugin_callback_fn callback,
@@ -38,38 +44,71 @@ class Promise
         , context_(context)
         , jdata_(jdata)
         , jmeta_(jmeta)
+        , action_(PLUGIN_ACTION_UNKNOWN)
+        , binary_(false)
+        , app_id_(0)
+        , endpoint_id_(0)
         , responsed_(false)
+        , deferred_(false)
         , webstreamer_(nullptr)
         , app_(nullptr)
         , callback_(callback)
     {
+        stamps_.id = Trace::NextId();
+        stamps_.created = g_get_monotonic_time();
+        ParseAction();
+    }
+
+    // binary envelope, the payload (tlv sequence) is copied
+    Promise(void* iface, const void* context, plugin_callback_fn callback,
+        const plugin_call_header_t& header,
+        const void* payload, size_t size)
+        : user_data(NULL)
+        , iface_((plugin_interface_t *)iface)
+        , context_(context)
+        , action_((plugin_action_t)header.action)
+        , binary_(true)
+        , app_id_(header.app)
+        , endpoint_id_(header.endpoint)
+        , responsed_(false)
+        , deferred_(false)
+        , webstreamer_(nullptr)
+        , app_(nullptr)
+        , callback_(callback)
+    {
+        stamps_.id = Trace::NextId();
+        stamps_.created = g_get_monotonic_time();
+        if (payload && size) {
+            payload_.assign((const char*)payload, size);
+        }
     }
 
     void resolve(const nlohmann::json& param) {
-        if (responsed_) {
+        // settled from the app loop, state changes or batches: once only
+        if (responsed_.exchange(true)) {
             return;  // response repated
         }
-
-        const std::string& s = param.dump();
+        Settled();
         plugin_buffer_t data;
-        plugin_buffer_string_set(&data, s.c_str());
-        callback_(iface_, context_, 1, &data);
+        EventBuffer::Serialize(param)->Attach(&data);
+        callback_(iface_, context_, 0, &data);
     }
 
     void resolve() {
-        if (responsed_) {
+        if (responsed_.exchange(true)) {
             return;  // response repated
         }
-
+        Settled();
         callback_(iface_, context_, 0, NULL);
     }
 
     void reject(const std::string& message) {
-        if (responsed_) {
+        if (responsed_.exchange(true)) {
             return;  // response repated
         }
+        Settled();
         plugin_buffer_t data;
-        plugin_buffer_string_set(&data, message.c_str());
+        EventBuffer::FromString(message.data(), message.size())->Attach(&data);
         callback_(iface_, context_, 1, &data);
     }
 
@@ -83,6 +122,25 @@ class Promise
         return this->jmeta_;
     }
 
+    plugin_action_t action() const { return action_; }
+    std::string action_name() const;
+    bool binary() const { return binary_; }
+    guint32 app_id() const { return app_id_; }
+    guint32 endpoint_id() const { return endpoint_id_; }
+
+    // tlv accessors of the binary envelope
+    bool GetString(guint16 tag, std::string* value) const;
+    bool GetUint(guint16 tag, guint32* value) const;
+
+    // the app settles the promise later (from any thread) and deletes
+    // it then, otherwise it is deleted once On() returns
+    void Defer() { deferred_ = true; }
+    bool deferred() const { return deferred_; }
+
+    // the call came in before its json was parsed
+    void SetReceived(gint64 us) { stamps_.received = us; }
+    const Trace::Stamps& stamps() const { return stamps_; }
+
     IApp*        app() { return app_;  }
     WebStreamer* webstreamer() {return webstreamer_;}
     void* user_data;
@@ -96,14 +154,31 @@ class Promise
     friend class WebStreamer;
 
  private:
+    void ParseAction();
+    void Settled()
+    {
+        stamps_.settled = g_get_monotonic_time();
+        Metrics::ObservePromise(stamps_.settled -
+                                (stamps_.received ? stamps_.received : stamps_.created));
+        Trace::Settled(action_, stamps_);
+    }
+    bool FindTLV(guint16 tag, const char** value, guint32* length) const;
+
     plugin_interface_t*       iface_;
     const void*               context_;
     nlohmann::json            jdata_;
     nlohmann::json            jmeta_;
-    bool                      responsed_;
+    std::string               payload_;
+    plugin_action_t           action_;
+    bool                      binary_;
+    guint32                   app_id_;
+    guint32                   endpoint_id_;
+    std::atomic<bool>         responsed_;
+    bool                      deferred_;
     WebStreamer*              webstreamer_;
     IApp*                     app_;
     plugin_callback_fn        callback_;
+    Trace::Stamps             stamps_;
 };
 
 #endif  // _LIBWEBSTREAMER_PROMISE_H_
@@ -65,6 +65,17 @@ bool RTSPServer::Initialize(GstRTSPSessionPool* pool,
 	return true;
 }
 
+void RTSPServer::set_max_threads(guint max_threads)
+{
+	g_return_if_fail(server_ != NULL);
+	if (max_threads <= 1) {
+		return;
+	}
+	GstRTSPThreadPool* pool = gst_rtsp_server_get_thread_pool(server_);
+	gst_rtsp_thread_pool_set_max_threads(pool, (gint)max_threads);
+	g_object_unref(pool);
+}
+
 void RTSPServer::Destroy()
 {
 	if (server_)
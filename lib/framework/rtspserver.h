@@ -38,6 +38,8 @@ class RTSPServer
 	bool Initialize(GstRTSPSessionPool* pool, int port);  // TO BE DEL
 	bool Initialize(GstRTSPSessionPool* pool, GMainContext* context = NULL);
 	void Destroy();
+	// number of threads serving the rtsp clients (<= 1 serves in the main context)
+	void set_max_threads(guint max_threads);
 	Type type() { return type_; }
 	int port() { return port_; }
 	GstRTSPServer* server() { return server_; }
@@ -18,12 +18,15 @@
 
 #include <iostream>
 #include <exception>
+#include <atomic>
+#include <vector>
 
 #include "nlohmann/json.hpp"
 
 #include <gst/gst.h>
 #include "./plugin_interface.h"
 #include "./webstreamer.h"
+#include "utils/eventbuffer.h"
 
 #ifndef __VERSION__
 #define __VERSION__ "0.1.1"
@@ -77,34 +80,40 @@ static void init(const void *iface,
 }
 
 
-static void call(const void *iface,
-                 const void *context,
-                 plugin_buffer_t *data,
-                 plugin_buffer_t *meta,
-                 plugin_callback_fn callback)
+/*
+ * build the promise of a call, on failure returns NULL with
+ * the error message (json string) set.
+ */
+static Promise *make_promise(plugin_interface_t *self,
+                             const void *context,
+                             plugin_buffer_t *data,
+                             plugin_buffer_t *meta,
+                             plugin_callback_fn callback,
+                             const char **error)
 {
-    plugin_interface_t *self = (plugin_interface_t *)iface;
-    if (!_webstreamer) {
-        plugin_buffer_t err;
-        plugin_buffer_string_set(&err, const_error_msg("call", "webstreamer not constructed."));
-        callback(self, context, 1, &err);
-        return;
+    if (!meta || !meta->data || !meta->size) {
+        *error = const_error_msg("call", "action not specified.");
+        return NULL;
     }
+    gint64 received = g_get_monotonic_time();
+    Promise *promise = NULL;
 
-    if (WebStreamer::State::RUNNING != _webstreamer->state()) {
-        plugin_buffer_t err;
-        plugin_buffer_string_set(&err, const_error_msg("call", "trying call method befor running state.."));
-        callback(self, context, 1, &err);
-        return;
+    // binary fast path, dispatched without building a json DOM
+    if (meta->size >= sizeof(plugin_call_header_t)) {
+        plugin_call_header_t header;
+        memcpy(&header, meta->data, sizeof(plugin_call_header_t));
+        if (header.magic == PLUGIN_CALL_MAGIC) {
+            promise = new Promise((void *)self,
+                                  context,
+                                  callback,
+                                  header,
+                                  data ? data->data : NULL,
+                                  data ? data->size : 0);
+            promise->SetReceived(received);
+            return promise;
+        }
     }
 
-    if (!meta || !meta->data || !meta->size) {
-        plugin_buffer_t err;
-        plugin_buffer_string_set(&err,
-                                 const_error_msg("call", "action not specified."));
-        callback(self, context, 1, &err);
-        return;
-    }
     nlohmann::json jmeta;
     try {
         const char *begin = (const char *)meta->data;
@@ -112,11 +121,8 @@ static void call(const void *iface,
 
         jmeta = nlohmann::json::parse(begin, end);
     } catch (std::exception &) {
-        plugin_buffer_t err;
-        plugin_buffer_string_set(&err,
-                                 const_error_msg("call", "invalid meta json string."));
-        callback(self, context, 1, &err);
-        return;
+        *error = const_error_msg("call", "invalid meta json string.");
+        return NULL;
     }
 
     nlohmann::json jdata;
@@ -127,22 +133,185 @@ static void call(const void *iface,
             jdata = nlohmann::json::parse(begin, end);
         }
     } catch (std::exception &) {
+        *error = const_error_msg("call", "invalid data json string.");
+        return NULL;
+    }
+
+    promise = new Promise((void *)self,
+                          context,
+                          callback,
+                          jmeta,
+                          jdata);
+    promise->SetReceived(received);
+    return promise;
+}
+
+static const char *check_running()
+{
+    if (!_webstreamer) {
+        return const_error_msg("call", "webstreamer not constructed.");
+    }
+
+    if (WebStreamer::State::RUNNING != _webstreamer->state()) {
+        return const_error_msg("call", "trying call method befor running state..");
+    }
+    return NULL;
+}
+
+static void call(const void *iface,
+                 const void *context,
+                 plugin_buffer_t *data,
+                 plugin_buffer_t *meta,
+                 plugin_callback_fn callback)
+{
+    plugin_interface_t *self = (plugin_interface_t *)iface;
+    const char *error = check_running();
+    Promise *promise = error ? NULL : make_promise(self, context, data, meta, callback, &error);
+    if (!promise) {
         plugin_buffer_t err;
-        plugin_buffer_string_set(&err,
-                                 const_error_msg("call", "invalid data json string."));
+        plugin_buffer_string_set(&err, error);
         callback(self, context, 1, &err);
         return;
     }
 
-    Promise *promise = new Promise((void *)self,
-                                   context,
-                                   callback,
-                                   jmeta,
-                                   jdata);
     _webstreamer->Call(promise);
     promise = nullptr;
 }
 
+/*
+ * aggregated batch, collects the result of every call and
+ * invokes the host callback once the last one is settled.
+ */
+struct Batch
+{
+    plugin_interface_t *iface;
+    const void *context;
+    plugin_callback_fn callback;
+    std::vector<nlohmann::json> results;
+    std::atomic<size_t> pending;
+    std::atomic<int> failed;
+};
+
+struct BatchItem
+{
+    Batch *batch;
+    size_t index;
+};
+
+static void release_batch(Batch *batch)
+{
+    if (--batch->pending > 0) {
+        return;
+    }
+
+    nlohmann::json results(batch->results);
+    plugin_buffer_t buf;
+    EventBuffer::Serialize(results)->Attach(&buf);
+    batch->callback(batch->iface, batch->context, batch->failed ? 1 : 0, &buf);
+    delete batch;
+}
+
+static void on_batch_item_settled(const void *self,
+                                  const void *context,
+                                  int status,
+                                  plugin_buffer_t *data)
+{
+    BatchItem *item = (BatchItem *)context;
+    Batch *batch = item->batch;
+
+    nlohmann::json result;
+    result["status"] = status;
+    if (data && data->data && data->size) {
+        const char *begin = (const char *)data->data;
+        const char *end = begin + data->size;
+        try {
+            result["data"] = nlohmann::json::parse(begin, end);
+        } catch (std::exception &) {
+            result["data"] = std::string(begin, end);
+        }
+    }
+    if (data && data->release) {
+        data->release(data);
+    }
+    batch->results[item->index] = result;
+    if (status != 0) {
+        batch->failed++;
+    }
+    delete item;
+
+    release_batch(batch);
+}
+
+static void call_batch(const void *iface,
+                       const void *context,
+                       const void *const *contexts,
+                       size_t count,
+                       plugin_buffer_t *data,
+                       plugin_buffer_t *meta,
+                       plugin_callback_fn callback)
+{
+    plugin_interface_t *self = (plugin_interface_t *)iface;
+    const char *error = check_running();
+    if (error) {
+        if (contexts) {
+            for (size_t i = 0; i < count; i++) {
+                plugin_buffer_t err;
+                plugin_buffer_string_set(&err, error);
+                callback(self, contexts[i], 1, &err);
+            }
+        } else {
+            plugin_buffer_t err;
+            plugin_buffer_string_set(&err, error);
+            callback(self, context, 1, &err);
+        }
+        return;
+    }
+
+    Batch *batch = NULL;
+    if (!contexts) {
+        batch = new Batch();
+        batch->iface = self;
+        batch->context = context;
+        batch->callback = callback;
+        batch->results.resize(count);
+        // one extra reference, dropped below once every call is submitted
+        batch->pending = count + 1;
+        batch->failed = 0;
+    }
+
+    std::vector<Promise *> promises;
+    promises.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        const void *ctx = NULL;
+        plugin_callback_fn cb = callback;
+        if (batch) {
+            BatchItem *item = new BatchItem();
+            item->batch = batch;
+            item->index = i;
+            ctx = item;
+            cb = on_batch_item_settled;
+        } else {
+            ctx = contexts[i];
+        }
+
+        error = NULL;
+        Promise *promise = make_promise(self, ctx, data ? &data[i] : NULL, &meta[i], cb, &error);
+        if (!promise) {
+            plugin_buffer_t err;
+            plugin_buffer_string_set(&err, error);
+            cb(self, ctx, 1, &err);
+            continue;
+        }
+        promises.push_back(promise);
+    }
+
+    _webstreamer->CallBatch(promises);
+
+    if (batch) {
+        release_batch(batch);
+    }
+}
+
 static void terminate(const void *iface,
                       const void *context,
                       plugin_callback_fn callback)
@@ -153,4 +322,4 @@ static void terminate(const void *iface,
     _webstreamer->Terminate(promise);
 }
 
-PLUGIN_INTERFACE(__VERSION__, init, call, terminate)
+PLUGIN_INTERFACE_BATCH(__VERSION__, init, call, call_batch, terminate)
@@ -19,6 +19,7 @@
 
 #include <malloc.h>
 #include <string.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -26,7 +27,10 @@ extern "C" {
 
 #define PLUGIN_CALL_OK 0
 
-
+/*
+ * `data` may be borrowed from a pooled, refcounted backing (`context`),
+ * always hand it on with `move` and drop it with `release`, never free it.
+ */
 typedef struct plugin_buffer_t
 {
     void *data;
@@ -98,6 +102,127 @@ inline static void plugin_buffer_string_set(plugin_buffer_t *src,
     src->release = _default_plugin_buffer_release;
 }
 
+/*
+ * Binary call envelope
+ *
+ * A call whose meta buffer starts with PLUGIN_CALL_MAGIC is dispatched
+ * without json parsing. The meta buffer holds a plugin_call_header_t,
+ * the data buffer a sequence of plugin_tlv_t, each immediately followed
+ * by `length` bytes of value. Integers are in host byte order.
+ * App ids are returned by `create` ({"id": n}), endpoint ids by
+ * `add_performer`/`add_audience`. Json meta stays fully supported.
+ */
+#define PLUGIN_CALL_MAGIC 0x42535700u /* "\0WSB", never a json text */
+
+typedef enum plugin_action_t
+{
+    PLUGIN_ACTION_UNKNOWN = 0,
+    PLUGIN_ACTION_CREATE,
+    PLUGIN_ACTION_DESTROY,
+    PLUGIN_ACTION_STARTUP,
+    PLUGIN_ACTION_STOP,
+    PLUGIN_ACTION_ADD_PERFORMER,
+    PLUGIN_ACTION_ADD_AUDIENCE,
+    PLUGIN_ACTION_REMOVE_AUDIENCE,
+    PLUGIN_ACTION_REMOTE_SDP,
+    PLUGIN_ACTION_REMOTE_CANDIDATE,
+    PLUGIN_ACTION_SNAPSHOT,
+    PLUGIN_ACTION_REMOVE_AUDIENCES,
+    PLUGIN_ACTION_STATS,
+    PLUGIN_ACTION_TRACE,
+    // append only, values are part of the ABI
+} plugin_action_t;
+
+typedef struct plugin_call_header_t
+{
+    uint32_t magic;     // PLUGIN_CALL_MAGIC
+    uint16_t action;    // plugin_action_t
+    uint16_t flags;     // reserved, 0
+    uint32_t app;       // interned app id
+    uint32_t endpoint;  // interned endpoint id, 0 if none
+} plugin_call_header_t;
+
+typedef enum plugin_tlv_tag_t
+{
+    PLUGIN_TLV_NAME = 1,     // string
+    PLUGIN_TLV_CANDIDATE,    // string
+    PLUGIN_TLV_MLINE_INDEX,  // uint32_t
+    PLUGIN_TLV_SDP,          // string
+    PLUGIN_TLV_SDP_TYPE,     // string, "offer" | "answer"
+} plugin_tlv_tag_t;
+
+typedef struct plugin_tlv_t
+{
+    uint16_t tag;
+    uint16_t reserved;
+    uint32_t length;
+} plugin_tlv_t;
+
+/*
+ * append a tlv to buf, returns the new offset or 0 if it does not fit.
+ */
+inline static size_t plugin_tlv_put(void *buf, size_t capacity, size_t offset,
+                                    uint16_t tag, const void *value,
+                                    uint32_t length)
+{
+    plugin_tlv_t tlv;
+    if (offset + sizeof(plugin_tlv_t) + length > capacity)
+        return 0;
+
+    tlv.tag = tag;
+    tlv.reserved = 0;
+    tlv.length = length;
+    memcpy((char *)buf + offset, &tlv, sizeof(plugin_tlv_t));
+    offset += sizeof(plugin_tlv_t);
+    if (length) {
+        memcpy((char *)buf + offset, value, length);
+    }
+    return offset + length;
+}
+
+/*
+ * Shared-memory frame ring
+ *
+ * Frames (e.g. ElementWatcher images) are written into a named shared
+ * memory object (POSIX shm_open name, or a Windows file mapping name)
+ * laid out as a plugin_frame_ring_t followed by `slot_count` slots of
+ * `slot_stride` bytes, each a plugin_frame_slot_t and `slot_size`
+ * bytes of payload. The host maps it once, reads a READY slot named by
+ * a notify ({"ring", "slot", "seq"}) in place and then stores
+ * PLUGIN_FRAME_SLOT_FREE to `state` (atomically) to hand it back.
+ * The producer drops frames while the next slot is not free.
+ */
+#define PLUGIN_FRAME_RING_MAGIC 0x52465357u /* "WSFR" */
+
+typedef enum plugin_frame_slot_state_t
+{
+    PLUGIN_FRAME_SLOT_FREE = 0,
+    PLUGIN_FRAME_SLOT_WRITING,
+    PLUGIN_FRAME_SLOT_READY,
+} plugin_frame_slot_state_t;
+
+typedef struct plugin_frame_ring_t
+{
+    uint32_t magic;        // PLUGIN_FRAME_RING_MAGIC
+    uint32_t version;      // 1
+    uint32_t slot_count;
+    uint32_t slot_size;    // payload capacity of a slot
+    uint32_t slot_stride;  // distance between two slot headers
+    uint32_t reserved;
+    uint64_t written;      // frames committed so far
+    uint64_t dropped;      // frames dropped, no free slot
+} plugin_frame_ring_t;
+
+typedef struct plugin_frame_slot_t
+{
+    int32_t state;  // plugin_frame_slot_state_t
+    uint32_t reserved;
+    uint64_t seq;
+    uint64_t size;  // payload bytes
+    uint64_t pts;
+    uint64_t duration;
+} plugin_frame_slot_t;
+
 typedef void (*plugin_callback_fn)(const void *self,
                                    const void *context,
                                    int status,
@@ -135,6 +260,19 @@ typedef struct plugin_interface_t
 
     // private
     void *instance;  // the plugin application instance
+
+    // set by plugin, NULL if the plugin has no batch support.
+    // Submits `count` calls (meta[i], data[i]; data may be NULL) at once.
+    // With `contexts` the callback is invoked once per call with
+    // contexts[i], otherwise once for the whole batch with `context`
+    // and a json array of {"status": s, "data": d} in call order.
+    void (*call_batch)(const void *self,
+                       const void *context,
+                       const void *const *contexts,
+                       size_t count,
+                       struct plugin_buffer_t *data,
+                       struct plugin_buffer_t *meta,
+                       plugin_callback_fn callback);
 } plugin_interface_t;
 
 typedef plugin_interface_t *(*plugin_interface_initialize_fn)(
@@ -162,6 +300,10 @@ typedef void (*plugin_interface_terminate_fn)(plugin_interface_t *iface);
 
 
 #define PLUGIN_INTERFACE(_VERSION, _init_, _call_, _terminate_) \
+    PLUGIN_INTERFACE_BATCH(_VERSION, _init_, _call_, NULL, _terminate_)
+
+#define PLUGIN_INTERFACE_BATCH(_VERSION, _init_, _call_,         \
+                               _call_batch_, _terminate_)       \
     NODE_PLUGIN_SYMBOL                                          \
     plugin_interface_t *plugin_interface_initialize(            \
         void *context,                                          \
@@ -176,6 +318,7 @@ typedef void (*plugin_interface_terminate_fn)(plugin_interface_t *iface);
         /* set plugin functions */                              \
         iface->init = _init_;                                   \
         iface->call = _call_;                                   \
+        iface->call_batch = _call_batch_;                       \
         iface->terminate = _terminate_;                         \
         iface->version = _VERSION;                              \
         iface->instance = NULL;                                 \
@@ -0,0 +1,147 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "asyncstatechange.h"
+#include "trace.h"
+
+GST_DEBUG_CATEGORY_STATIC(my_category);
+#define GST_CAT_DEFAULT my_category
+
+AsyncStateChange::AsyncStateChange()
+    : shared_(std::make_shared<Shared>())
+{
+}
+
+AsyncStateChange::~AsyncStateChange()
+{
+    Cancel();
+}
+
+void AsyncStateChange::Start(GstElement *element,
+                             GstState state,
+                             GstClockTime timeout,
+                             GMainContext *context,
+                             const Callback &callback)
+{
+    GST_DEBUG_CATEGORY_INIT(my_category, "webstreamer", 2, "libWebStreamer");
+    g_return_if_fail(element != NULL);
+
+    std::shared_ptr<Job> job = std::make_shared<Job>(element);
+    job->state = state;
+    job->timeout = timeout;
+    job->context = context;
+    // from here to the callback on the app loop, cancelled or not
+    static Histogram *const histogram = Trace::SpanHistogram("set_state");
+    guint32 promise = Trace::current();
+    gint64 begin = g_get_monotonic_time();
+    job->callback = [callback, promise, begin](const std::string &error) {
+        Trace::Span("set_state", histogram, promise, begin, g_get_monotonic_time());
+        callback(error);
+    };
+    job->shared = shared_;
+    {
+        std::lock_guard<std::mutex> lock(shared_->mutex);
+        shared_->jobs.push_back(job);
+    }
+    gst_element_call_async(element, on_call_async, new std::shared_ptr<Job>(job), free_job);
+}
+
+void AsyncStateChange::Cancel()
+{
+    std::list<std::shared_ptr<Job> > jobs;
+    {
+        // waits for a set_state in flight, the next ones see cancelled
+        std::lock_guard<std::mutex> state_lock(shared_->state_mutex);
+        std::lock_guard<std::mutex> lock(shared_->mutex);
+        jobs.swap(shared_->jobs);
+        for (auto &job : jobs) {
+            job->cancelled = true;
+        }
+    }
+    for (auto &job : jobs) {
+        job->callback("cancelled");
+    }
+}
+
+bool AsyncStateChange::pending()
+{
+    std::lock_guard<std::mutex> lock(shared_->mutex);
+    return !shared_->jobs.empty();
+}
+
+bool AsyncStateChange::Take(const std::shared_ptr<Job> &job)
+{
+    std::lock_guard<std::mutex> lock(job->shared->mutex);
+    auto &jobs = job->shared->jobs;
+    for (auto it = jobs.begin(); it != jobs.end(); ++it) {
+        if (*it == job) {
+            jobs.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+void AsyncStateChange::on_call_async(GstElement *element, gpointer user_data)
+{
+    std::shared_ptr<Job> &job = *static_cast<std::shared_ptr<Job> *>(user_data);
+    const gchar *state = gst_element_state_get_name(job->state);
+
+    GstStateChangeReturn ret;
+    {
+        std::lock_guard<std::mutex> state_lock(job->shared->state_mutex);
+        {
+            std::lock_guard<std::mutex> lock(job->shared->mutex);
+            if (job->cancelled) {
+                // the owner may have set NULL already, leave it there
+                GST_DEBUG("[statechange] %s %s: cancelled", GST_ELEMENT_NAME(element), state);
+                return;
+            }
+        }
+        ret = gst_element_set_state(element, job->state);
+    }
+    if (ret == GST_STATE_CHANGE_ASYNC) {
+        // the thread of the pool waits, not the app loop
+        ret = gst_element_get_state(element, NULL, NULL, job->timeout);
+    }
+    if (ret == GST_STATE_CHANGE_FAILURE) {
+        job->error = std::string("state change to ") + state + " failed";
+    } else if (ret == GST_STATE_CHANGE_ASYNC) {
+        job->error = std::string("state change to ") + state + " timed out";
+    }
+    GST_DEBUG("[statechange] %s %s: %s", GST_ELEMENT_NAME(element), state,
+              job->error.empty() ? "done" : job->error.c_str());
+
+    GSource *source = g_idle_source_new();
+    g_source_set_callback(source, on_done, new std::shared_ptr<Job>(job), free_job);
+    g_source_attach(source, job->context);
+    g_source_unref(source);
+}
+
+gboolean AsyncStateChange::on_done(gpointer user_data)
+{
+    std::shared_ptr<Job> &job = *static_cast<std::shared_ptr<Job> *>(user_data);
+    // cancelled meanwhile, the callback has been called
+    if (Take(job)) {
+        job->callback(job->error);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+void AsyncStateChange::free_job(gpointer data)
+{
+    delete static_cast<std::shared_ptr<Job> *>(data);
+}
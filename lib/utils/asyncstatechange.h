@@ -0,0 +1,95 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBWEBSTREAMER_UTILS_ASYNC_STATE_CHANGE_H_
+#define _LIBWEBSTREAMER_UTILS_ASYNC_STATE_CHANGE_H_
+
+#include <gst/gst.h>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+
+/*
+ * State changes of a pipeline that must not block the app loop.
+ * Start() hands gst_element_set_state to the element's thread pool
+ * (gst_element_call_async) and waits there, up to the timeout, for an
+ * async change to complete. The callback then runs on the given main
+ * context: error is empty on success, else it says what failed or that
+ * the timeout passed (the element keeps changing state then).
+ * Cancel() runs the callbacks of the pending changes at once with
+ * "cancelled", their results are dropped when they come. It waits for a
+ * gst_element_set_state in flight and no cancelled change starts after
+ * it, so a set_state(NULL) following Cancel() is never overtaken.
+ */
+#define ASYNC_STATE_CHANGE_TIMEOUT (10 * GST_SECOND)
+
+class AsyncStateChange
+{
+ public:
+    typedef std::function<void(const std::string &error)> Callback;
+
+    AsyncStateChange();
+    ~AsyncStateChange();
+
+    void Start(GstElement *element,
+               GstState state,
+               GstClockTime timeout,
+               GMainContext *context,
+               const Callback &callback);
+    void Cancel();
+    bool pending();
+
+ private:
+    AsyncStateChange(const AsyncStateChange &);
+    AsyncStateChange &operator=(const AsyncStateChange &);
+
+    struct Job;
+    struct Shared
+    {
+        std::mutex state_mutex;  // held around set_state, before mutex
+        std::mutex mutex;
+        std::list<std::shared_ptr<Job> > jobs;
+    };
+    struct Job
+    {
+        explicit Job(GstElement *e)
+            : element(GST_ELEMENT(gst_object_ref(e)))
+            , cancelled(false)
+        {
+        }
+        ~Job() { gst_object_unref(element); }
+
+        GstElement *element;
+        GstState state;
+        GstClockTime timeout;
+        GMainContext *context;
+        Callback callback;
+        std::string error;
+        bool cancelled;  // under Shared::mutex
+        std::shared_ptr<Shared> shared;
+    };
+    // true if the job was still pending, it is not anymore
+    static bool Take(const std::shared_ptr<Job> &job);
+    static void on_call_async(GstElement *element, gpointer user_data);
+    static gboolean on_done(gpointer user_data);
+    static void free_job(gpointer data);
+
+    std::shared_ptr<Shared> shared_;
+};
+
+#endif  // _LIBWEBSTREAMER_UTILS_ASYNC_STATE_CHANGE_H_
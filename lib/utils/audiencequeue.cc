@@ -0,0 +1,300 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "audiencequeue.h"
+#include "metrics.h"
+
+using json = nlohmann::json;
+
+GST_DEBUG_CATEGORY_STATIC(my_category);
+#define GST_CAT_DEFAULT my_category
+
+static void probe_size(GstPadProbeInfo *info, guint *count, gsize *bytes, bool *keyframe)
+{
+    if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+        GstBufferList *buffers = GST_PAD_PROBE_INFO_BUFFER_LIST(info);
+        *count = gst_buffer_list_length(buffers);
+        *bytes = gst_buffer_list_calculate_size(buffers);
+        GstBuffer *first = *count ? gst_buffer_list_get(buffers, 0) : NULL;
+        *keyframe = first && !GST_BUFFER_FLAG_IS_SET(first, GST_BUFFER_FLAG_DELTA_UNIT);
+    } else {
+        GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+        *count = 1;
+        *bytes = gst_buffer_get_size(buffer);
+        *keyframe = !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+    }
+}
+
+AudienceQueue::AudienceQueue(const Options &options,
+                             const std::string &audience,
+                             const std::string &media_type,
+                             const DisconnectFunc &on_disconnect)
+    : options_(options)
+    , audience_(audience)
+    , media_type_(media_type)
+    , queue_(NULL)
+    , on_disconnect_(on_disconnect)
+    , received_buffers_(0)
+    , received_bytes_(0)
+    , accepted_buffers_(0)
+    , accepted_bytes_(0)
+    , sent_buffers_(0)
+    , sent_bytes_(0)
+    , dropped_buffers_(0)
+    , dropped_bytes_(0)
+    , dropping_(false)
+    , disconnected_(false)
+{
+}
+
+AudienceQueue::~AudienceQueue()
+{
+}
+
+bool AudienceQueue::ParseOptions(const json &j, Options *options, std::string *error)
+{
+    if (!j.is_object()) {
+        return true;
+    }
+    json::const_iterator it = j.find("policy");
+    if (it != j.end()) {
+        const std::string policy = it->is_string() ? it->get<std::string>() : std::string();
+        if (policy == "drop_oldest") {
+            options->policy = Policy::DROP_OLDEST;
+        } else if (policy == "drop_until_keyframe") {
+            options->policy = Policy::DROP_UNTIL_KEYFRAME;
+        } else if (policy == "disconnect") {
+            options->policy = Policy::DISCONNECT;
+        } else {
+            *error = "unknown queue policy: " + it->dump();
+            return false;
+        }
+    }
+    options->max_buffers = CLAMP(j.value("max_buffers", (gint)options->max_buffers), 1, 65536);
+    options->max_bytes = (guint)MAX(0, j.value("max_bytes", (gint)options->max_bytes));
+    return true;
+}
+
+const char *AudienceQueue::PolicyName(Policy policy)
+{
+    switch (policy) {
+        case Policy::DROP_UNTIL_KEYFRAME:
+            return "drop_until_keyframe";
+        case Policy::DISCONNECT:
+            return "disconnect";
+        default:
+            return "drop_oldest";
+    }
+}
+
+std::shared_ptr<AudienceQueue> AudienceQueue::Install(GstElement *queue,
+                                                      const Options &options,
+                                                      const std::string &audience,
+                                                      const std::string &media_type,
+                                                      const DisconnectFunc &on_disconnect)
+{
+    GST_DEBUG_CATEGORY_INIT(my_category, "webstreamer", 2, "libWebStreamer");
+
+    std::shared_ptr<AudienceQueue> self(new AudienceQueue(options, audience, media_type, on_disconnect));
+    self->queue_ = queue;
+    if (options.policy == Policy::DROP_OLDEST) {
+        g_object_set(queue,
+                     "leaky", 2,
+                     "max-size-buffers", options.max_buffers,
+                     "max-size-bytes", options.max_bytes,
+                     "max-size-time", (guint64)0,
+                     NULL);
+    } else {
+        // the probe drops before the bound, the queue limits are only
+        // a backstop and must never block the tee
+        g_object_set(queue,
+                     "leaky", 1,
+                     "max-size-buffers", options.max_buffers * 2,
+                     "max-size-bytes", options.max_bytes * 2,
+                     "max-size-time", (guint64)0,
+                     NULL);
+    }
+    // the element keeps us alive, the owner may keep a reference for stats
+    g_object_set_data_full(G_OBJECT(queue),
+                           "audience-queue",
+                           new std::shared_ptr<AudienceQueue>(self),
+                           on_element_gone);
+
+    GstPad *pad = gst_element_get_static_pad(queue, "sink");
+    gst_pad_add_probe(pad,
+                      (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER |
+                                        GST_PAD_PROBE_TYPE_BUFFER_LIST |
+                                        GST_PAD_PROBE_TYPE_EVENT_FLUSH),
+                      on_sink,
+                      self.get(),
+                      NULL);
+    gst_object_unref(pad);
+    pad = gst_element_get_static_pad(queue, "src");
+    gst_pad_add_probe(pad,
+                      (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER |
+                                        GST_PAD_PROBE_TYPE_BUFFER_LIST),
+                      on_src,
+                      self.get(),
+                      NULL);
+    gst_object_unref(pad);
+
+    GST_DEBUG("[audience-queue] %s (%s) policy: %s, max buffers: %u, max bytes: %u",
+              audience.c_str(), media_type.c_str(), PolicyName(options.policy),
+              options.max_buffers, options.max_bytes);
+    return self;
+}
+
+void AudienceQueue::on_element_gone(gpointer data)
+{
+    std::shared_ptr<AudienceQueue> *self = static_cast<std::shared_ptr<AudienceQueue> *>(data);
+    {
+        std::lock_guard<std::mutex> lock((*self)->mutex_);
+        (*self)->queue_ = NULL;
+    }
+    delete self;
+}
+
+void AudienceQueue::Disarm()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    on_disconnect_ = nullptr;
+}
+
+GstElement *AudienceQueue::element()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queue_;
+}
+
+json AudienceQueue::stats()
+{
+    guint64 dropped_buffers = dropped_buffers_.load();
+    guint64 dropped_bytes = dropped_bytes_.load();
+    guint64 sent_buffers = sent_buffers_.load();
+    guint64 sent_bytes = sent_bytes_.load();
+    if (options_.policy == Policy::DROP_OLDEST) {
+        // leaked inside the queue: what went in, not out and is not queued
+        guint level_buffers = 0;
+        guint level_bytes = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (queue_) {
+                g_object_get(queue_,
+                             "current-level-buffers", &level_buffers,
+                             "current-level-bytes", &level_bytes,
+                             NULL);
+            }
+        }
+        guint64 received_buffers = received_buffers_.load();
+        guint64 received_bytes = received_bytes_.load();
+        if (received_buffers > sent_buffers + level_buffers) {
+            dropped_buffers = received_buffers - sent_buffers - level_buffers;
+        }
+        if (received_bytes > sent_bytes + level_bytes) {
+            dropped_bytes = received_bytes - sent_bytes - level_bytes;
+        }
+    }
+
+    json j;
+    j["audience"] = audience_;
+    j["media"] = media_type_;
+    j["policy"] = PolicyName(options_.policy);
+    j["received_buffers"] = received_buffers_.load();
+    j["received_bytes"] = received_bytes_.load();
+    j["sent_buffers"] = sent_buffers;
+    j["sent_bytes"] = sent_bytes;
+    j["dropped_buffers"] = dropped_buffers;
+    j["dropped_bytes"] = dropped_bytes;
+    return j;
+}
+
+GstPadProbeReturn AudienceQueue::on_sink(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    AudienceQueue *self = static_cast<AudienceQueue *>(user_data);
+    if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_EVENT_FLUSH) {
+        if (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info)) == GST_EVENT_FLUSH_STOP) {
+            // the queue is empty again
+            self->sent_buffers_.store(self->accepted_buffers_.load());
+            self->sent_bytes_.store(self->accepted_bytes_.load());
+            self->dropping_ = false;
+        }
+        return GST_PAD_PROBE_OK;
+    }
+
+    guint count = 0;
+    gsize bytes = 0;
+    bool keyframe = false;
+    probe_size(info, &count, &bytes, &keyframe);
+    self->received_buffers_.fetch_add(count, std::memory_order_relaxed);
+    self->received_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+    if (self->options_.policy == Policy::DROP_OLDEST) {
+        self->accepted_buffers_.fetch_add(count, std::memory_order_relaxed);
+        self->accepted_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+        return GST_PAD_PROBE_OK;
+    }
+
+    guint64 level_buffers = self->accepted_buffers_.load() - self->sent_buffers_.load();
+    guint64 level_bytes = self->accepted_bytes_.load() - self->sent_bytes_.load();
+    bool full = level_buffers + count > self->options_.max_buffers ||
+                (self->options_.max_bytes && level_bytes + bytes > self->options_.max_bytes);
+
+    bool drop = full;
+    if (self->options_.policy == Policy::DROP_UNTIL_KEYFRAME) {
+        if (full) {
+            if (!self->dropping_) {
+                GST_INFO("[audience-queue] %s (%s) congested, dropping until keyframe.",
+                         self->audience_.c_str(), self->media_type_.c_str());
+            }
+            self->dropping_ = true;
+        } else if (self->dropping_ && keyframe) {
+            self->dropping_ = false;
+        }
+        drop = self->dropping_;
+    } else {
+        if (full && !self->disconnected_.exchange(true)) {
+            GST_WARNING("[audience-queue] %s (%s) congested, disconnecting.",
+                        self->audience_.c_str(), self->media_type_.c_str());
+            std::lock_guard<std::mutex> lock(self->mutex_);
+            if (self->on_disconnect_) {
+                self->on_disconnect_(self);
+            }
+        }
+        // nothing goes out any more until the audience is removed
+        drop = self->disconnected_.load();
+    }
+
+    if (drop) {
+        self->dropped_buffers_.fetch_add(count, std::memory_order_relaxed);
+        self->dropped_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+        Metrics::AddDropped("queue", count);
+        return GST_PAD_PROBE_DROP;
+    }
+    self->accepted_buffers_.fetch_add(count, std::memory_order_relaxed);
+    self->accepted_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+    return GST_PAD_PROBE_OK;
+}
+
+GstPadProbeReturn AudienceQueue::on_src(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    AudienceQueue *self = static_cast<AudienceQueue *>(user_data);
+    guint count = 0;
+    gsize bytes = 0;
+    bool keyframe = false;
+    probe_size(info, &count, &bytes, &keyframe);
+    self->sent_buffers_.fetch_add(count, std::memory_order_relaxed);
+    self->sent_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+    return GST_PAD_PROBE_OK;
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBWEBSTREAMER_UTILS_AUDIENCE_QUEUE_H_
+#define _LIBWEBSTREAMER_UTILS_AUDIENCE_QUEUE_H_
+
+#include <gst/gst.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <nlohmann/json.hpp>
+
+/*
+ * Bounded queue in front of one audience joint.
+ * Wraps a "queue" element so that the tee never blocks on a congested
+ * viewer, what happens when the bound is reached is the policy:
+ *   "drop_oldest"         the queue leaks its oldest buffers
+ *   "drop_until_keyframe" new buffers are dropped until the queue has
+ *                         room again and a keyframe arrives
+ *   "disconnect"          new buffers are dropped and the owner is
+ *                         asked (once) to remove the audience
+ * Received/sent/dropped buffers and bytes are counted per queue.
+ */
+class AudienceQueue
+{
+ public:
+    enum class Policy
+    {
+        DROP_OLDEST,
+        DROP_UNTIL_KEYFRAME,
+        DISCONNECT,
+    };
+    struct Options
+    {
+        Options()
+            : policy(Policy::DROP_OLDEST)
+            , max_buffers(200)
+            , max_bytes(10 * 1024 * 1024)
+        {
+        }
+        Policy policy;
+        guint max_buffers;
+        guint max_bytes;  // 0: no byte bound
+    };
+    // called from the streaming thread under the queue lock (Disarm()
+    // waits for it): must not take a lock held around Disarm()/element()
+    typedef std::function<void(AudienceQueue *queue)> DisconnectFunc;
+
+    // {"policy", "max_buffers", "max_bytes"}, absent fields are kept
+    static bool ParseOptions(const nlohmann::json &j, Options *options, std::string *error);
+    static const char *PolicyName(Policy policy);
+
+    // configures `queue` and ties the returned object to its lifetime
+    static std::shared_ptr<AudienceQueue> Install(GstElement *queue,
+                                                  const Options &options,
+                                                  const std::string &audience,
+                                                  const std::string &media_type,
+                                                  const DisconnectFunc &on_disconnect);
+    ~AudienceQueue();
+
+    // no more disconnect requests, the owner is going away
+    void Disarm();
+    const std::string &audience() const { return audience_; }
+    // the wrapped queue, NULL once it has been disposed
+    GstElement *element();
+    // {"audience", "media", "policy", "received_buffers", "received_bytes",
+    //  "sent_buffers", "sent_bytes", "dropped_buffers", "dropped_bytes"}
+    nlohmann::json stats();
+
+ private:
+    AudienceQueue(const Options &options,
+                  const std::string &audience,
+                  const std::string &media_type,
+                  const DisconnectFunc &on_disconnect);
+    static GstPadProbeReturn on_sink(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+    static GstPadProbeReturn on_src(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+    static void on_element_gone(gpointer data);
+
+    Options options_;
+    std::string audience_;
+    std::string media_type_;
+
+    std::mutex mutex_;  // queue_ and on_disconnect_
+    GstElement *queue_;  // not owned, cleared when the element goes
+    DisconnectFunc on_disconnect_;
+
+    std::atomic<guint64> received_buffers_;
+    std::atomic<guint64> received_bytes_;
+    std::atomic<guint64> accepted_buffers_;
+    std::atomic<guint64> accepted_bytes_;
+    std::atomic<guint64> sent_buffers_;
+    std::atomic<guint64> sent_bytes_;
+    std::atomic<guint64> dropped_buffers_;
+    std::atomic<guint64> dropped_bytes_;
+    bool dropping_;  // only touched by the upstream streaming thread
+    std::atomic<bool> disconnected_;
+};
+
+#endif  // _LIBWEBSTREAMER_UTILS_AUDIENCE_QUEUE_H_
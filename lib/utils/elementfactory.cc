@@ -0,0 +1,74 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "elementfactory.h"
+#include <mutex>  // NOLINT
+#include <unordered_map>
+
+GST_DEBUG_CATEGORY_STATIC(my_category);
+#define GST_CAT_DEFAULT my_category
+
+namespace {
+std::mutex factories_mutex;
+// holds a ref of every factory
+std::unordered_map<std::string, GstElementFactory *> factories;
+}
+
+GstElementFactory *ElementFactory::Find(const char *factory)
+{
+    g_return_val_if_fail(factory != NULL, NULL);
+
+    std::lock_guard<std::mutex> lock(factories_mutex);
+    auto it = factories.find(factory);
+    if (it != factories.end()) {
+        return it->second;
+    }
+    // a missing plugin is looked up again next time, it may be loaded later
+    GstElementFactory *found = gst_element_factory_find(factory);
+    if (found) {
+        factories[factory] = found;
+    }
+    return found;
+}
+
+GstElement *ElementFactory::Make(const char *factory, const char *name)
+{
+    GstElementFactory *found = Find(factory);
+    if (!found) {
+        GST_WARNING("[elementfactory] no such element factory \"%s\".", factory);
+        return NULL;
+    }
+    return gst_element_factory_create(found, name);
+}
+
+void ElementFactory::Preload(const std::vector<std::string> &names)
+{
+    GST_DEBUG_CATEGORY_INIT(my_category, "webstreamer", 2, "libWebStreamer");
+    for (auto &name : names) {
+        if (!Find(name.c_str())) {
+            GST_DEBUG("[elementfactory] %s is not available.", name.c_str());
+        }
+    }
+}
+
+void ElementFactory::Clear()
+{
+    std::lock_guard<std::mutex> lock(factories_mutex);
+    for (auto &it : factories) {
+        gst_object_unref(it.second);
+    }
+    factories.clear();
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBWEBSTREAMER_UTILS_ELEMENT_FACTORY_H_
+#define _LIBWEBSTREAMER_UTILS_ELEMENT_FACTORY_H_
+
+#include <gst/gst.h>
+#include <string>
+#include <vector>
+
+/*
+ * Process wide cache of GstElementFactory.
+ * gst_element_factory_make looks the factory up in the registry by name
+ * on every call, Make() does it once per name and creates from the
+ * cached factory afterwards. Preload() resolves the usual ones at init.
+ */
+class ElementFactory
+{
+ public:
+    static GstElement *Make(const char *factory, const char *name);
+    static GstElementFactory *Find(const char *factory);
+
+    static void Preload(const std::vector<std::string> &factories);
+    static void Clear();  // before gst_deinit
+
+ private:
+    ElementFactory();
+};
+
+#endif  // _LIBWEBSTREAMER_UTILS_ELEMENT_FACTORY_H_
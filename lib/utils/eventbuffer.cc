@@ -0,0 +1,170 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "eventbuffer.h"
+#include <stdlib.h>
+#include <mutex>
+#include <vector>
+
+// buffers that grew bigger (an SDP with many candidates, a snapshot)
+// are freed rather than kept around
+#define EVENT_BUFFER_POOL_SIZE 256
+#define EVENT_BUFFER_POOL_MAX_CAPACITY (64 * 1024)
+#define EVENT_BUFFER_INITIAL_CAPACITY 512
+
+class EventBufferPool
+{
+ public:
+    ~EventBufferPool()
+    {
+        for (auto buffer : free_) {
+            delete buffer;
+        }
+    }
+
+    EventBuffer *Acquire()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!free_.empty()) {
+                EventBuffer *buffer = free_.back();
+                free_.pop_back();
+                return buffer;
+            }
+        }
+        return new EventBuffer();
+    }
+
+    void Recycle(EventBuffer *buffer)
+    {
+        if (buffer->capacity_ <= EVENT_BUFFER_POOL_MAX_CAPACITY) {
+            buffer->size_ = 0;
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (free_.size() < EVENT_BUFFER_POOL_SIZE) {
+                free_.push_back(buffer);
+                return;
+            }
+        }
+        delete buffer;
+    }
+
+    static EventBufferPool &instance()
+    {
+        static EventBufferPool pool;
+        return pool;
+    }
+
+ private:
+    std::mutex mutex_;
+    std::vector<EventBuffer *> free_;
+};
+
+EventBuffer::EventBuffer()
+    : refcount_(0)
+    , data_(NULL)
+    , size_(0)
+    , capacity_(0)
+{
+}
+
+EventBuffer::~EventBuffer()
+{
+    free(data_);
+}
+
+EventBuffer *EventBuffer::Acquire()
+{
+    EventBuffer *buffer = EventBufferPool::instance().Acquire();
+    buffer->refcount_.store(1, std::memory_order_relaxed);
+    return buffer;
+}
+
+EventBuffer *EventBuffer::Serialize(const nlohmann::json &j)
+{
+    EventBuffer *buffer = Acquire();
+    const std::string s = j.dump();
+    buffer->Append(s.data(), s.size());
+    return buffer;
+}
+
+EventBuffer *EventBuffer::FromString(const char *s, size_t length)
+{
+    EventBuffer *buffer = Acquire();
+    buffer->Append(s, length);
+    return buffer;
+}
+
+void EventBuffer::Ref()
+{
+    refcount_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void EventBuffer::Unref()
+{
+    if (refcount_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        EventBufferPool::instance().Recycle(this);
+    }
+}
+
+void EventBuffer::Reserve(size_t capacity)
+{
+    if (capacity <= capacity_) {
+        return;
+    }
+    size_t n = capacity_ ? capacity_ : EVENT_BUFFER_INITIAL_CAPACITY;
+    while (n < capacity) {
+        n *= 2;
+    }
+    data_ = (char *)realloc(data_, n);
+    capacity_ = n;
+}
+
+void EventBuffer::Append(char c)
+{
+    if (size_ + 1 >= capacity_) {
+        Reserve(size_ + 2);
+    }
+    data_[size_++] = c;
+}
+
+void EventBuffer::Append(const char *s, size_t length)
+{
+    Reserve(size_ + length + 1);
+    memcpy(data_ + size_, s, length);
+    size_ += length;
+}
+
+void EventBuffer::Attach(plugin_buffer_t *buffer)
+{
+    Reserve(size_ + 1);
+    data_[size_] = '\0';
+
+    buffer->data = data_;
+    buffer->size = size_;
+    buffer->context = this;
+    buffer->release = EventBuffer::OnRelease;
+    // the reference travels with the struct, nothing to copy
+    buffer->move = _default_plugin_buffer_move;
+}
+
+void EventBuffer::OnRelease(plugin_buffer_t *buffer)
+{
+    EventBuffer *self = static_cast<EventBuffer *>(buffer->context);
+    memset(buffer, 0, sizeof(plugin_buffer_t));
+    if (self) {
+        self->Unref();
+    }
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBWEBSTREAMER_UTILS_EVENT_BUFFER_H_
+#define _LIBWEBSTREAMER_UTILS_EVENT_BUFFER_H_
+
+#include <atomic>
+#include <plugin_interface.h>
+#include <nlohmann/json.hpp>
+
+/*
+ * Refcounted byte buffer recycled through a process wide pool.
+ * Attach() hands a reference to a plugin_buffer_t whose release hook
+ * gives it back, so an event reaches the host without another copy.
+ * Json goes through json::dump(), the serializer of nlohmann is not
+ * a public interface.
+ */
+class EventBuffer
+{
+ public:
+    static EventBuffer *Acquire();
+    // acquire a buffer holding the compact dump of `j`
+    static EventBuffer *Serialize(const nlohmann::json &j);
+    static EventBuffer *FromString(const char *s, size_t length);
+
+    void Ref();
+    void Unref();
+
+    void Append(char c);
+    void Append(const char *s, size_t length);
+
+    const char *data() const { return data_; }
+    size_t size() const { return size_; }
+
+    // moves one reference into `buffer` (data is NUL terminated)
+    void Attach(plugin_buffer_t *buffer);
+
+ private:
+    EventBuffer();
+    ~EventBuffer();
+    EventBuffer(const EventBuffer &);
+    EventBuffer &operator=(const EventBuffer &);
+
+    friend class EventBufferPool;
+
+    void Reserve(size_t capacity);
+    static void OnRelease(plugin_buffer_t *buffer);
+
+    std::atomic<int> refcount_;
+    char *data_;
+    size_t size_;
+    size_t capacity_;
+};
+
+#endif  // _LIBWEBSTREAMER_UTILS_EVENT_BUFFER_H_
@@ -0,0 +1,196 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fanout.h"
+
+GST_DEBUG_CATEGORY_STATIC(my_category);
+#define GST_CAT_DEFAULT my_category
+
+FanOut::Subscriber::~Subscriber()
+{
+    // the last reference may be dropped by the streaming thread
+    gst_pad_unlink(srcpad, sinkpad);
+    gst_pad_set_active(srcpad, FALSE);
+    gst_object_unref(srcpad);
+    gst_object_unref(sinkpad);
+}
+
+FanOut::FanOut()
+    : subscribers_(std::make_shared<List>())
+    , pad_(NULL)
+    , sticky_(NULL)
+    , probe_id_(0)
+    , seq_(0)
+{
+}
+
+FanOut::~FanOut()
+{
+    Detach();
+}
+
+bool FanOut::Attach(GstPad *pad)
+{
+    GST_DEBUG_CATEGORY_INIT(my_category, "webstreamer", 2, "libWebStreamer");
+    g_return_val_if_fail(pad != NULL, false);
+    g_return_val_if_fail(pad_ == NULL, false);
+
+    sticky_ = gst_pad_new("fanout_sticky", GST_PAD_SRC);
+    gst_pad_set_active(sticky_, TRUE);
+    pad_ = GST_PAD(gst_object_ref(pad));
+    probe_id_ = gst_pad_add_probe(pad_,
+                                  (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER |
+                                                    GST_PAD_PROBE_TYPE_BUFFER_LIST |
+                                                    GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM |
+                                                    GST_PAD_PROBE_TYPE_EVENT_FLUSH),
+                                  on_data,
+                                  this,
+                                  NULL);
+    return true;
+}
+
+void FanOut::Detach()
+{
+    if (!pad_) {
+        return;
+    }
+    gst_pad_remove_probe(pad_, probe_id_);
+    probe_id_ = 0;
+    gst_object_unref(pad_);
+    pad_ = NULL;
+
+    std::shared_ptr<const List> list;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        list.swap(subscribers_);
+        subscribers_ = std::make_shared<List>();
+    }
+    list.reset();
+    gst_pad_set_active(sticky_, FALSE);
+    gst_object_unref(sticky_);
+    sticky_ = NULL;
+}
+
+bool FanOut::Subscribe(GstPad *sinkpad)
+{
+    g_return_val_if_fail(sinkpad != NULL, false);
+    g_return_val_if_fail(pad_ != NULL, false);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    gchar *name = g_strdup_printf("fanout_src_%u", seq_++);
+    GstPad *srcpad = gst_pad_new(name, GST_PAD_SRC);
+    g_free(name);
+    gst_pad_set_active(srcpad, TRUE);
+    // stream-start, caps and segment go out in front of the next buffer
+    gst_pad_sticky_events_foreach(sticky_, copy_sticky_event, srcpad);
+    // the peer lives in another pipeline, skip the hierarchy check
+    if (gst_pad_link_full(srcpad, sinkpad, GST_PAD_LINK_CHECK_NOTHING) != GST_PAD_LINK_OK) {
+        GST_ERROR("[fanout] link to %s:%s failed.", GST_DEBUG_PAD_NAME(sinkpad));
+        gst_pad_set_active(srcpad, FALSE);
+        gst_object_unref(srcpad);
+        return false;
+    }
+
+    std::shared_ptr<Subscriber> subscriber = std::make_shared<Subscriber>();
+    subscriber->srcpad = srcpad;
+    subscriber->sinkpad = GST_PAD(gst_object_ref(sinkpad));
+    std::shared_ptr<List> list = std::make_shared<List>(*subscribers_);
+    list->push_back(subscriber);
+    subscribers_ = list;
+    GST_DEBUG("[fanout] %s:%s subscribed, %u in total.",
+              GST_DEBUG_PAD_NAME(sinkpad), (guint)list->size());
+    return true;
+}
+
+bool FanOut::Unsubscribe(GstPad *sinkpad)
+{
+    std::shared_ptr<const List> old;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::shared_ptr<List> list = std::make_shared<List>();
+        list->reserve(subscribers_->size());
+        for (auto &subscriber : *subscribers_) {
+            if (subscriber->sinkpad != sinkpad) {
+                list->push_back(subscriber);
+            }
+        }
+        if (list->size() == subscribers_->size()) {
+            return false;
+        }
+        old.swap(subscribers_);
+        subscribers_ = list;
+    }
+    // a push in flight keeps its own reference to the old list
+    return true;
+}
+
+guint FanOut::size()
+{
+    return (guint)subscribers()->size();
+}
+
+std::shared_ptr<const FanOut::List> FanOut::subscribers()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return subscribers_;
+}
+
+gboolean FanOut::copy_sticky_event(GstPad *pad, GstEvent **event, gpointer user_data)
+{
+    gst_pad_store_sticky_event(GST_PAD(user_data), *event);
+    return TRUE;
+}
+
+GstPadProbeReturn FanOut::on_data(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    FanOut *self = static_cast<FanOut *>(user_data);
+    std::shared_ptr<const List> list;
+    if (GST_PAD_PROBE_INFO_TYPE(info) & (GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM | GST_PAD_PROBE_TYPE_EVENT_FLUSH)) {
+        GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+        std::lock_guard<std::mutex> lock(self->mutex_);
+        // recorded under the lock, a concurrent Subscribe either sees
+        // the event in its replay or gets it pushed below
+        if (GST_EVENT_IS_STICKY(event)) {
+            gst_pad_store_sticky_event(self->sticky_, event);
+        }
+        list = self->subscribers_;
+    } else {
+        list = self->subscribers();
+    }
+    if (list->empty()) {
+        return GST_PAD_PROBE_OK;
+    }
+
+    // a failing subscriber must not affect the producer or the others,
+    // flow returns are ignored
+    if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER) {
+        GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+        for (auto &subscriber : *list) {
+            gst_pad_push(subscriber->srcpad, gst_buffer_ref(buffer));
+        }
+    } else if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+        GstBufferList *buffers = GST_PAD_PROBE_INFO_BUFFER_LIST(info);
+        for (auto &subscriber : *list) {
+            gst_pad_push_list(subscriber->srcpad, gst_buffer_list_ref(buffers));
+        }
+    } else {
+        GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+        for (auto &subscriber : *list) {
+            gst_pad_push_event(subscriber->srcpad, gst_event_ref(event));
+        }
+    }
+    return GST_PAD_PROBE_OK;
+}
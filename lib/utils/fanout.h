@@ -0,0 +1,78 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBWEBSTREAMER_UTILS_FANOUT_H_
+#define _LIBWEBSTREAMER_UTILS_FANOUT_H_
+
+#include <gst/gst.h>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <vector>
+
+/*
+ * Producer side subscriber list.
+ * Attached to the sink pad of an app tee, it pushes every buffer (list)
+ * and downstream event to all subscribers from the producer streaming
+ * thread, with a reference instead of a copy. A subscriber is a sink pad
+ * of any pipeline (usually a leaky queue), linked to a parentless source
+ * pad owned by the fan-out, so no tee request pad, proxysink/proxysrc
+ * pair or clock crossing is needed per viewer.
+ * The subscriber list is copy-on-write, the streaming thread only holds
+ * the lock to take a reference of the current list.
+ */
+class FanOut
+{
+ public:
+    FanOut();
+    ~FanOut();
+
+    bool Attach(GstPad *pad);
+    void Detach();
+
+    // sticky events seen so far are replayed to the new subscriber
+    bool Subscribe(GstPad *sinkpad);
+    bool Unsubscribe(GstPad *sinkpad);
+    guint size();
+
+ private:
+    FanOut(const FanOut &);
+    FanOut &operator=(const FanOut &);
+
+    struct Subscriber
+    {
+        GstPad *srcpad;
+        GstPad *sinkpad;
+        ~Subscriber();
+    };
+    typedef std::vector<std::shared_ptr<Subscriber> > List;
+
+    std::shared_ptr<const List> subscribers();
+    static GstPadProbeReturn on_data(GstPad *pad,
+                                     GstPadProbeInfo *info,
+                                     gpointer user_data);
+    static gboolean copy_sticky_event(GstPad *pad,
+                                      GstEvent **event,
+                                      gpointer user_data);
+
+    std::mutex mutex_;
+    std::shared_ptr<const List> subscribers_;
+    GstPad *pad_;
+    GstPad *sticky_;  // keeps the sticky events for late subscribers
+    gulong probe_id_;
+    guint seq_;
+};
+
+#endif  // _LIBWEBSTREAMER_UTILS_FANOUT_H_
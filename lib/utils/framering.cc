@@ -0,0 +1,194 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "framering.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+GST_DEBUG_CATEGORY_STATIC(my_category);
+#define GST_CAT_DEFAULT my_category
+
+#define FRAME_RING_ALIGN 64
+
+static gsize align_up(gsize n)
+{
+    return (n + FRAME_RING_ALIGN - 1) & ~(gsize)(FRAME_RING_ALIGN - 1);
+}
+
+FrameRing::FrameRing()
+    : ring_(NULL)
+    , length_(0)
+    , next_(0)
+#ifdef _WIN32
+    , mapping_(NULL)
+#endif
+{
+}
+
+FrameRing::~FrameRing()
+{
+    Destroy();
+}
+
+std::string FrameRing::MakeName(const std::string &tag)
+{
+    static gint seq = 0;
+    gchar *name;
+#ifdef _WIN32
+    name = g_strdup_printf("Local\\webstreamer-%lu-%s-%d",
+                           (unsigned long)GetCurrentProcessId(), tag.c_str(),
+                           g_atomic_int_add(&seq, 1));
+#else
+    name = g_strdup_printf("/webstreamer-%ld-%s-%d",
+                           (long)getpid(), tag.c_str(),
+                           g_atomic_int_add(&seq, 1));
+#endif
+    std::string result(name);
+    g_free(name);
+    return result;
+}
+
+bool FrameRing::Create(const std::string &name, guint slot_count, gsize slot_size)
+{
+    GST_DEBUG_CATEGORY_INIT(my_category, "webstreamer", 2, "libWebStreamer");
+    g_return_val_if_fail(ring_ == NULL, false);
+    g_return_val_if_fail(slot_count > 0 && slot_size > 0, false);
+
+    gsize header = align_up(sizeof(plugin_frame_ring_t));
+    gsize stride = align_up(sizeof(plugin_frame_slot_t) + slot_size);
+    gsize length = header + stride * slot_count;
+    void *base = NULL;
+
+#ifdef _WIN32
+    HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                        (DWORD)((guint64)length >> 32),
+                                        (DWORD)(length & 0xffffffff),
+                                        name.c_str());
+    if (!mapping) {
+        GST_ERROR("[frame-ring] CreateFileMapping %s failed: %lu", name.c_str(), GetLastError());
+        return false;
+    }
+    base = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, length);
+    if (!base) {
+        GST_ERROR("[frame-ring] MapViewOfFile %s failed: %lu", name.c_str(), GetLastError());
+        CloseHandle(mapping);
+        return false;
+    }
+    mapping_ = mapping;
+#else
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        GST_ERROR("[frame-ring] shm_open %s failed: %s", name.c_str(), g_strerror(errno));
+        return false;
+    }
+    if (ftruncate(fd, (off_t)length) != 0) {
+        GST_ERROR("[frame-ring] ftruncate %s failed: %s", name.c_str(), g_strerror(errno));
+        close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+    base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        GST_ERROR("[frame-ring] mmap %s failed: %s", name.c_str(), g_strerror(errno));
+        shm_unlink(name.c_str());
+        return false;
+    }
+#endif
+
+    name_ = name;
+    length_ = length;
+    next_ = 0;
+    ring_ = static_cast<plugin_frame_ring_t *>(base);
+    memset(ring_, 0, header);
+    ring_->version = 1;
+    ring_->slot_count = slot_count;
+    ring_->slot_size = (uint32_t)slot_size;
+    ring_->slot_stride = (uint32_t)stride;
+    for (guint i = 0; i < slot_count; i++) {
+        memset(slot(i), 0, sizeof(plugin_frame_slot_t));
+    }
+    // published last, a host seeing the magic sees a complete header
+    g_atomic_int_set((gint *)&ring_->magic, (gint)PLUGIN_FRAME_RING_MAGIC);
+
+    GST_INFO("[frame-ring] %s created, %u slots of %" G_GSIZE_FORMAT " bytes.",
+             name.c_str(), slot_count, slot_size);
+    return true;
+}
+
+void FrameRing::Destroy()
+{
+    if (!ring_) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(ring_);
+    CloseHandle((HANDLE)mapping_);
+    mapping_ = NULL;
+#else
+    munmap(ring_, length_);
+    // hosts which mapped it keep their mapping
+    shm_unlink(name_.c_str());
+#endif
+    ring_ = NULL;
+    length_ = 0;
+}
+
+plugin_frame_slot_t *FrameRing::slot(guint index)
+{
+    guint8 *base = reinterpret_cast<guint8 *>(ring_);
+    return reinterpret_cast<plugin_frame_slot_t *>(
+        base + align_up(sizeof(plugin_frame_ring_t)) + (gsize)index * ring_->slot_stride);
+}
+
+guint8 *FrameRing::Acquire(guint *index)
+{
+    g_return_val_if_fail(ring_ != NULL, NULL);
+
+    plugin_frame_slot_t *s = slot(next_);
+    if (!g_atomic_int_compare_and_exchange((gint *)&s->state,
+                                           PLUGIN_FRAME_SLOT_FREE,
+                                           PLUGIN_FRAME_SLOT_WRITING)) {
+        ring_->dropped++;
+        return NULL;
+    }
+    *index = next_;
+    next_ = (next_ + 1) % ring_->slot_count;
+    return reinterpret_cast<guint8 *>(s) + sizeof(plugin_frame_slot_t);
+}
+
+guint64 FrameRing::Commit(guint index, gsize size, GstClockTime pts, GstClockTime duration)
+{
+    plugin_frame_slot_t *s = slot(index);
+    s->seq = ++ring_->written;
+    s->size = size;
+    s->pts = pts;
+    s->duration = duration;
+    g_atomic_int_set((gint *)&s->state, PLUGIN_FRAME_SLOT_READY);
+    return s->seq;
+}
+
+void FrameRing::Abort(guint index)
+{
+    g_atomic_int_set((gint *)&slot(index)->state, PLUGIN_FRAME_SLOT_FREE);
+}
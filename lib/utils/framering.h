@@ -0,0 +1,68 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBWEBSTREAMER_UTILS_FRAME_RING_H_
+#define _LIBWEBSTREAMER_UTILS_FRAME_RING_H_
+
+#include <gst/gst.h>
+#include <string>
+#include <plugin_interface.h>
+
+/*
+ * Single producer side of the shared-memory frame ring described in
+ * plugin_interface.h. The host releases slots by itself, the producer
+ * only ever takes the slot following the last one it wrote.
+ */
+class FrameRing
+{
+ public:
+    FrameRing();
+    ~FrameRing();
+
+    // a name unique to this process for `tag` (shm_open / mapping name)
+    static std::string MakeName(const std::string &tag);
+
+    bool Create(const std::string &name, guint slot_count, gsize slot_size);
+    void Destroy();
+
+    bool valid() const { return ring_ != NULL; }
+    const std::string &name() const { return name_; }
+    guint slot_count() const { return ring_ ? ring_->slot_count : 0; }
+    gsize slot_size() const { return ring_ ? ring_->slot_size : 0; }
+
+    // payload of the next slot, NULL (frame dropped) if it is still in use
+    guint8 *Acquire(guint *index);
+    // publish the slot, returns its sequence number
+    guint64 Commit(guint index, gsize size, GstClockTime pts, GstClockTime duration);
+    // give back an acquired slot without publishing it
+    void Abort(guint index);
+
+ private:
+    FrameRing(const FrameRing &);
+    FrameRing &operator=(const FrameRing &);
+
+    plugin_frame_slot_t *slot(guint index);
+
+    std::string name_;
+    plugin_frame_ring_t *ring_;
+    gsize length_;
+    guint next_;
+#ifdef _WIN32
+    void *mapping_;
+#endif
+};
+
+#endif  // _LIBWEBSTREAMER_UTILS_FRAME_RING_H_
@@ -0,0 +1,218 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gopcache.h"
+
+GST_DEBUG_CATEGORY_STATIC(my_category);
+#define GST_CAT_DEFAULT my_category
+
+#define GOP_REPLAY_SPACING (GST_MSECOND)
+
+GopCache::State::~State()
+{
+    Clear();
+}
+
+void GopCache::State::Clear()
+{
+    for (auto buffer : group) {
+        gst_buffer_unref(buffer);
+    }
+    group.clear();
+    bytes = 0;
+}
+
+GopCache::GopCache()
+    : state_(std::make_shared<State>())
+    , pad_(NULL)
+    , probe_id_(0)
+{
+}
+
+GopCache::~GopCache()
+{
+    Detach();
+}
+
+bool GopCache::Attach(GstPad *pad, gsize max_bytes)
+{
+    GST_DEBUG_CATEGORY_INIT(my_category, "webstreamer", 2, "libWebStreamer");
+    g_return_val_if_fail(pad != NULL, false);
+    g_return_val_if_fail(pad_ == NULL, false);
+
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        state_->max_bytes = max_bytes;
+        state_->overflow = true;
+        state_->Clear();
+    }
+    pad_ = GST_PAD(gst_object_ref(pad));
+    probe_id_ = gst_pad_add_probe(pad_,
+                                  (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER |
+                                                    GST_PAD_PROBE_TYPE_BUFFER_LIST |
+                                                    GST_PAD_PROBE_TYPE_EVENT_FLUSH),
+                                  on_buffer,
+                                  state_.get(),
+                                  NULL);
+    GST_DEBUG("[gop-cache] attached to %s:%s, max bytes: %" G_GSIZE_FORMAT,
+              GST_DEBUG_PAD_NAME(pad), max_bytes);
+    return true;
+}
+
+void GopCache::Detach()
+{
+    if (!pad_) {
+        return;
+    }
+    gst_pad_remove_probe(pad_, probe_id_);
+    probe_id_ = 0;
+    gst_object_unref(pad_);
+    pad_ = NULL;
+
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->Clear();
+    state_->overflow = true;
+}
+
+guint GopCache::buffers()
+{
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return (guint)state_->group.size();
+}
+
+gsize GopCache::bytes()
+{
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->bytes;
+}
+
+void GopCache::Add(State *state, GstBuffer *buffer)
+{
+    if (!GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+        state->Clear();
+        state->overflow = false;
+    }
+    if (state->overflow) {
+        return;
+    }
+    gsize size = gst_buffer_get_size(buffer);
+    if (state->max_bytes && state->bytes + size > state->max_bytes) {
+        GST_DEBUG("[gop-cache] group exceeds %" G_GSIZE_FORMAT " bytes, dropped.", state->max_bytes);
+        state->Clear();
+        state->overflow = true;
+        return;
+    }
+    state->group.push_back(gst_buffer_ref(buffer));
+    state->bytes += size;
+}
+
+GstPadProbeReturn GopCache::on_buffer(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    State *state = static_cast<State *>(user_data);
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_EVENT_FLUSH) {
+        // whatever comes after a flush is not a continuation
+        state->Clear();
+        state->overflow = true;
+    } else if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+        GstBufferList *buffers = GST_PAD_PROBE_INFO_BUFFER_LIST(info);
+        guint length = gst_buffer_list_length(buffers);
+        for (guint i = 0; i < length; i++) {
+            Add(state, gst_buffer_list_get(buffers, i));
+        }
+    } else {
+        Add(state, GST_PAD_PROBE_INFO_BUFFER(info));
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+void GopCache::Prime(GstPad *sinkpad)
+{
+    g_return_if_fail(pad_ != NULL);
+    Primer *primer = new Primer();
+    primer->state = state_;
+    primer->done = false;
+    gst_pad_add_probe(sinkpad,
+                      (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+                      on_first_buffer,
+                      primer,
+                      free_primer);
+}
+
+void GopCache::free_primer(gpointer data)
+{
+    delete static_cast<Primer *>(data);
+}
+
+GstPadProbeReturn GopCache::on_first_buffer(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    Primer *primer = static_cast<Primer *>(user_data);
+    if (primer->done) {
+        return GST_PAD_PROBE_OK;  // one of the replayed buffers
+    }
+    primer->done = true;
+
+    GstBuffer *live = (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER_LIST)
+                          ? gst_buffer_list_get(GST_PAD_PROBE_INFO_BUFFER_LIST(info), 0)
+                          : GST_PAD_PROBE_INFO_BUFFER(info);
+    if (!live || !GST_BUFFER_FLAG_IS_SET(live, GST_BUFFER_FLAG_DELTA_UNIT)) {
+        return GST_PAD_PROBE_REMOVE;  // starts with a keyframe anyway
+    }
+
+    std::vector<GstBuffer *> burst;
+    {
+        State *state = primer->state.get();
+        std::lock_guard<std::mutex> lock(state->mutex);
+        burst.reserve(state->group.size());
+        for (auto buffer : state->group) {
+            // the cache was fed before the tee pushed the live buffer
+            if (buffer == live || (buffer->pts == live->pts && buffer->dts == live->dts)) {
+                break;
+            }
+            burst.push_back(gst_buffer_ref(buffer));
+        }
+    }
+    if (burst.empty()) {
+        return GST_PAD_PROBE_REMOVE;
+    }
+
+    GstClockTime end = GST_BUFFER_DTS_OR_PTS(live);
+    GstClockTime span = GOP_REPLAY_SPACING * burst.size();
+    GstClockTime start = (GST_CLOCK_TIME_IS_VALID(end) && end > span) ? end - span : GST_CLOCK_TIME_NONE;
+    GST_DEBUG("[gop-cache] %s:%s replays %u buffers.", GST_DEBUG_PAD_NAME(pad), (guint)burst.size());
+
+    for (size_t i = 0; i < burst.size(); i++) {
+        // shallow copy, the memory is shared with the live stream
+        GstBuffer *buffer = gst_buffer_copy(burst[i]);
+        gst_buffer_unref(burst[i]);
+        if (GST_CLOCK_TIME_IS_VALID(start)) {
+            GST_BUFFER_PTS(buffer) = start + GOP_REPLAY_SPACING * i;
+            GST_BUFFER_DTS(buffer) = GST_BUFFER_PTS(buffer);
+            GST_BUFFER_DURATION(buffer) = GOP_REPLAY_SPACING;
+        }
+        if (i == 0) {
+            GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DISCONT);
+        }
+        // stream lock is recursive, this probe lets them through
+        if (gst_pad_chain(pad, buffer) != GST_FLOW_OK) {
+            for (size_t j = i + 1; j < burst.size(); j++) {
+                gst_buffer_unref(burst[j]);
+            }
+            break;
+        }
+    }
+    return GST_PAD_PROBE_REMOVE;
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBWEBSTREAMER_UTILS_GOP_CACHE_H_
+#define _LIBWEBSTREAMER_UTILS_GOP_CACHE_H_
+
+#include <gst/gst.h>
+#include <deque>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <vector>
+
+/*
+ * Keeps the access units of the current group of pictures.
+ * Attached to the sink pad of the video tee, the cache restarts on every
+ * keyframe and holds references (no copies) until the next one, a group
+ * larger than max_bytes is dropped until the next keyframe.
+ * Prime() makes a new audience start with a burst of the cached group:
+ * in front of its first live buffer the group is chained with
+ * timestamps packed 1ms apart right before that buffer, so the decoder
+ * shows a picture at once instead of waiting for the next IDR.
+ * The burst is in decode order with pts = dts, streams with B frames
+ * show the burst pictures in decode order.
+ */
+class GopCache
+{
+ public:
+    GopCache();
+    ~GopCache();
+
+    bool Attach(GstPad *pad, gsize max_bytes);
+    void Detach();
+    bool attached() const { return pad_ != NULL; }
+
+    // one shot, for the pad an audience gets its video from
+    void Prime(GstPad *sinkpad);
+
+    guint buffers();
+    gsize bytes();
+
+ private:
+    GopCache(const GopCache &);
+    GopCache &operator=(const GopCache &);
+
+    struct State
+    {
+        State()
+            : max_bytes(0)
+            , bytes(0)
+            , overflow(true)
+        {
+        }
+        ~State();
+        void Clear();
+
+        std::mutex mutex;
+        gsize max_bytes;
+        gsize bytes;
+        bool overflow;  // waiting for a keyframe
+        std::deque<GstBuffer *> group;
+    };
+    struct Primer
+    {
+        std::shared_ptr<State> state;
+        bool done;
+    };
+    static void Add(State *state, GstBuffer *buffer);
+    static GstPadProbeReturn on_buffer(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+    static GstPadProbeReturn on_first_buffer(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+    static void free_primer(gpointer data);
+
+    std::shared_ptr<State> state_;
+    GstPad *pad_;
+    gulong probe_id_;
+};
+
+#endif  // _LIBWEBSTREAMER_UTILS_GOP_CACHE_H_
@@ -0,0 +1,167 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "keyframesnapshot.h"
+#include <gst/app/app.h>
+#include <gst/video/video.h>
+
+GST_DEBUG_CATEGORY_STATIC(my_category);
+#define GST_CAT_DEFAULT my_category
+
+using json = nlohmann::json;
+
+// decoding is bursty (a poll over many cameras), keep it bounded
+#define KEYFRAME_SNAPSHOT_THREADS 4
+#define KEYFRAME_DECODE_TIMEOUT (2 * GST_SECOND)
+
+bool KeyframeSnapshot::ParseRequest(const json &j, Request *request)
+{
+    gint timeout = 5000;
+    if (j.is_object()) {
+        request->format = j.value("format", request->format);
+        request->width = MAX(0, j.value("width", request->width));
+        request->height = MAX(0, j.value("height", request->height));
+        timeout = MAX(1, j.value("timeout", timeout));
+    }
+    if (request->format != "jpeg" && request->format != "png") {
+        return false;
+    }
+    request->deadline = g_get_monotonic_time() + (gint64)timeout * 1000;
+    return true;
+}
+
+void KeyframeSnapshot::Submit(GstSample *keyframe, const std::vector<Request> &requests)
+{
+    static GThreadPool *thread_pool = NULL;
+    if (g_once_init_enter(&thread_pool)) {
+        GST_DEBUG_CATEGORY_INIT(my_category, "webstreamer", 2, "libWebStreamer");
+        g_once_init_leave(&thread_pool,
+                          g_thread_pool_new(KeyframeSnapshot::Run, NULL,
+                                            KEYFRAME_SNAPSHOT_THREADS, FALSE, NULL));
+    }
+    Job *job = new Job;
+    job->keyframe = keyframe;
+    job->requests = requests;
+    g_thread_pool_push(thread_pool, job, NULL);
+}
+
+GstSample *KeyframeSnapshot::Decode(GstSample *keyframe, std::string *error)
+{
+    GError *err = NULL;
+    GstElement *pipeline = gst_parse_launch(
+        "appsrc name=src format=time ! decodebin ! videoconvert ! "
+        "appsink name=sink sync=false",
+        &err);
+    if (!pipeline) {
+        *error = err ? err->message : "failed to create decoder.";
+        g_clear_error(&err);
+        return NULL;
+    }
+    GstElement *src = gst_bin_get_by_name(GST_BIN(pipeline), "src");
+    GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    gst_app_src_set_caps(GST_APP_SRC(src), gst_sample_get_caps(keyframe));
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    // a single frame, the decoder drains it on EOS
+    GstBuffer *buffer = gst_buffer_ref(gst_sample_get_buffer(keyframe));
+    gst_app_src_push_buffer(GST_APP_SRC(src), buffer);
+    gst_app_src_end_of_stream(GST_APP_SRC(src));
+
+    GstSample *raw = gst_app_sink_try_pull_sample(GST_APP_SINK(sink), KEYFRAME_DECODE_TIMEOUT);
+    if (!raw) {
+        *error = "keyframe could not be decoded.";
+    }
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(src);
+    gst_object_unref(sink);
+    gst_object_unref(pipeline);
+    return raw;
+}
+
+void KeyframeSnapshot::Run(gpointer data, gpointer user_data)
+{
+    Job *job = static_cast<Job *>(data);
+    std::string error;
+    GstSample *raw = Decode(job->keyframe, &error);
+    GstClockTime pts = GST_BUFFER_PTS(gst_sample_get_buffer(job->keyframe));
+
+    GstVideoInfo info;
+    if (raw && !gst_video_info_from_caps(&info, gst_sample_get_caps(raw))) {
+        gst_sample_unref(raw);
+        raw = NULL;
+        error = "decoder output is not raw video.";
+    }
+
+    for (auto &request : job->requests) {
+        Promise *promise = request.promise;
+        if (!raw) {
+            GST_ERROR("[snapshot] %s", error.c_str());
+            promise->reject(error);
+            delete promise;
+            continue;
+        }
+
+        gint width = request.width;
+        gint height = request.height;
+        if (!width && !height) {
+            width = GST_VIDEO_INFO_WIDTH(&info);
+            height = GST_VIDEO_INFO_HEIGHT(&info);
+        } else if (!width) {
+            width = MAX(1, (gint)gst_util_uint64_scale_int(height, GST_VIDEO_INFO_WIDTH(&info), GST_VIDEO_INFO_HEIGHT(&info)));
+        } else if (!height) {
+            height = MAX(1, (gint)gst_util_uint64_scale_int(width, GST_VIDEO_INFO_HEIGHT(&info), GST_VIDEO_INFO_WIDTH(&info)));
+        }
+
+        GstCaps *caps = gst_caps_new_simple(request.format == "png" ? "image/png" : "image/jpeg",
+                                            "width", G_TYPE_INT, width,
+                                            "height", G_TYPE_INT, height,
+                                            NULL);
+        GError *err = NULL;
+        GstSample *image = gst_video_convert_sample(raw, caps, GST_CLOCK_TIME_NONE, &err);
+        gst_caps_unref(caps);
+        GstMapInfo map;
+        if (!image || !gst_buffer_map(gst_sample_get_buffer(image), &map, GST_MAP_READ)) {
+            std::string message = err ? err->message : "failed to encode the snapshot.";
+            GST_ERROR("[snapshot] %s", message.c_str());
+            g_clear_error(&err);
+            if (image) {
+                gst_sample_unref(image);
+            }
+            promise->reject(message);
+            delete promise;
+            continue;
+        }
+        gchar *base64 = g_base64_encode(map.data, map.size);
+        gst_buffer_unmap(gst_sample_get_buffer(image), &map);
+        gst_sample_unref(image);
+
+        json result;
+        result["format"] = request.format;
+        result["width"] = width;
+        result["height"] = height;
+        result["pts"] = pts;
+        result["data"] = base64;
+        g_free(base64);
+        promise->resolve(result);
+        delete promise;
+    }
+
+    if (raw) {
+        gst_sample_unref(raw);
+    }
+    gst_sample_unref(job->keyframe);
+    delete job;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBWEBSTREAMER_UTILS_KEYFRAME_SNAPSHOT_H_
+#define _LIBWEBSTREAMER_UTILS_KEYFRAME_SNAPSHOT_H_
+
+#include <gst/gst.h>
+#include <string>
+#include <vector>
+#include <framework/promise.h>
+
+/*
+ * Turns one encoded keyframe into thumbnails.
+ * Submit() hands the keyframe and the waiting (deferred) promises to a
+ * small shared thread pool; there a transient decode pipeline is built
+ * for that single frame, the picture is scaled and encoded once per
+ * request and the promise is resolved with
+ *   {"format", "width", "height", "pts", "data": <base64>}
+ * and deleted. No decoder is kept running between snapshots.
+ */
+class KeyframeSnapshot
+{
+ public:
+    struct Request
+    {
+        Request()
+            : promise(NULL)
+            , format("jpeg")
+            , width(0)
+            , height(0)
+            , deadline(0)
+        {
+        }
+        Promise *promise;
+        std::string format;  // "jpeg" or "png"
+        gint width;          // 0: keep source (or aspect of the other)
+        gint height;
+        gint64 deadline;     // g_get_monotonic_time() based
+    };
+
+    static bool ParseRequest(const nlohmann::json &j, Request *request);
+    // takes the keyframe sample
+    static void Submit(GstSample *keyframe, const std::vector<Request> &requests);
+
+ private:
+    struct Job
+    {
+        GstSample *keyframe;
+        std::vector<Request> requests;
+    };
+    static void Run(gpointer data, gpointer user_data);
+    static GstSample *Decode(GstSample *keyframe, std::string *error);
+};
+
+#endif  // _LIBWEBSTREAMER_UTILS_KEYFRAME_SNAPSHOT_H_
@@ -0,0 +1,105 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "keyunitrelay.h"
+#include <gst/video/video.h>
+
+using json = nlohmann::json;
+
+GST_DEBUG_CATEGORY_STATIC(my_category);
+#define GST_CAT_DEFAULT my_category
+
+KeyUnitRelay::KeyUnitRelay(GstClockTime window, const ForwardFunc &forward)
+    : window_(window)
+    , forward_(forward)
+    , last_(0)
+    , requested_(0)
+    , forwarded_(0)
+{
+}
+
+std::shared_ptr<KeyUnitRelay> KeyUnitRelay::Create(GstClockTime window, const ForwardFunc &forward)
+{
+    GST_DEBUG_CATEGORY_INIT(my_category, "webstreamer", 2, "libWebStreamer");
+    std::shared_ptr<KeyUnitRelay> relay(new KeyUnitRelay(window, forward));
+    relay->self_ = relay;
+    return relay;
+}
+
+void KeyUnitRelay::Watch(GstPad *pad, const std::string &origin)
+{
+    Watcher *watcher = new Watcher();
+    watcher->relay = self_.lock();
+    watcher->origin = origin;
+    gst_pad_add_probe(pad,
+                      GST_PAD_PROBE_TYPE_EVENT_UPSTREAM,
+                      on_upstream_event,
+                      watcher,
+                      free_watcher);
+}
+
+void KeyUnitRelay::free_watcher(gpointer data)
+{
+    delete static_cast<Watcher *>(data);
+}
+
+GstPadProbeReturn KeyUnitRelay::on_upstream_event(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+    if (!gst_video_event_is_force_key_unit(event)) {
+        return GST_PAD_PROBE_OK;
+    }
+    Watcher *watcher = static_cast<Watcher *>(user_data);
+    watcher->relay->Request(watcher->origin);
+    return GST_PAD_PROBE_DROP;
+}
+
+bool KeyUnitRelay::Request(const std::string &origin)
+{
+    requested_.fetch_add(1, std::memory_order_relaxed);
+    gint64 now = g_get_monotonic_time();
+    gint64 last = last_.load();
+    gint64 window = (gint64)(window_ / GST_USECOND);
+    do {
+        if (last != 0 && now - last < window) {
+            GST_LOG("[keyunit-relay] request of %s merged.", origin.c_str());
+            return false;
+        }
+    } while (!last_.compare_exchange_weak(last, now));
+
+    GST_DEBUG("[keyunit-relay] request of %s forwarded.", origin.c_str());
+    forwarded_.fetch_add(1, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (forward_) {
+        forward_();
+    }
+    return true;
+}
+
+void KeyUnitRelay::Disarm()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    forward_ = nullptr;
+}
+
+json KeyUnitRelay::stats()
+{
+    json j;
+    j["window"] = window_ / GST_MSECOND;
+    j["requested"] = requested_.load();
+    j["forwarded"] = forwarded_.load();
+    return j;
+}
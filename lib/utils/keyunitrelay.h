@@ -0,0 +1,72 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBWEBSTREAMER_UTILS_KEY_UNIT_RELAY_H_
+#define _LIBWEBSTREAMER_UTILS_KEY_UNIT_RELAY_H_
+
+#include <gst/gst.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <nlohmann/json.hpp>
+
+/*
+ * Collects keyframe requests of the audiences of one app.
+ * Upstream GstForceKeyUnit events (PLI/FIR of a WebRTC viewer, a new
+ * RTSP client, ...) are caught on the audience side of the joints,
+ * which they can not cross, and turned into Request() calls.
+ * Requests within `window` of the last forwarded one are merged, so a
+ * burst of viewers costs the source one keyframe.
+ */
+class KeyUnitRelay
+{
+ public:
+    // from any thread, at most once per window
+    typedef std::function<void()> ForwardFunc;
+
+    static std::shared_ptr<KeyUnitRelay> Create(GstClockTime window, const ForwardFunc &forward);
+
+    // drops upstream force-key-unit events on pad and requests instead
+    void Watch(GstPad *pad, const std::string &origin);
+    bool Request(const std::string &origin);
+    // no more forwarding, the owner is going away
+    void Disarm();
+
+    // {"window", "requested", "forwarded"}
+    nlohmann::json stats();
+
+ private:
+    KeyUnitRelay(GstClockTime window, const ForwardFunc &forward);
+    struct Watcher
+    {
+        std::shared_ptr<KeyUnitRelay> relay;
+        std::string origin;
+    };
+    static GstPadProbeReturn on_upstream_event(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+    static void free_watcher(gpointer data);
+
+    std::weak_ptr<KeyUnitRelay> self_;
+    GstClockTime window_;
+    std::mutex mutex_;
+    ForwardFunc forward_;
+    std::atomic<gint64> last_;  // monotonic us of the last forwarded request
+    std::atomic<guint64> requested_;
+    std::atomic<guint64> forwarded_;
+};
+
+#endif  // _LIBWEBSTREAMER_UTILS_KEY_UNIT_RELAY_H_
@@ -0,0 +1,214 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "latencytracer.h"
+#include "trace.h"
+#include <atomic>
+
+using json = nlohmann::json;
+
+namespace {
+std::atomic<guint> sample_interval(0);
+std::atomic<guint> sample_count(0);
+
+const std::vector<gint64> &bounds()
+{
+    // 8us .. 10s, 4 buckets per doubling
+    static const std::vector<gint64> bounds = Histogram::LogLinear(8, 10 * G_USEC_PER_SEC, 4);
+    return bounds;
+}
+
+gboolean latency_meta_init(GstMeta *meta, gpointer params, GstBuffer *buffer)
+{
+    reinterpret_cast<LatencyMeta *>(meta)->origin = 0;
+    return TRUE;
+}
+
+gboolean latency_meta_transform(GstBuffer *dest, GstMeta *meta, GstBuffer *buffer,
+                                GQuark type, gpointer data)
+{
+    // copies and payloading alike, the time of the content is the same
+    LatencyMeta *copy = reinterpret_cast<LatencyMeta *>(
+        gst_buffer_add_meta(dest, latency_meta_get_info(), NULL));
+    if (!copy) {
+        return FALSE;
+    }
+    copy->origin = reinterpret_cast<LatencyMeta *>(meta)->origin;
+    return TRUE;
+}
+
+void stamp(GstBuffer *buffer, gint64 now)
+{
+    LatencyMeta *meta = reinterpret_cast<LatencyMeta *>(
+        gst_buffer_add_meta(buffer, latency_meta_get_info(), NULL));
+    if (meta) {
+        meta->origin = now;
+    }
+}
+
+void observe(Histogram *histogram, GstBuffer *buffer, gint64 now)
+{
+    LatencyMeta *meta = reinterpret_cast<LatencyMeta *>(
+        gst_buffer_get_meta(buffer, latency_meta_api_get_type()));
+    if (meta) {
+        histogram->Observe(now - meta->origin);
+    }
+}
+}
+
+GType latency_meta_api_get_type()
+{
+    static volatile gsize type = 0;
+    static const gchar *tags[] = {NULL};
+    if (g_once_init_enter(&type)) {
+        GType t = gst_meta_api_type_register("WebStreamerLatencyMetaAPI", tags);
+        g_once_init_leave(&type, t);
+    }
+    return type;
+}
+
+const GstMetaInfo *latency_meta_get_info()
+{
+    static volatile gsize info = 0;
+    if (g_once_init_enter(&info)) {
+        const GstMetaInfo *registered = gst_meta_register(latency_meta_api_get_type(),
+                                                          "WebStreamerLatencyMeta",
+                                                          sizeof(LatencyMeta),
+                                                          latency_meta_init,
+                                                          NULL,
+                                                          latency_meta_transform);
+        g_once_init_leave(&info, (gsize)registered);
+    }
+    return (const GstMetaInfo *)info;
+}
+
+void LatencyTracer::Configure(const json &option)
+{
+    guint interval = 0;
+    if (option.is_object() && option.find("sample") != option.end() && option["sample"].is_number_integer()) {
+        gint64 n = option["sample"];
+        interval = (guint)CLAMP(n, 0, G_MAXINT);
+    }
+    sample_interval.store(interval);
+}
+
+bool LatencyTracer::enabled()
+{
+    return sample_interval.load(std::memory_order_relaxed) != 0;
+}
+
+LatencyTracer::LatencyTracer()
+{
+}
+
+void LatencyTracer::Stamp(GstElement *element, const char *pad_name)
+{
+    if (!enabled() || !element) {
+        return;
+    }
+    GstPad *pad = gst_element_get_static_pad(element, pad_name);
+    g_return_if_fail(pad != NULL);
+    gst_pad_add_probe(pad,
+                      (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+                      on_stamp, NULL, NULL);
+    gst_object_unref(pad);
+}
+
+void LatencyTracer::Hop(GstElement *element, const char *pad_name,
+                        const std::string &endpoint, const std::string &hop)
+{
+    if (!enabled() || !element) {
+        return;
+    }
+    GstPad *pad = gst_element_get_static_pad(element, pad_name);
+    g_return_if_fail(pad != NULL);
+    std::shared_ptr<Histogram> histogram;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::shared_ptr<Histogram> &h = histograms_[endpoint][hop];
+        if (!h) {
+            h = std::make_shared<Histogram>(bounds());
+        }
+        histogram = h;
+    }
+    gst_pad_add_probe(pad,
+                      (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+                      on_hop, new std::shared_ptr<Histogram>(histogram), free_histogram);
+    gst_object_unref(pad);
+}
+
+void LatencyTracer::Forget(const std::string &endpoint)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    histograms_.erase(endpoint);
+}
+
+json LatencyTracer::stats()
+{
+    json result = json::object();
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &endpoint : histograms_) {
+        json hops = json::object();
+        for (auto &hop : endpoint.second) {
+            hops[hop.first] = Trace::Summary(*hop.second);
+        }
+        result[endpoint.first] = hops;
+    }
+    return result;
+}
+
+GstPadProbeReturn LatencyTracer::on_stamp(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    guint interval = sample_interval.load(std::memory_order_relaxed);
+    // one counter for all the ingests, the sampling only has to be sparse
+    if (interval == 0 || sample_count.fetch_add(1, std::memory_order_relaxed) % interval != 0) {
+        return GST_PAD_PROBE_OK;
+    }
+    gint64 now = g_get_monotonic_time();
+    if (info->type & GST_PAD_PROBE_TYPE_BUFFER) {
+        GstBuffer *buffer = gst_buffer_make_writable(GST_PAD_PROBE_INFO_BUFFER(info));
+        GST_PAD_PROBE_INFO_DATA(info) = buffer;
+        stamp(buffer, now);
+    } else if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+        GstBufferList *list = gst_buffer_list_make_writable(GST_PAD_PROBE_INFO_BUFFER_LIST(info));
+        GST_PAD_PROBE_INFO_DATA(info) = list;
+        if (gst_buffer_list_length(list) > 0) {
+            stamp(gst_buffer_list_get_writable(list, 0), now);
+        }
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+GstPadProbeReturn LatencyTracer::on_hop(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    Histogram *histogram = static_cast<std::shared_ptr<Histogram> *>(user_data)->get();
+    gint64 now = g_get_monotonic_time();
+    if (info->type & GST_PAD_PROBE_TYPE_BUFFER) {
+        observe(histogram, GST_PAD_PROBE_INFO_BUFFER(info), now);
+    } else if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+        GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST(info);
+        guint n = gst_buffer_list_length(list);
+        for (guint i = 0; i < n; i++) {
+            observe(histogram, gst_buffer_list_get(list, i), now);
+        }
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+void LatencyTracer::free_histogram(gpointer data)
+{
+    delete static_cast<std::shared_ptr<Histogram> *>(data);
+}
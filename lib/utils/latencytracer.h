@@ -0,0 +1,82 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBWEBSTREAMER_UTILS_LATENCY_TRACER_H_
+#define _LIBWEBSTREAMER_UTILS_LATENCY_TRACER_H_
+
+#include <gst/gst.h>
+#include <nlohmann/json.hpp>
+#include <map>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include "metrics.h"
+
+/*
+ * Monotonic time (us) a buffer left the ingest, carried from the depayloader
+ * to the payloaders. The api has no tags, so parsers, payloaders and the
+ * proxysink/proxysrc joints keep it.
+ */
+struct LatencyMeta
+{
+    GstMeta meta;
+    gint64 origin;
+};
+
+GType latency_meta_api_get_type();
+const GstMetaInfo *latency_meta_get_info();
+
+/*
+ * Streaming path latency, opt-in by the init option
+ *   "latency_trace": {"sample": 30}
+ * 1 of `sample` buffers is stamped with a LatencyMeta at the ingest, the
+ * hops of the app observe the age of the stamped ones, into histograms
+ * by endpoint and hop ("performer" for the app side). The ages are from
+ * the ingest, a hop costs the difference with the previous one: a
+ * buffer may be shared by several branches after a tee, the meta is
+ * never written once stamped. Probes are only installed when enabled.
+ */
+class LatencyTracer
+{
+ public:
+    static void Configure(const nlohmann::json &option);
+    static bool enabled();
+
+    LatencyTracer();
+
+    // stamps the buffers leaving the static pad, the ingest of the app
+    void Stamp(GstElement *element, const char *pad);
+    // observes the stamped buffers passing the static pad
+    void Hop(GstElement *element, const char *pad, const std::string &endpoint, const std::string &hop);
+    // histograms of a removed endpoint, its probes go with its pads
+    void Forget(const std::string &endpoint);
+
+    // {endpoint: {hop: {count, mean_us, p50_us, p90_us, p99_us, max_us}}}
+    nlohmann::json stats();
+
+ private:
+    LatencyTracer(const LatencyTracer &);
+    LatencyTracer &operator=(const LatencyTracer &);
+
+    static GstPadProbeReturn on_stamp(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+    static GstPadProbeReturn on_hop(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+    static void free_histogram(gpointer data);
+
+    std::mutex mutex_;
+    std::map<std::string, std::map<std::string, std::shared_ptr<Histogram> > > histograms_;
+};
+
+#endif  // _LIBWEBSTREAMER_UTILS_LATENCY_TRACER_H_
@@ -0,0 +1,269 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "launchrecipe.h"
+#include "trace.h"
+#include <map>
+#include <mutex>  // NOLINT
+
+GST_DEBUG_CATEGORY_STATIC(my_category);
+#define GST_CAT_DEFAULT my_category
+
+namespace {
+// least recently used recipes are dropped beyond this
+const size_t MAX_RECIPES = 64;
+
+struct CachedRecipe
+{
+    std::shared_ptr<LaunchRecipe> recipe;
+    guint64 used;
+};
+std::mutex recipes_mutex;
+std::map<std::string, CachedRecipe> recipes;
+guint64 recipes_clock = 0;
+}
+
+LaunchRecipe::LaunchRecipe(const std::string &launch)
+    : launch_(launch)
+    , compiled_(false)
+    , single_(false)
+{
+}
+
+LaunchRecipe::~LaunchRecipe()
+{
+    for (auto &step : steps_) {
+        for (auto &property : step.properties) {
+            g_value_unset(&property.value);
+        }
+        gst_object_unref(step.factory);
+    }
+}
+
+std::shared_ptr<LaunchRecipe> LaunchRecipe::Get(const std::string &launch, std::string *error)
+{
+    GST_DEBUG_CATEGORY_INIT(my_category, "webstreamer", 2, "libWebStreamer");
+    {
+        std::lock_guard<std::mutex> lock(recipes_mutex);
+        auto it = recipes.find(launch);
+        if (it != recipes.end()) {
+            it->second.used = ++recipes_clock;
+            return it->second.recipe;
+        }
+    }
+
+    TRACE_SPAN(span, "launch.parse");
+    GError *err = NULL;
+    GstElement *parsed = gst_parse_launch(launch.c_str(), &err);
+    if (err) {
+        *error = err->message;
+        g_error_free(err);
+        g_clear_object(&parsed);
+        return std::shared_ptr<LaunchRecipe>();
+    }
+    span.Stop();
+    std::shared_ptr<LaunchRecipe> recipe(new LaunchRecipe(launch));
+    recipe->compiled_ = recipe->Compile(parsed);
+    gst_object_unref(parsed);
+    GST_DEBUG("[launchrecipe] %s: %s", recipe->compiled_ ? "compiled" : "parsed each time", launch.c_str());
+
+    // a racing Get() may have stored it first, both are equal
+    std::lock_guard<std::mutex> lock(recipes_mutex);
+    CachedRecipe cached = {recipe, ++recipes_clock};
+    auto it = recipes.insert(std::make_pair(launch, cached)).first;
+    if (recipes.size() > MAX_RECIPES) {
+        // on a miss only, a linear scan is fine; users keep their shared_ptr
+        auto oldest = recipes.begin();
+        for (auto i = recipes.begin(); i != recipes.end(); ++i) {
+            if (i->second.used < oldest->second.used) {
+                oldest = i;
+            }
+        }
+        if (oldest != it) {
+            recipes.erase(oldest);
+        }
+    }
+    return it->second.recipe;
+}
+
+void LaunchRecipe::Clear()
+{
+    std::lock_guard<std::mutex> lock(recipes_mutex);
+    recipes.clear();
+}
+
+bool LaunchRecipe::Replayable(GstElement *element)
+{
+    GstElementFactory *factory = gst_element_get_factory(element);
+    if (!factory) {
+        return false;
+    }
+    // ( ... ) groups of the launch
+    const gchar *name = GST_OBJECT_NAME(factory);
+    if (g_str_equal(name, "bin") || g_str_equal(name, "pipeline")) {
+        return false;
+    }
+    // parse links those when the pad shows up, not recorded
+    for (const GList *l = gst_element_factory_get_static_pad_templates(factory); l; l = l->next) {
+        GstStaticPadTemplate *templ = static_cast<GstStaticPadTemplate *>(l->data);
+        if (templ->direction == GST_PAD_SRC && templ->presence == GST_PAD_SOMETIMES) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void LaunchRecipe::Record(GstElement *element)
+{
+    Step step;
+    step.factory = GST_ELEMENT_FACTORY(gst_object_ref(gst_element_get_factory(element)));
+    step.name = GST_OBJECT_NAME(element);
+
+    guint n = 0;
+    GParamSpec **specs = g_object_class_list_properties(G_OBJECT_GET_CLASS(element), &n);
+    for (guint i = 0; i < n; i++) {
+        GParamSpec *spec = specs[i];
+        if ((spec->flags & G_PARAM_READWRITE) != G_PARAM_READWRITE ||
+            (spec->flags & G_PARAM_CONSTRUCT_ONLY) ||
+            spec->owner_type == GST_TYPE_OBJECT) {
+            continue;
+        }
+        GValue value = G_VALUE_INIT;
+        g_value_init(&value, spec->value_type);
+        g_object_get_property(G_OBJECT(element), spec->name, &value);
+        if (g_param_value_defaults(spec, &value)) {
+            g_value_unset(&value);
+            continue;
+        }
+        // the value is owned by the recipe from now on
+        Property property;
+        property.name = spec->name;
+        property.value = value;
+        step.properties.push_back(property);
+    }
+    g_free(specs);
+
+    for (GList *l = GST_ELEMENT_PADS(element); l; l = l->next) {
+        GstPad *pad = GST_PAD(l->data);
+        if (GST_PAD_DIRECTION(pad) != GST_PAD_SRC) {
+            continue;
+        }
+        GstPad *peer = gst_pad_get_peer(pad);
+        if (!peer) {
+            continue;
+        }
+        GstElement *peer_element = gst_pad_get_parent_element(peer);
+        if (peer_element) {
+            Link link;
+            link.src = step.name;
+            link.srcpad = GST_PAD_NAME(pad);
+            link.sink = GST_OBJECT_NAME(peer_element);
+            link.sinkpad = GST_PAD_NAME(peer);
+            links_.push_back(link);
+            gst_object_unref(peer_element);
+        }
+        gst_object_unref(peer);
+    }
+    steps_.push_back(step);
+}
+
+bool LaunchRecipe::Compile(GstElement *parsed)
+{
+    if (!GST_IS_BIN(parsed) || gst_element_get_factory(parsed) == NULL ||
+        !g_str_equal(GST_OBJECT_NAME(gst_element_get_factory(parsed)), "pipeline")) {
+        // a single element, which may be a bin of its own (webrtcbin)
+        if (!Replayable(parsed)) {
+            return false;
+        }
+        single_ = true;
+        Record(parsed);
+        return true;
+    }
+
+    std::vector<GstElement *> children;
+    for (GList *l = GST_BIN_CHILDREN(parsed); l; l = l->next) {
+        GstElement *child = GST_ELEMENT(l->data);
+        if (!Replayable(child)) {
+            return false;
+        }
+        children.push_back(child);
+    }
+    // children are prepended, keep the launch order
+    for (auto it = children.rbegin(); it != children.rend(); ++it) {
+        Record(*it);
+    }
+    return true;
+}
+
+GstElement *LaunchRecipe::Create(const Step &step) const
+{
+    GstElement *element = gst_element_factory_create(step.factory, step.name.c_str());
+    if (!element) {
+        return NULL;
+    }
+    for (auto &property : step.properties) {
+        g_object_set_property(G_OBJECT(element), property.name, &property.value);
+    }
+    return element;
+}
+
+GstElement *LaunchRecipe::Instantiate(std::string *error) const
+{
+    TRACE_SPAN(span, "launch.instantiate");
+    if (!compiled_) {
+        GError *err = NULL;
+        GstElement *parsed = gst_parse_launch(launch_.c_str(), &err);
+        if (err) {
+            *error = err->message;
+            g_error_free(err);
+            g_clear_object(&parsed);
+            return NULL;
+        }
+        return parsed;
+    }
+    if (single_) {
+        GstElement *element = Create(steps_.front());
+        if (!element) {
+            *error = "failed to create " + steps_.front().name;
+        }
+        return element;
+    }
+
+    GstElement *bin = gst_bin_new(NULL);
+    for (auto &step : steps_) {
+        GstElement *element = Create(step);
+        if (!element) {
+            *error = "failed to create " + step.name;
+            gst_object_unref(bin);
+            return NULL;
+        }
+        gst_bin_add(GST_BIN(bin), element);
+    }
+    for (auto &link : links_) {
+        GstElement *src = gst_bin_get_by_name(GST_BIN(bin), link.src.c_str());
+        GstElement *sink = gst_bin_get_by_name(GST_BIN(bin), link.sink.c_str());
+        // request pads (webrtcbin sink_%u) are requested by their name
+        gboolean linked = gst_element_link_pads(src, link.srcpad.c_str(), sink, link.sinkpad.c_str());
+        gst_object_unref(src);
+        gst_object_unref(sink);
+        if (!linked) {
+            *error = "failed to link " + link.src + ":" + link.srcpad + " to " + link.sink + ":" + link.sinkpad;
+            gst_object_unref(bin);
+            return NULL;
+        }
+    }
+    return bin;
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBWEBSTREAMER_UTILS_LAUNCH_RECIPE_H_
+#define _LIBWEBSTREAMER_UTILS_LAUNCH_RECIPE_H_
+
+#include <gst/gst.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * A launch description parsed once and replayed.
+ * The first Get() of a launch parses it and records every element
+ * (factory, name, the properties that differ from their default) and
+ * every link, Instantiate() builds a new bin from that record without
+ * going through the parser and the registry again.
+ * Launches with nested bins or sometimes pads (delayed links) are not
+ * recorded, Instantiate() parses those as before.
+ * Meant for the few launches derived from codecs (webrtc viewers), the
+ * cache keeps the 64 most recently used.
+ */
+class LaunchRecipe
+{
+ public:
+    ~LaunchRecipe();
+
+    static std::shared_ptr<LaunchRecipe> Get(const std::string &launch, std::string *error);
+    static void Clear();
+
+    // what gst_parse_launch would return: the element, or a bin of them
+    GstElement *Instantiate(std::string *error) const;
+
+    const std::string &launch() const { return launch_; }
+    bool compiled() const { return compiled_; }
+
+ private:
+    explicit LaunchRecipe(const std::string &launch);
+    LaunchRecipe(const LaunchRecipe &);
+    LaunchRecipe &operator=(const LaunchRecipe &);
+
+    struct Property
+    {
+        const gchar *name;  // interned by the param spec
+        GValue value;
+    };
+    struct Step
+    {
+        GstElementFactory *factory;
+        std::string name;
+        std::vector<Property> properties;
+    };
+    struct Link
+    {
+        std::string src;
+        std::string srcpad;
+        std::string sink;
+        std::string sinkpad;
+    };
+    bool Compile(GstElement *parsed);
+    void Record(GstElement *element);
+    static bool Replayable(GstElement *element);
+    GstElement *Create(const Step &step) const;
+
+    std::string launch_;
+    bool compiled_;
+    bool single_;  // the launch is one element, no bin around it
+    std::vector<Step> steps_;
+    std::vector<Link> links_;
+};
+
+#endif  // _LIBWEBSTREAMER_UTILS_LAUNCH_RECIPE_H_
@@ -0,0 +1,232 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "metrics.h"
+#include <algorithm>
+#include <map>
+#include <mutex>  // NOLINT
+
+Histogram::Histogram(const std::vector<gint64> &bounds)
+    : bounds_(bounds)
+    , buckets_(new std::atomic<guint64>[bounds.size() + 1])
+    , count_(0)
+    , sum_(0)
+    , max_(0)
+{
+    for (size_t i = 0; i <= bounds_.size(); i++) {
+        buckets_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+std::vector<gint64> Histogram::LogLinear(gint64 min, gint64 max, guint steps)
+{
+    std::vector<gint64> bounds;
+    for (gint64 base = MAX(min, (gint64)steps); base < max; base *= 2) {
+        for (guint i = 0; i < steps; i++) {
+            bounds.push_back(base + base * i / steps);
+        }
+    }
+    bounds.push_back(max);
+    return bounds;
+}
+
+void Histogram::Observe(gint64 value)
+{
+    // first bound not below the value, +Inf past the end
+    size_t i = std::lower_bound(bounds_.begin(), bounds_.end(), value) - bounds_.begin();
+    buckets_[i].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+    gint64 max = max_.load(std::memory_order_relaxed);
+    while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+    }
+}
+
+void Histogram::Reset()
+{
+    // not atomic as a whole, an observation racing with it may be half kept
+    for (size_t i = 0; i <= bounds_.size(); i++) {
+        buckets_[i].store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+}
+
+double Histogram::Quantile(double q) const
+{
+    std::vector<guint64> counts(bounds_.size() + 1);
+    guint64 total = 0;
+    for (size_t i = 0; i <= bounds_.size(); i++) {
+        counts[i] = buckets_[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0) {
+        return -1;
+    }
+    double rank = q * total;
+    guint64 below = 0;
+    for (size_t i = 0; i < bounds_.size(); i++) {
+        if (counts[i] && below + counts[i] >= rank) {
+            double lower = i ? (double)bounds_[i - 1] : 0;
+            double v = lower + (bounds_[i] - lower) * (rank - below) / counts[i];
+            return std::min(v, (double)max());
+        }
+        below += counts[i];
+    }
+    // above the last bound, the largest value seen
+    return (double)max();
+}
+
+void Histogram::Render(const std::string &name, const std::string &labels, std::string *out) const
+{
+    std::string bucket = name + "_bucket";
+    std::string prefix = labels.empty() ? std::string() : labels + ",";
+    guint64 cumulative = 0;
+    for (size_t i = 0; i < bounds_.size(); i++) {
+        cumulative += buckets_[i].load(std::memory_order_relaxed);
+        gchar le[G_ASCII_DTOSTR_BUF_SIZE];
+        g_ascii_formatd(le, sizeof(le), "%.9g", bounds_[i] / 1e6);
+        Metrics::Sample(out, bucket.c_str(), prefix + "le=\"" + le + "\"", cumulative);
+    }
+    cumulative += buckets_[bounds_.size()].load(std::memory_order_relaxed);
+    Metrics::Sample(out, bucket.c_str(), prefix + "le=\"+Inf\"", cumulative);
+    Metrics::Sample(out, (name + "_sum").c_str(), labels, sum() / 1e6);
+    // the +Inf bucket, not count(), so that both agree
+    Metrics::Sample(out, (name + "_count").c_str(), labels, cumulative);
+}
+
+namespace {
+std::atomic<gint64> apps(0);
+std::atomic<guint64> dropped_queue(0);
+std::atomic<guint64> dropped_qos(0);
+std::mutex audiences_mutex;
+std::map<std::string, gint64> audiences;  // by protocol
+
+// 100us .. 10s
+Histogram &promise_histogram()
+{
+    static Histogram histogram({100, 250, 500, 1000, 2500, 5000, 10000, 25000,
+                                50000, 100000, 250000, 500000, 1000000, 2500000,
+                                5000000, 10000000});
+    return histogram;
+}
+}
+
+void Metrics::AddApp(gint delta)
+{
+    apps.fetch_add(delta, std::memory_order_relaxed);
+}
+
+void Metrics::AddAudience(const std::string &protocol, gint delta)
+{
+    std::lock_guard<std::mutex> lock(audiences_mutex);
+    audiences[protocol] += delta;
+}
+
+void Metrics::AddDropped(const char *reason, guint64 buffers)
+{
+    if (g_strcmp0(reason, "qos") == 0) {
+        dropped_qos.fetch_add(buffers, std::memory_order_relaxed);
+    } else {
+        dropped_queue.fetch_add(buffers, std::memory_order_relaxed);
+    }
+}
+
+void Metrics::ObservePromise(gint64 us)
+{
+    promise_histogram().Observe(us);
+}
+
+const Histogram &Metrics::promise_latency()
+{
+    return promise_histogram();
+}
+
+void Metrics::Family(std::string *out, const char *name, const char *type, const char *help)
+{
+    out->append("# HELP ").append(name).append(" ").append(help).append("\n");
+    out->append("# TYPE ").append(name).append(" ").append(type).append("\n");
+}
+
+void Metrics::Sample(std::string *out, const char *name, const std::string &labels, guint64 value)
+{
+    out->append(name);
+    if (!labels.empty()) {
+        out->append("{").append(labels).append("}");
+    }
+    out->append(" ").append(std::to_string(value)).append("\n");
+}
+
+void Metrics::Sample(std::string *out, const char *name, const std::string &labels, gint64 value)
+{
+    out->append(name);
+    if (!labels.empty()) {
+        out->append("{").append(labels).append("}");
+    }
+    out->append(" ").append(std::to_string(value)).append("\n");
+}
+
+void Metrics::Sample(std::string *out, const char *name, const std::string &labels, double value)
+{
+    // not locale dependent, unlike printf
+    gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+    g_ascii_formatd(buf, sizeof(buf), "%.9g", value);
+    out->append(name);
+    if (!labels.empty()) {
+        out->append("{").append(labels).append("}");
+    }
+    out->append(" ").append(buf).append("\n");
+}
+
+void Metrics::Render(std::string *out)
+{
+    Family(out, "webstreamer_apps", "gauge", "Apps created and not destroyed.");
+    Sample(out, "webstreamer_apps", "", apps.load(std::memory_order_relaxed));
+
+    Family(out, "webstreamer_audiences", "gauge", "Audiences by protocol.");
+    {
+        std::lock_guard<std::mutex> lock(audiences_mutex);
+        for (auto &it : audiences) {
+            Sample(out, "webstreamer_audiences", "protocol=\"" + it.first + "\"", it.second);
+        }
+    }
+
+    Family(out, "webstreamer_dropped_buffers_total", "counter",
+           "Buffers dropped by the audience queues and reported by QoS.");
+    Sample(out, "webstreamer_dropped_buffers_total", "reason=\"queue\"",
+           dropped_queue.load(std::memory_order_relaxed));
+    Sample(out, "webstreamer_dropped_buffers_total", "reason=\"qos\"",
+           dropped_qos.load(std::memory_order_relaxed));
+
+    const Histogram &latency = promise_latency();
+    Family(out, "webstreamer_promise_duration_seconds", "histogram",
+           "Time from the call to the response of a promise.");
+    latency.Render("webstreamer_promise_duration_seconds", "", out);
+    Family(out, "webstreamer_promise_duration_quantile_seconds", "gauge",
+           "Promise duration percentiles, interpolated from the histogram.");
+    static const double quantiles[] = {0.5, 0.9, 0.99};
+    for (double q : quantiles) {
+        double v = latency.Quantile(q);
+        if (v < 0) {
+            continue;
+        }
+        gchar label[G_ASCII_DTOSTR_BUF_SIZE];
+        g_ascii_formatd(label, sizeof(label), "%.9g", q);
+        Sample(out, "webstreamer_promise_duration_quantile_seconds",
+               std::string("quantile=\"") + label + "\"", v / 1e6);
+    }
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBWEBSTREAMER_UTILS_METRICS_H_
+#define _LIBWEBSTREAMER_UTILS_METRICS_H_
+
+#include <gst/gst.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * Histogram over fixed bucket bounds, in microseconds.
+ * Observe() is lock free; quantiles are interpolated inside the bucket
+ * they fall in, so they are as coarse as the bounds.
+ */
+class Histogram
+{
+ public:
+    explicit Histogram(const std::vector<gint64> &bounds);
+
+    // log-linear bounds from min to max, `steps` per doubling (HDR like,
+    // the relative error of a quantile stays under 1 / steps)
+    static std::vector<gint64> LogLinear(gint64 min, gint64 max, guint steps);
+
+    void Observe(gint64 value);
+    void Reset();
+    guint64 count() const { return count_.load(std::memory_order_relaxed); }
+    gint64 sum() const { return sum_.load(std::memory_order_relaxed); }
+    gint64 max() const { return max_.load(std::memory_order_relaxed); }
+    // q in [0, 1], -1 when nothing was observed
+    double Quantile(double q) const;
+    // prometheus text format, the values in seconds
+    void Render(const std::string &name, const std::string &labels, std::string *out) const;
+
+ private:
+    Histogram(const Histogram &);
+    Histogram &operator=(const Histogram &);
+
+    std::vector<gint64> bounds_;
+    std::unique_ptr<std::atomic<guint64>[]> buckets_;  // one more than bounds_, not cumulative
+    std::atomic<guint64> count_;
+    std::atomic<gint64> sum_;
+    std::atomic<gint64> max_;
+};
+
+/*
+ * Process wide gauges and counters of the plugin, rendered in the
+ * prometheus text format by MetricsServer. Updates are relaxed atomics
+ * (the audience gauge takes a mutex, it only moves on add/remove).
+ */
+class Metrics
+{
+ public:
+    static void AddApp(gint delta);
+    static void AddAudience(const std::string &protocol, gint delta);
+    // reason: "queue" (audience queue policy) or "qos" (sinks)
+    static void AddDropped(const char *reason, guint64 buffers);
+    // creation to response of a promise
+    static void ObservePromise(gint64 us);
+    static const Histogram &promise_latency();
+
+    static void Render(std::string *out);
+
+    // helpers of the collectors
+    static void Family(std::string *out, const char *name, const char *type, const char *help);
+    static void Sample(std::string *out, const char *name, const std::string &labels, guint64 value);
+    static void Sample(std::string *out, const char *name, const std::string &labels, gint64 value);
+    static void Sample(std::string *out, const char *name, const std::string &labels, double value);
+
+ private:
+    Metrics();
+};
+
+#endif  // _LIBWEBSTREAMER_UTILS_METRICS_H_
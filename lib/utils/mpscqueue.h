@@ -0,0 +1,91 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBWEBSTREAMER_UTILS_MPSC_QUEUE_H_
+#define _LIBWEBSTREAMER_UTILS_MPSC_QUEUE_H_
+
+#include <atomic>
+
+struct MpscNode
+{
+    std::atomic<MpscNode *> mpsc_next;
+    MpscNode()
+        : mpsc_next(nullptr)
+    {
+    }
+};
+
+/*
+ * Intrusive multi-producer single-consumer queue (Vyukov).
+ * Push is wait-free (one exchange and one store) and may be called
+ * from any thread, Pop must only be called by the single consumer.
+ * Pop may return nullptr while a producer is between its two steps,
+ * the consumer should simply retry on its next iteration.
+ */
+class MpscQueue
+{
+ public:
+    MpscQueue()
+        : head_(&stub_)
+        , tail_(&stub_)
+    {
+    }
+
+    void Push(MpscNode *node)
+    {
+        node->mpsc_next.store(nullptr, std::memory_order_relaxed);
+        MpscNode *prev = head_.exchange(node, std::memory_order_acq_rel);
+        prev->mpsc_next.store(node, std::memory_order_release);
+    }
+
+    MpscNode *Pop()
+    {
+        MpscNode *tail = tail_;
+        MpscNode *next = tail->mpsc_next.load(std::memory_order_acquire);
+        if (tail == &stub_) {
+            if (!next) {
+                return nullptr;
+            }
+            tail_ = next;
+            tail = next;
+            next = next->mpsc_next.load(std::memory_order_acquire);
+        }
+        if (next) {
+            tail_ = next;
+            return tail;
+        }
+        if (tail != head_.load(std::memory_order_acquire)) {
+            return nullptr;  // a producer is linking its node
+        }
+        Push(&stub_);
+        next = tail->mpsc_next.load(std::memory_order_acquire);
+        if (next) {
+            tail_ = next;
+            return tail;
+        }
+        return nullptr;
+    }
+
+ private:
+    MpscQueue(const MpscQueue &);
+    MpscQueue &operator=(const MpscQueue &);
+
+    std::atomic<MpscNode *> head_;
+    MpscNode *tail_;
+    MpscNode stub_;
+};
+
+#endif  // _LIBWEBSTREAMER_UTILS_MPSC_QUEUE_H_
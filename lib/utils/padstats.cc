@@ -0,0 +1,281 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "padstats.h"
+#include <set>
+
+using json = nlohmann::json;
+
+namespace {
+// the states of attached pads, summed up by Totals()
+std::mutex totals_mutex;
+std::set<gpointer> totals_live;
+guint64 totals_retired[2] = {0, 0};  // in, out
+}
+
+LatencyRing::LatencyRing()
+{
+    for (guint i = 0; i < SIZE; i++) {
+        slots_[i].pts.store(GST_CLOCK_TIME_NONE, std::memory_order_relaxed);
+        slots_[i].at.store(0, std::memory_order_relaxed);
+    }
+}
+
+void LatencyRing::Record(GstClockTime pts, gint64 now)
+{
+    Slot &slot = slots_[(pts / GST_MSECOND) % SIZE];
+    slot.pts.store(GST_CLOCK_TIME_NONE, std::memory_order_relaxed);
+    slot.at.store(now, std::memory_order_release);
+    slot.pts.store(pts, std::memory_order_release);
+}
+
+bool LatencyRing::Lookup(GstClockTime pts, gint64 *at)
+{
+    Slot &slot = slots_[(pts / GST_MSECOND) % SIZE];
+    if (slot.pts.load(std::memory_order_acquire) != pts) {
+        return false;
+    }
+    *at = slot.at.load(std::memory_order_acquire);
+    // rewritten while reading
+    return slot.pts.load(std::memory_order_acquire) == pts;
+}
+
+PadStats::State::State()
+    : role(PASSIVE)
+    , bytes(0)
+    , buffers(0)
+    , keyframes(0)
+    , first(0)
+    , last_keyframe(0)
+    , keyframe_interval(0)
+    , jitter(0)
+    , latency(-1)
+    , latency_max(0)
+    , transit(0)
+    , has_transit(false)
+    , prev_bytes(0)
+    , prev_buffers(0)
+    , prev_time(0)
+{
+}
+
+PadStats::State::~State()
+{
+    std::lock_guard<std::mutex> lock(totals_mutex);
+    if (totals_live.erase(this)) {
+        totals_retired[role == EGRESS ? 1 : 0] += bytes.load(std::memory_order_relaxed);
+    }
+}
+
+PadStats::PadStats()
+    : state_(std::make_shared<State>())
+    , pad_(NULL)
+    , probe_id_(0)
+{
+}
+
+PadStats::~PadStats()
+{
+    Detach();
+}
+
+bool PadStats::Attach(GstPad *pad, Role role, const std::shared_ptr<LatencyRing> &ring)
+{
+    g_return_val_if_fail(pad != NULL, false);
+    g_return_val_if_fail(pad_ == NULL, false);
+    g_return_val_if_fail(role == PASSIVE || ring, false);
+
+    state_->role = role;
+    state_->ring = ring;
+    {
+        std::lock_guard<std::mutex> lock(totals_mutex);
+        totals_live.insert(state_.get());
+    }
+    pad_ = GST_PAD(gst_object_ref(pad));
+    probe_id_ = gst_pad_add_probe(pad_,
+                                  (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+                                  on_buffer,
+                                  new std::shared_ptr<State>(state_),
+                                  free_state);
+    return true;
+}
+
+void PadStats::Detach()
+{
+    if (!pad_) {
+        return;
+    }
+    gst_pad_remove_probe(pad_, probe_id_);
+    gst_object_unref(pad_);
+    pad_ = NULL;
+    probe_id_ = 0;
+}
+
+void PadStats::Count(State *state, GstBuffer *buffer, gint64 now)
+{
+    state->bytes.fetch_add(gst_buffer_get_size(buffer), std::memory_order_relaxed);
+    state->buffers.fetch_add(1, std::memory_order_relaxed);
+    if (state->first.load(std::memory_order_relaxed) == 0) {
+        state->first.store(now, std::memory_order_relaxed);
+    }
+    if (!GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+        state->keyframes.fetch_add(1, std::memory_order_relaxed);
+        gint64 last = state->last_keyframe.exchange(now, std::memory_order_relaxed);
+        if (last != 0) {
+            state->keyframe_interval.store(now - last, std::memory_order_relaxed);
+        }
+    }
+
+    GstClockTime pts = GST_BUFFER_PTS(buffer);
+    if (!GST_CLOCK_TIME_IS_VALID(pts)) {
+        return;
+    }
+    // J += (|D| - J) / 16, kept times 16 to stay in integers
+    gint64 transit = now * 1000 - (gint64)pts;
+    if (state->has_transit) {
+        gint64 d = transit - state->transit;
+        d = d < 0 ? -d : d;
+        gint64 j = state->jitter.load(std::memory_order_relaxed);
+        state->jitter.store(j + d - ((j + 8) >> 4), std::memory_order_relaxed);
+    }
+    state->transit = transit;
+    state->has_transit = true;
+
+    if (state->role == INGEST) {
+        state->ring->Record(pts, now);
+    } else if (state->role == EGRESS) {
+        gint64 at = 0;
+        if (state->ring->Lookup(pts, &at)) {
+            gint64 latency = now - at;
+            state->latency.store(latency, std::memory_order_relaxed);
+            if (latency > state->latency_max.load(std::memory_order_relaxed)) {
+                state->latency_max.store(latency, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+GstPadProbeReturn PadStats::on_buffer(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    State *state = static_cast<std::shared_ptr<State> *>(user_data)->get();
+    gint64 now = g_get_monotonic_time();
+    if (info->type & GST_PAD_PROBE_TYPE_BUFFER) {
+        Count(state, GST_PAD_PROBE_INFO_BUFFER(info), now);
+    } else if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+        GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST(info);
+        guint n = gst_buffer_list_length(list);
+        for (guint i = 0; i < n; i++) {
+            Count(state, gst_buffer_list_get(list, i), now);
+        }
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+void PadStats::free_state(gpointer data)
+{
+    delete static_cast<std::shared_ptr<State> *>(data);
+}
+
+json PadStats::stats()
+{
+    State *state = state_.get();
+    guint64 bytes = state->bytes.load(std::memory_order_relaxed);
+    guint64 buffers = state->buffers.load(std::memory_order_relaxed);
+    gint64 now = g_get_monotonic_time();
+
+    json j;
+    j["bytes"] = bytes;
+    j["buffers"] = buffers;
+    j["keyframes"] = state->keyframes.load(std::memory_order_relaxed);
+    j["keyframe_interval_ms"] = state->keyframe_interval.load(std::memory_order_relaxed) / 1000;
+    j["jitter_ms"] = (gdouble)(state->jitter.load(std::memory_order_relaxed) >> 4) / GST_MSECOND;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        gint64 since = state->prev_time ? state->prev_time : state->first.load(std::memory_order_relaxed);
+        gint64 elapsed = since ? now - since : 0;
+        if (elapsed > 0) {
+            j["bitrate"] = (guint64)((bytes - state->prev_bytes) * 8 * G_USEC_PER_SEC / elapsed);
+            j["fps"] = (gdouble)(buffers - state->prev_buffers) * G_USEC_PER_SEC / elapsed;
+        } else {
+            j["bitrate"] = 0;
+            j["fps"] = 0;
+        }
+        state->prev_bytes = bytes;
+        state->prev_buffers = buffers;
+        state->prev_time = now;
+    }
+    if (state->role == EGRESS) {
+        gint64 latency = state->latency.load(std::memory_order_relaxed);
+        j["latency_ms"] = latency < 0 ? json() : json((gdouble)latency / 1000);
+        j["latency_max_ms"] = (gdouble)state->latency_max.load(std::memory_order_relaxed) / 1000;
+    }
+    return j;
+}
+
+void PadStats::Totals(guint64 *in, guint64 *out)
+{
+    std::lock_guard<std::mutex> lock(totals_mutex);
+    *in = totals_retired[0];
+    *out = totals_retired[1];
+    for (auto &it : totals_live) {
+        State *state = static_cast<State *>(it);
+        guint64 bytes = state->bytes.load(std::memory_order_relaxed);
+        *(state->role == EGRESS ? out : in) += bytes;
+    }
+}
+
+static gboolean add_field(GQuark field, const GValue *value, gpointer user_data)
+{
+    json &j = *static_cast<json *>(user_data);
+    const gchar *name = g_quark_to_string(field);
+    GType type = G_VALUE_TYPE(value);
+    if (type == GST_TYPE_STRUCTURE) {
+        j[name] = structure_to_json(gst_value_get_structure(value));
+    } else if (type == G_TYPE_BOOLEAN) {
+        j[name] = g_value_get_boolean(value) ? true : false;
+    } else if (type == G_TYPE_INT) {
+        j[name] = g_value_get_int(value);
+    } else if (type == G_TYPE_UINT) {
+        j[name] = g_value_get_uint(value);
+    } else if (type == G_TYPE_INT64) {
+        j[name] = g_value_get_int64(value);
+    } else if (type == G_TYPE_UINT64) {
+        j[name] = g_value_get_uint64(value);
+    } else if (type == G_TYPE_DOUBLE) {
+        j[name] = g_value_get_double(value);
+    } else if (type == G_TYPE_STRING) {
+        const gchar *s = g_value_get_string(value);
+        j[name] = s ? s : "";
+    } else if (G_VALUE_HOLDS_ENUM(value)) {
+        j[name] = g_value_get_enum(value);
+    } else {
+        gchar *s = gst_value_serialize(value);
+        if (s) {
+            j[name] = s;
+            g_free(s);
+        }
+    }
+    return TRUE;
+}
+
+json structure_to_json(const GstStructure *structure)
+{
+    json j = json::object();
+    if (structure) {
+        gst_structure_foreach(structure, add_field, &j);
+    }
+    return j;
+}
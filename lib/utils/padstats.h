@@ -0,0 +1,130 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBWEBSTREAMER_UTILS_PAD_STATS_H_
+#define _LIBWEBSTREAMER_UTILS_PAD_STATS_H_
+
+#include <gst/gst.h>
+#include <nlohmann/json.hpp>
+#include <atomic>
+#include <memory>
+#include <mutex>  // NOLINT
+
+/*
+ * Arrival time of the recent ingest buffers by pts.
+ * Slots are picked by the millisecond of the pts, about one second of
+ * history; written by one streaming thread, looked up lock free from
+ * the egress ones. A slot overwritten meanwhile is simply not found.
+ */
+class LatencyRing
+{
+ public:
+    LatencyRing();
+
+    void Record(GstClockTime pts, gint64 now);
+    bool Lookup(GstClockTime pts, gint64 *at);
+
+ private:
+    LatencyRing(const LatencyRing &);
+    LatencyRing &operator=(const LatencyRing &);
+
+    enum
+    {
+        SIZE = 1024
+    };
+    struct Slot
+    {
+        std::atomic<guint64> pts;
+        std::atomic<gint64> at;
+    };
+    Slot slots_[SIZE];
+};
+
+/*
+ * Always-on counters of the buffers passing a pad.
+ * The probe only does relaxed atomic updates: bytes, buffers, keyframes,
+ * the keyframe interval and the inter-arrival jitter (RFC 3550 style,
+ * arrival time against pts). An ingest pad records its buffers into a
+ * LatencyRing, an egress pad looks its buffers up there for the
+ * ingest-to-egress latency. Bitrate and fps are computed by stats()
+ * over the time since its previous call.
+ */
+class PadStats
+{
+ public:
+    enum Role
+    {
+        PASSIVE,
+        INGEST,
+        EGRESS
+    };
+
+    PadStats();
+    ~PadStats();
+
+    bool Attach(GstPad *pad, Role role = PASSIVE,
+                const std::shared_ptr<LatencyRing> &ring = std::shared_ptr<LatencyRing>());
+    void Detach();
+    bool attached() const { return pad_ != NULL; }
+
+    nlohmann::json stats();
+
+    // bytes through all the pads of the process, detached ones included;
+    // passive and ingest pads count in, egress pads out
+    static void Totals(guint64 *in, guint64 *out);
+
+ private:
+    PadStats(const PadStats &);
+    PadStats &operator=(const PadStats &);
+
+    struct State
+    {
+        State();
+        ~State();
+
+        Role role;
+        std::shared_ptr<LatencyRing> ring;
+        std::atomic<guint64> bytes;
+        std::atomic<guint64> buffers;
+        std::atomic<guint64> keyframes;
+        std::atomic<gint64> first;  // us, monotonic
+        std::atomic<gint64> last_keyframe;
+        std::atomic<gint64> keyframe_interval;
+        std::atomic<gint64> jitter;  // ns, times 16
+        std::atomic<gint64> latency;  // us, last
+        std::atomic<gint64> latency_max;
+        // streaming thread only
+        gint64 transit;
+        bool has_transit;
+        // stats() only
+        std::mutex mutex;
+        guint64 prev_bytes;
+        guint64 prev_buffers;
+        gint64 prev_time;
+    };
+    static void Count(State *state, GstBuffer *buffer, gint64 now);
+    static GstPadProbeReturn on_buffer(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+    static void free_state(gpointer data);
+
+    std::shared_ptr<State> state_;
+    GstPad *pad_;
+    gulong probe_id_;
+};
+
+// GstStructure (rtp/webrtc stats) to json, nested structures included
+nlohmann::json structure_to_json(const GstStructure *structure);
+
+#endif  // _LIBWEBSTREAMER_UTILS_PAD_STATS_H_
@@ -15,6 +15,7 @@
  */
 
 #include "pipejoint.h"
+#include "elementfactory.h"
 
 
 PipeJoint make_pipe_joint(const std::string &media_type, const std::string &name)
@@ -25,8 +26,8 @@ PipeJoint make_pipe_joint(const std::string &media_type, const std::string &name
         name_ = std::to_string(id++);
     }
 
-    GstElement *psink = gst_element_factory_make("proxysink", (name_ + "_proxysink").c_str());
-    GstElement *psrc = gst_element_factory_make("proxysrc", (name_ + "_proxysrc").c_str());
+    GstElement *psink = ElementFactory::Make("proxysink", (name_ + "_proxysink").c_str());
+    GstElement *psrc = ElementFactory::Make("proxysrc", (name_ + "_proxysrc").c_str());
     g_object_set(psrc, "proxysink", psink, NULL);
     g_object_set_data( G_OBJECT(psink), "media-type", (gchar *) g_strdup(media_type.c_str()) );
 
@@ -36,9 +37,32 @@ PipeJoint make_pipe_joint(const std::string &media_type, const std::string &name
     pipejoint.downstream_joint = psrc;
     return pipejoint;
 }
+PipeJoint make_fanout_joint(const std::string &media_type, const std::string &name)
+{
+    std::string name_ = name;
+    if (name_.empty()) {
+        static int id = 0;
+        name_ = std::to_string(id++);
+    }
+
+    GstElement *queue = ElementFactory::Make("queue", (name_ + "_fanout").c_str());
+    // a slow viewer drops its own old buffers instead of blocking the producer
+    g_object_set(queue, "leaky", 2, NULL);
+    g_object_set_data( G_OBJECT(queue), "media-type", (gchar *) g_strdup(media_type.c_str()) );
+    g_object_set_data( G_OBJECT(queue), "fanout-joint", GINT_TO_POINTER(1) );
+
+    PipeJoint pipejoint;
+    pipejoint.upstream_joint = queue;
+    pipejoint.downstream_joint = queue;
+    return pipejoint;
+}
+bool is_fanout_joint(GstElement *joint)
+{
+    return g_object_get_data(G_OBJECT(joint), "fanout-joint") != NULL;
+}
 void update_downstream_joint(PipeJoint *pipejoint)
 {
-    GstElement *psrc = gst_element_factory_make("proxysrc", NULL);
+    GstElement *psrc = ElementFactory::Make("proxysrc", NULL);
     g_object_set(psrc, "proxysink", pipejoint->upstream_joint, NULL);
     pipejoint->downstream_joint = psrc;
 }
@@ -28,6 +28,11 @@ struct PipeJoint
 
 PipeJoint make_pipe_joint(const std::string &media_type = "video",
                           const std::string &name = "");
+// a leaky queue subscribed to the app fan-out, upstream and downstream
+// joint are the same element which lives in the consumer pipeline
+PipeJoint make_fanout_joint(const std::string &media_type = "video",
+                            const std::string &name = "");
+bool is_fanout_joint(GstElement *joint);
 void update_downstream_joint(PipeJoint *pipejoint);
 void destroy_pipe_joint(PipeJoint *pipejoint);
 
@@ -0,0 +1,177 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBWEBSTREAMER_UTILS_RCU_MAP_H_
+#define _LIBWEBSTREAMER_UTILS_RCU_MAP_H_
+
+#include <atomic>
+#include <functional>
+#include <mutex>  // NOLINT
+#include <thread>
+#include <unordered_map>
+
+/*
+ * Hash map with lock-free readers (read-copy-update).
+ * Readers enter a read section by bumping the counter of the current
+ * epoch and look up in the published table without any lock. Writers
+ * are serialized, publish a modified copy and free the old table once
+ * both epoch counters have drained (two flips, so readers which entered
+ * on either side of the first flip are waited for).
+ * Writes cost O(n) copies, which suits registries read on every
+ * buffer or call and written on join/leave only. Values handed to a
+ * reader must not be used after the read section, an erased value can
+ * be released once Erase() returns.
+ */
+template <typename Key, typename Value, typename Hash = std::hash<Key> >
+class RcuMap
+{
+ public:
+    typedef std::unordered_map<Key, Value, Hash> Table;
+
+    RcuMap()
+        : table_(new Table())
+        , epoch_(0)
+    {
+        readers_[0] = 0;
+        readers_[1] = 0;
+    }
+    ~RcuMap()
+    {
+        delete table_.load();
+    }
+
+    // fn(const Value &) runs inside the read section, it must not block
+    template <typename Fn>
+    bool Read(const Key &key, Fn fn) const
+    {
+        ReadSection section(this);
+        typename Table::const_iterator it = section.table->find(key);
+        if (it == section.table->end()) {
+            return false;
+        }
+        fn(it->second);
+        return true;
+    }
+
+    bool Find(const Key &key, Value *value) const
+    {
+        return Read(key, [value](const Value &v) { *value = v; });
+    }
+
+    bool Contains(const Key &key) const
+    {
+        ReadSection section(this);
+        return section.table->find(key) != section.table->end();
+    }
+
+    // fn(const Key &, const Value &) on a consistent snapshot
+    template <typename Fn>
+    void ForEach(Fn fn) const
+    {
+        ReadSection section(this);
+        for (auto &it : *section.table) {
+            fn(it.first, it.second);
+        }
+    }
+
+    size_t size() const
+    {
+        ReadSection section(this);
+        return section.table->size();
+    }
+
+    // false if the key exists already
+    bool Insert(const Key &key, const Value &value)
+    {
+        std::lock_guard<std::mutex> lock(writer_);
+        const Table *current = table_.load();
+        if (current->find(key) != current->end()) {
+            return false;
+        }
+        Table *next = new Table(*current);
+        next->insert(std::make_pair(key, value));
+        Publish(next);
+        return true;
+    }
+
+    bool Erase(const Key &key, Value *old = NULL)
+    {
+        std::lock_guard<std::mutex> lock(writer_);
+        const Table *current = table_.load();
+        typename Table::const_iterator it = current->find(key);
+        if (it == current->end()) {
+            return false;
+        }
+        if (old) {
+            *old = it->second;
+        }
+        Table *next = new Table(*current);
+        next->erase(key);
+        Publish(next);
+        return true;
+    }
+
+    // the former content, readers are done with it
+    Table Clear()
+    {
+        std::lock_guard<std::mutex> lock(writer_);
+        Table former(*table_.load());
+        Publish(new Table());
+        return former;
+    }
+
+ private:
+    RcuMap(const RcuMap &);
+    RcuMap &operator=(const RcuMap &);
+
+    struct ReadSection
+    {
+        explicit ReadSection(const RcuMap *map)
+            : counter(&map->readers_[map->epoch_.load() & 1])
+        {
+            counter->fetch_add(1);
+            // loaded after the counter is up, a writer which missed us
+            // has published its table already
+            table = map->table_.load();
+        }
+        ~ReadSection()
+        {
+            counter->fetch_sub(1);
+        }
+        std::atomic<long> *counter;
+        const Table *table;
+    };
+
+    void Publish(Table *next)
+    {
+        const Table *old = table_.exchange(next);
+        for (int i = 0; i < 2; i++) {
+            unsigned epoch = epoch_.load();
+            epoch_.store(epoch + 1);
+            while (readers_[epoch & 1].load() != 0) {
+                std::this_thread::yield();
+            }
+        }
+        delete old;
+    }
+
+    std::mutex writer_;
+    std::atomic<const Table *> table_;
+    std::atomic<unsigned> epoch_;
+    mutable std::atomic<long> readers_[2];
+};
+
+#endif  // _LIBWEBSTREAMER_UTILS_RCU_MAP_H_
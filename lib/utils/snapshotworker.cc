@@ -0,0 +1,329 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "snapshotworker.h"
+
+GST_DEBUG_CATEGORY_STATIC(my_category);
+#define GST_CAT_DEFAULT my_category
+
+using json = nlohmann::json;
+
+// BITMAPFILEHEADER + BITMAPINFOHEADER
+#define BMP_HEADER_SIZE 54
+
+static void put_le(guint8 *p, guint32 value, int bytes)
+{
+    for (int i = 0; i < bytes; i++) {
+        p[i] = (guint8)(value >> (8 * i));
+    }
+}
+
+// 32 bit top-down BMP, rows are plain BGRx without padding
+static void write_bmp_header(guint8 *p, gint width, gint height, gsize image_size)
+{
+    memset(p, 0, BMP_HEADER_SIZE);
+    p[0] = 'B';
+    p[1] = 'M';
+    put_le(p + 2, (guint32)(BMP_HEADER_SIZE + image_size), 4);
+    put_le(p + 10, BMP_HEADER_SIZE, 4);
+    put_le(p + 14, 40, 4);
+    put_le(p + 18, (guint32)width, 4);
+    put_le(p + 22, (guint32)(-height), 4);
+    put_le(p + 26, 1, 2);
+    put_le(p + 28, 32, 2);
+    put_le(p + 34, (guint32)image_size, 4);
+}
+
+SnapshotWorker::SnapshotWorker()
+    : thread_(NULL)
+    , pending_(NULL)
+    , stopping_(true)
+    , dropped_(0)
+    , converter_(NULL)
+{
+}
+
+SnapshotWorker::~SnapshotWorker()
+{
+    Stop();
+}
+
+bool SnapshotWorker::ParseOptions(const json &j, Options *options)
+{
+    if (!j.is_object()) {
+        return true;
+    }
+    options->format = j.value("format", options->format);
+    if (options->format != "bmp" && options->format != "i420" &&
+        options->format != "jpeg" && options->format != "png") {
+        return false;
+    }
+    options->width = MAX(0, j.value("width", options->width));
+    options->height = MAX(0, j.value("height", options->height));
+    options->slots = CLAMP(j.value("slots", (gint)options->slots), 1, 256);
+    options->slot_size = j.value("slot_size", options->slot_size);
+    return true;
+}
+
+bool SnapshotWorker::Start(const Options &options, const Callback &callback)
+{
+    GST_DEBUG_CATEGORY_INIT(my_category, "webstreamer", 2, "libWebStreamer");
+    g_return_val_if_fail(thread_ == NULL, false);
+
+    options_ = options;
+    callback_ = callback;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = false;
+    }
+    thread_ = g_thread_new("webstreamer_snapshot", SnapshotWorker::Run, this);
+    return thread_ != NULL;
+}
+
+void SnapshotWorker::Stop()
+{
+    if (!thread_) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cond_.notify_one();
+    g_thread_join(thread_);
+    thread_ = NULL;
+
+    // Post() drops its samples from now on
+    GstSample *pending;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending = pending_;
+        pending_ = NULL;
+    }
+    if (pending) {
+        gst_sample_unref(pending);
+    }
+    if (converter_) {
+        gst_video_converter_free(converter_);
+        converter_ = NULL;
+    }
+    ring_.Destroy();
+}
+
+void SnapshotWorker::Post(GstSample *sample)
+{
+    GstSample *replaced;
+    bool stopped;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // not started or stopped, nobody would take it
+        stopped = stopping_;
+        replaced = stopped ? sample : pending_;
+        if (!stopped) {
+            pending_ = sample;
+            if (replaced) {
+                dropped_++;
+            }
+        }
+    }
+    if (replaced) {
+        gst_sample_unref(replaced);
+    } else if (!stopped) {
+        cond_.notify_one();
+    }
+}
+
+gpointer SnapshotWorker::Run(gpointer data)
+{
+    SnapshotWorker *self = static_cast<SnapshotWorker *>(data);
+    for (;;) {
+        GstSample *sample;
+        {
+            std::unique_lock<std::mutex> lock(self->mutex_);
+            while (!self->pending_ && !self->stopping_) {
+                self->cond_.wait(lock);
+            }
+            if (self->stopping_) {
+                break;
+            }
+            sample = self->pending_;
+            self->pending_ = NULL;
+        }
+        self->Process(sample);
+        gst_sample_unref(sample);
+    }
+    return NULL;
+}
+
+guint8 *SnapshotWorker::AcquireSlot(gsize size, gsize capacity, guint *index)
+{
+    if (!ring_.valid()) {
+        capacity = MAX(capacity, size);
+        if (!ring_.Create(FrameRing::MakeName(options_.tag),
+                          options_.slots,
+                          MAX(capacity, options_.slot_size))) {
+            return NULL;
+        }
+    }
+    if (size > ring_.slot_size()) {
+        GST_ERROR("[snapshot] image of %" G_GSIZE_FORMAT " bytes exceeds the ring slot.", size);
+        return NULL;
+    }
+    guint8 *slot = ring_.Acquire(index);
+    if (!slot) {
+        GST_DEBUG("[snapshot] no free slot, image dropped.");
+    }
+    return slot;
+}
+
+bool SnapshotWorker::Convert(const GstVideoInfo *in_info,
+                             GstBuffer *in,
+                             const GstVideoInfo *out_info,
+                             guint8 *dest)
+{
+    if (!converter_ ||
+        !gst_video_info_is_equal(&converter_in_, in_info) ||
+        !gst_video_info_is_equal(&converter_out_, out_info)) {
+        if (converter_) {
+            gst_video_converter_free(converter_);
+        }
+        converter_in_ = *in_info;
+        converter_out_ = *out_info;
+        // scaling is part of the conversion, done once on the small side
+        converter_ = gst_video_converter_new(&converter_in_, &converter_out_, NULL);
+        if (!converter_) {
+            return false;
+        }
+    }
+
+    GstVideoFrame in_frame;
+    GstVideoFrame out_frame;
+    if (!gst_video_frame_map(&in_frame, (GstVideoInfo *)in_info, in, GST_MAP_READ)) {
+        return false;
+    }
+    // wraps the slot memory, the converter writes straight into it
+    gsize size = GST_VIDEO_INFO_SIZE(out_info);
+    GstBuffer *out = gst_buffer_new_wrapped_full((GstMemoryFlags)0, dest, size, 0, size, NULL, NULL);
+    if (!gst_video_frame_map(&out_frame, (GstVideoInfo *)out_info, out, GST_MAP_WRITE)) {
+        gst_video_frame_unmap(&in_frame);
+        gst_buffer_unref(out);
+        return false;
+    }
+    gst_video_converter_frame(converter_, &in_frame, &out_frame);
+    gst_video_frame_unmap(&out_frame);
+    gst_video_frame_unmap(&in_frame);
+    gst_buffer_unref(out);
+    return true;
+}
+
+void SnapshotWorker::Process(GstSample *sample)
+{
+    GstVideoInfo in_info;
+    if (!gst_video_info_from_caps(&in_info, gst_sample_get_caps(sample))) {
+        GST_ERROR("[snapshot] sample is not raw video.");
+        return;
+    }
+    GstBuffer *buf = gst_sample_get_buffer(sample);
+    GstClockTime stream_time = GST_BUFFER_TIMESTAMP(buf);
+    GstClockTime duration = GST_BUFFER_DURATION(buf);
+
+    gint width = options_.width;
+    gint height = options_.height;
+    gint in_width = GST_VIDEO_INFO_WIDTH(&in_info);
+    gint in_height = GST_VIDEO_INFO_HEIGHT(&in_info);
+    if (!width && !height) {
+        width = in_width;
+        height = in_height;
+    } else if (!width) {
+        width = MAX(1, (gint)gst_util_uint64_scale_int(height, in_width, in_height));
+    } else if (!height) {
+        height = MAX(1, (gint)gst_util_uint64_scale_int(width, in_height, in_width));
+    }
+    const std::string &format = options_.format;
+    if (format == "i420") {
+        // chroma planes need even sizes
+        width = MAX(2, width & ~1);
+        height = MAX(2, height & ~1);
+    }
+
+    guint index = 0;
+    gsize size = 0;
+    guint8 *slot = NULL;
+    if (format == "bmp" || format == "i420") {
+        bool bmp = (format == "bmp");
+        GstVideoInfo out_info;
+        gst_video_info_set_format(&out_info,
+                                  bmp ? GST_VIDEO_FORMAT_BGRx : GST_VIDEO_FORMAT_I420,
+                                  width, height);
+        gsize header = bmp ? BMP_HEADER_SIZE : 0;
+        size = header + GST_VIDEO_INFO_SIZE(&out_info);
+        slot = AcquireSlot(size, size, &index);
+        if (!slot) {
+            return;
+        }
+        if (bmp) {
+            write_bmp_header(slot, width, height, GST_VIDEO_INFO_SIZE(&out_info));
+        }
+        if (!Convert(&in_info, buf, &out_info, slot + header)) {
+            GST_ERROR("[snapshot] failed converting frame.");
+            ring_.Abort(index);
+            return;
+        }
+    } else {
+        // the encoder output size is only known afterwards
+        GstCaps *caps = gst_caps_new_simple(format == "jpeg" ? "image/jpeg" : "image/png",
+                                            "width", G_TYPE_INT, width,
+                                            "height", G_TYPE_INT, height,
+                                            NULL);
+        GError *err = NULL;
+        GstSample *encoded = gst_video_convert_sample(sample, caps, GST_CLOCK_TIME_NONE, &err);
+        gst_caps_unref(caps);
+        if (!encoded) {
+            GST_ERROR("[snapshot] failed encoding %s: %s", format.c_str(), err ? err->message : "");
+            g_clear_error(&err);
+            return;
+        }
+        GstMapInfo map_info;
+        if (!gst_buffer_map(gst_sample_get_buffer(encoded), &map_info, GST_MAP_READ)) {
+            gst_sample_unref(encoded);
+            return;
+        }
+        size = map_info.size;
+        // sized for the worst case, not for the first (maybe flat) image
+        slot = AcquireSlot(size, (gsize)width * height * 4, &index);
+        if (slot) {
+            memcpy(slot, map_info.data, size);
+        }
+        gst_buffer_unmap(gst_sample_get_buffer(encoded), &map_info);
+        gst_sample_unref(encoded);
+        if (!slot) {
+            return;
+        }
+    }
+    guint64 seq = ring_.Commit(index, size, stream_time, duration);
+
+    json data;
+    data["ring"] = ring_.name();
+    data["slot"] = index;
+    data["seq"] = seq;
+    data["size"] = size;
+    data["format"] = format;
+    data["width"] = width;
+    data["height"] = height;
+    data["stream-time"] = stream_time;
+    data["duration"] = duration;
+    callback_(data);
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBWEBSTREAMER_UTILS_SNAPSHOT_WORKER_H_
+#define _LIBWEBSTREAMER_UTILS_SNAPSHOT_WORKER_H_
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <nlohmann/json.hpp>
+#include <utils/framering.h>
+
+/*
+ * Scales and encodes video samples off the streaming thread.
+ * Post() drops the sample into a single-slot mailbox (replacing one
+ * not taken yet) and returns at once, a worker thread converts the
+ * latest sample to the configured format and size and writes it into
+ * a FrameRing, then reports the slot through the callback.
+ *
+ * Formats: "bmp" (32 bit, top-down), "i420" (raw planes), "jpeg", "png".
+ * Raw formats are converted straight into the ring slot.
+ */
+class SnapshotWorker
+{
+ public:
+    struct Options
+    {
+        Options()
+            : format("bmp")
+            , width(0)
+            , height(0)
+            , slots(4)
+            , slot_size(0)
+        {
+        }
+        std::string format;
+        gint width;   // 0: keep source (or aspect of the other)
+        gint height;
+        guint slots;
+        gsize slot_size;  // 0: size of the first image
+        std::string tag;  // part of the ring name
+    };
+    // {"ring", "slot", "seq", "size", "format", "width", "height",
+    //  "stream-time", "duration"}
+    typedef std::function<void(const nlohmann::json &data)> Callback;
+
+    SnapshotWorker();
+    ~SnapshotWorker();
+
+    static bool ParseOptions(const nlohmann::json &j, Options *options);
+
+    bool Start(const Options &options, const Callback &callback);
+    void Stop();
+
+    // takes the sample, never blocks the caller
+    void Post(GstSample *sample);
+
+    // samples replaced in the mailbox before the worker took them
+    guint64 dropped()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return dropped_;
+    }
+
+ private:
+    SnapshotWorker(const SnapshotWorker &);
+    SnapshotWorker &operator=(const SnapshotWorker &);
+
+    static gpointer Run(gpointer data);
+    void Process(GstSample *sample);
+    guint8 *AcquireSlot(gsize size, gsize capacity, guint *index);
+    bool Convert(const GstVideoInfo *in_info, GstBuffer *in,
+                 const GstVideoInfo *out_info, guint8 *dest);
+
+    Options options_;
+    Callback callback_;
+    GThread *thread_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    GstSample *pending_;
+    bool stopping_;
+    guint64 dropped_;
+
+    // worker thread only
+    FrameRing ring_;
+    GstVideoConverter *converter_;
+    GstVideoInfo converter_in_;
+    GstVideoInfo converter_out_;
+};
+
+#endif  // _LIBWEBSTREAMER_UTILS_SNAPSHOT_WORKER_H_
@@ -0,0 +1,151 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "teedetacher.h"
+
+GST_DEBUG_CATEGORY_STATIC(my_category);
+#define GST_CAT_DEFAULT my_category
+
+TeeDetacher::TeeDetacher()
+    : state_(std::make_shared<State>())
+    , pad_(NULL)
+{
+}
+
+TeeDetacher::~TeeDetacher()
+{
+    if (pad_) {
+        gst_object_unref(pad_);
+    }
+}
+
+bool TeeDetacher::Attach(GstElement *tee)
+{
+    GST_DEBUG_CATEGORY_INIT(my_category, "webstreamer", 2, "libWebStreamer");
+    g_return_val_if_fail(tee != NULL, false);
+    g_return_val_if_fail(pad_ == NULL, false);
+
+    pad_ = gst_element_get_static_pad(tee, "sink");
+    return pad_ != NULL;
+}
+
+void TeeDetacher::Schedule(const Detach &detach)
+{
+    g_return_if_fail(pad_ != NULL);
+
+    bool arm = false;
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        state_->pending.push_back(detach);
+        arm = !state_->armed && state_->holds == 0;
+        state_->armed = state_->armed || arm;
+    }
+    if (arm) {
+        Arm();
+    }
+}
+
+void TeeDetacher::Hold()
+{
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->holds++;
+}
+
+void TeeDetacher::Release()
+{
+    bool arm = false;
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        g_return_if_fail(state_->holds > 0);
+        state_->holds--;
+        arm = state_->holds == 0 && !state_->armed && !state_->pending.empty();
+        state_->armed = state_->armed || arm;
+    }
+    if (arm) {
+        Arm();
+    }
+}
+
+void TeeDetacher::Arm()
+{
+    g_return_if_fail(pad_ != NULL);
+    // fires at once in this thread when nothing flows, so not under the lock
+    gst_pad_add_probe(pad_,
+                      GST_PAD_PROBE_TYPE_IDLE,
+                      on_idle,
+                      new std::shared_ptr<State>(state_),
+                      free_state);
+}
+
+void TeeDetacher::Flush()
+{
+    Run(state_.get());
+}
+
+void TeeDetacher::Run(State *state)
+{
+    std::vector<Detach> batch;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        batch.swap(state->pending);
+        state->armed = false;
+    }
+    if (batch.empty()) {
+        return;
+    }
+
+    gint64 start = g_get_monotonic_time();
+    for (auto &detach : batch) {
+        detach();
+    }
+    gint64 blocked = g_get_monotonic_time() - start;
+
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->batches++;
+        state->detached += batch.size();
+        state->blocked_total += blocked;
+        state->blocked_last = blocked;
+        state->blocked_max = MAX(state->blocked_max, blocked);
+    }
+    GST_DEBUG("[teedetacher] %u pads detached, tee blocked %" G_GINT64_FORMAT " us",
+              (guint)batch.size(), blocked);
+}
+
+GstPadProbeReturn TeeDetacher::on_idle(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    std::shared_ptr<State> &state = *static_cast<std::shared_ptr<State> *>(user_data);
+    Run(state.get());
+    return GST_PAD_PROBE_REMOVE;
+}
+
+void TeeDetacher::free_state(gpointer data)
+{
+    delete static_cast<std::shared_ptr<State> *>(data);
+}
+
+nlohmann::json TeeDetacher::stats()
+{
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    nlohmann::json j;
+    j["batches"] = state_->batches;
+    j["detached"] = state_->detached;
+    j["pending"] = state_->pending.size();
+    j["blocked_us"] = {{"total", state_->blocked_total},
+                       {"max", state_->blocked_max},
+                       {"last", state_->blocked_last}};
+    return j;
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBWEBSTREAMER_UTILS_TEE_DETACHER_H_
+#define _LIBWEBSTREAMER_UTILS_TEE_DETACHER_H_
+
+#include <gst/gst.h>
+#include <nlohmann/json.hpp>
+#include <functional>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <vector>
+
+/*
+ * Takes request pads off a tee in batches.
+ * Schedule() only queues the detach, the first one of a batch adds an
+ * IDLE probe to the tee sink pad; when it fires the tee is between two
+ * buffers and every detach queued so far runs in the same pass, so 300
+ * audiences leaving at once block the tee once instead of 300 times.
+ * A detach unlinks its tee pad, stops and removes the downstream
+ * elements and releases the request pad.
+ * Between Hold() and Release() detaches are only queued, so a bulk
+ * removal ends up in one batch even when the tee is idle.
+ */
+class TeeDetacher
+{
+ public:
+    typedef std::function<void()> Detach;
+
+    TeeDetacher();
+    ~TeeDetacher();
+
+    bool Attach(GstElement *tee);
+    void Schedule(const Detach &detach);
+    void Hold();
+    void Release();
+    // runs what is pending in the calling thread, the tee must be stopped
+    void Flush();
+
+    // batches, detaches and how long the tee was held, in microseconds
+    nlohmann::json stats();
+
+ private:
+    TeeDetacher(const TeeDetacher &);
+    TeeDetacher &operator=(const TeeDetacher &);
+
+    struct State
+    {
+        State()
+            : armed(false)
+            , holds(0)
+            , batches(0)
+            , detached(0)
+            , blocked_total(0)
+            , blocked_max(0)
+            , blocked_last(0)
+        {
+        }
+
+        std::mutex mutex;
+        bool armed;  // an idle probe is waiting for the pending ones
+        guint holds;
+        std::vector<Detach> pending;
+        guint64 batches;
+        guint64 detached;
+        gint64 blocked_total;
+        gint64 blocked_max;
+        gint64 blocked_last;
+    };
+    void Arm();
+    static void Run(State *state);
+    static GstPadProbeReturn on_idle(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+    static void free_state(gpointer data);
+
+    std::shared_ptr<State> state_;
+    GstPad *pad_;
+};
+
+#endif  // _LIBWEBSTREAMER_UTILS_TEE_DETACHER_H_
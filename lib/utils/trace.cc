@@ -0,0 +1,373 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "trace.h"
+#include "typedef.h"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <vector>
+
+using json = nlohmann::json;
+
+namespace {
+enum
+{
+    ACTIONS = 32,  // plugin_action_t values, larger ones count as unknown
+    EVENTS_MAX = 1 << 20
+};
+
+// 8us .. 60s, 4 buckets per doubling
+const std::vector<gint64> &bounds()
+{
+    static const std::vector<gint64> bounds = Histogram::LogLinear(8, 60 * G_USEC_PER_SEC, 4);
+    return bounds;
+}
+
+struct Phases
+{
+    Phases()
+        : parse(bounds())
+        , queue(bounds())
+        , run(bounds())
+        , total(bounds())
+    {
+    }
+    Histogram parse;
+    Histogram queue;
+    Histogram run;
+    Histogram total;
+};
+
+Phases *actions()
+{
+    static Phases phases[ACTIONS];
+    return phases;
+}
+
+// never erased, the histograms are cached by TRACE_SPAN
+std::mutex spans_mutex;
+std::map<std::string, std::unique_ptr<Histogram> > spans;
+
+struct Event
+{
+    std::string name;
+    const char *category;
+    bool async;
+    guint32 promise;
+    guint tid;
+    gint64 begin;
+    gint64 end;
+};
+std::atomic<bool> events_enabled(false);
+std::mutex events_mutex;
+std::vector<Event> events;  // a ring once full
+size_t events_capacity = 0;
+size_t events_next = 0;
+
+std::atomic<guint32> promise_seq(0);
+std::atomic<guint> thread_seq(0);
+GPrivate current_key = G_PRIVATE_INIT(NULL);
+GPrivate thread_key = G_PRIVATE_INIT(NULL);
+
+guint thread_id()
+{
+    guint tid = GPOINTER_TO_UINT(g_private_get(&thread_key));
+    if (tid == 0) {
+        tid = ++thread_seq;
+        g_private_set(&thread_key, GUINT_TO_POINTER(tid));
+    }
+    return tid;
+}
+
+void render_summary(std::string *out, const char *name, const std::string &labels, const Histogram &histogram)
+{
+    static const char *const quantiles[] = {"0.5", "0.9", "0.99"};
+    static const double values[] = {0.5, 0.9, 0.99};
+    for (int i = 0; i < 3; i++) {
+        double v = histogram.Quantile(values[i]);
+        if (v >= 0) {
+            Metrics::Sample(out, name, labels + ",quantile=\"" + quantiles[i] + "\"", v / 1e6);
+        }
+    }
+    Metrics::Sample(out, (std::string(name) + "_sum").c_str(), labels, histogram.sum() / 1e6);
+    Metrics::Sample(out, (std::string(name) + "_count").c_str(), labels, histogram.count());
+}
+}
+
+json Trace::Summary(const Histogram &histogram)
+{
+    guint64 count = histogram.count();
+    json j;
+    j["count"] = count;
+    j["mean_us"] = count ? histogram.sum() / (gint64)count : 0;
+    j["p50_us"] = (gint64)histogram.Quantile(0.5);
+    j["p90_us"] = (gint64)histogram.Quantile(0.9);
+    j["p99_us"] = (gint64)histogram.Quantile(0.99);
+    j["max_us"] = histogram.max();
+    return j;
+}
+
+void Trace::Configure(const json &option)
+{
+    size_t capacity = 0;
+    if (option.is_object() && option.find("events") != option.end() && option["events"].is_number_integer()) {
+        gint64 n = option["events"];
+        capacity = (size_t)CLAMP(n, 0, (gint64)EVENTS_MAX);
+    }
+    std::lock_guard<std::mutex> lock(events_mutex);
+    events.clear();
+    events.reserve(capacity);
+    events_capacity = capacity;
+    events_next = 0;
+    events_enabled.store(capacity > 0);
+}
+
+guint32 Trace::NextId()
+{
+    // 0 stays "no promise"
+    guint32 id = ++promise_seq;
+    return id ? id : ++promise_seq;
+}
+
+void Trace::Settled(plugin_action_t action, const Stamps &stamps)
+{
+    Phases &phases = actions()[(guint)action < ACTIONS ? action : PLUGIN_ACTION_UNKNOWN];
+    gint64 begin = stamps.received ? stamps.received : stamps.created;
+    if (stamps.received && stamps.created) {
+        phases.parse.Observe(stamps.created - stamps.received);
+    }
+    if (stamps.queued && stamps.dispatched) {
+        phases.queue.Observe(stamps.dispatched - stamps.queued);
+    }
+    if (stamps.dispatched) {
+        phases.run.Observe(stamps.settled - stamps.dispatched);
+    }
+    phases.total.Observe(stamps.settled - begin);
+
+    if (!events_enabled.load(std::memory_order_relaxed)) {
+        return;
+    }
+    std::string name = get_action_name(action);
+    Record(name.c_str(), "promise", true, stamps.id, begin, stamps.settled);
+    if (stamps.queued && stamps.dispatched) {
+        Record("queue", "promise", true, stamps.id, stamps.queued, stamps.dispatched);
+    }
+    if (stamps.dispatched) {
+        Record("run", "promise", true, stamps.id, stamps.dispatched, stamps.settled);
+    }
+}
+
+guint32 Trace::current()
+{
+    return GPOINTER_TO_UINT(g_private_get(&current_key));
+}
+
+Trace::Scope::Scope(guint32 promise)
+    : previous_(g_private_get(&current_key))
+{
+    g_private_set(&current_key, GUINT_TO_POINTER(promise));
+}
+
+Trace::Scope::~Scope()
+{
+    g_private_set(&current_key, previous_);
+}
+
+Histogram *Trace::SpanHistogram(const char *name)
+{
+    std::lock_guard<std::mutex> lock(spans_mutex);
+    std::unique_ptr<Histogram> &histogram = spans[name];
+    if (!histogram) {
+        histogram.reset(new Histogram(bounds()));
+    }
+    return histogram.get();
+}
+
+void Trace::Span(const char *name, Histogram *histogram, guint32 promise, gint64 begin, gint64 end)
+{
+    histogram->Observe(end - begin);
+    if (events_enabled.load(std::memory_order_relaxed)) {
+        Record(name, "span", true, promise, begin, end);
+    }
+}
+
+Trace::Timer::Timer(const char *name, Histogram *histogram)
+    : name_(name)
+    , histogram_(histogram)
+    , promise_(Trace::current())
+    , begin_(g_get_monotonic_time())
+{
+}
+
+void Trace::Timer::Stop()
+{
+    if (!histogram_) {
+        return;
+    }
+    gint64 end = g_get_monotonic_time();
+    histogram_->Observe(end - begin_);
+    if (events_enabled.load(std::memory_order_relaxed)) {
+        Record(name_, "span", false, promise_, begin_, end);
+    }
+    histogram_ = NULL;
+}
+
+void Trace::Record(const char *name, const char *category, bool async,
+                   guint32 promise, gint64 begin, gint64 end)
+{
+    Event event = {name, category, async, promise, thread_id(), begin, end};
+    std::lock_guard<std::mutex> lock(events_mutex);
+    if (events_capacity == 0) {
+        return;
+    }
+    if (events.size() < events_capacity) {
+        events.push_back(event);
+    } else {
+        events[events_next] = event;
+    }
+    events_next = (events_next + 1) % events_capacity;
+}
+
+json Trace::stats()
+{
+    json result;
+    json jactions = json::object();
+    for (guint i = 0; i < ACTIONS; i++) {
+        Phases &phases = actions()[i];
+        if (phases.total.count() == 0) {
+            continue;
+        }
+        jactions[get_action_name((plugin_action_t)i)] = {{"parse", Summary(phases.parse)},
+                                                         {"queue", Summary(phases.queue)},
+                                                         {"run", Summary(phases.run)},
+                                                         {"total", Summary(phases.total)}};
+    }
+    result["actions"] = jactions;
+
+    json jspans = json::object();
+    {
+        std::lock_guard<std::mutex> lock(spans_mutex);
+        for (auto &it : spans) {
+            if (it.second->count()) {
+                jspans[it.first] = Summary(*it.second);
+            }
+        }
+    }
+    result["spans"] = jspans;
+
+    std::lock_guard<std::mutex> lock(events_mutex);
+    result["events"] = {{"capacity", events_capacity}, {"kept", events.size()}};
+    return result;
+}
+
+void Trace::Reset()
+{
+    for (guint i = 0; i < ACTIONS; i++) {
+        Phases &phases = actions()[i];
+        phases.parse.Reset();
+        phases.queue.Reset();
+        phases.run.Reset();
+        phases.total.Reset();
+    }
+    {
+        std::lock_guard<std::mutex> lock(spans_mutex);
+        for (auto &it : spans) {
+            it.second->Reset();
+        }
+    }
+    std::lock_guard<std::mutex> lock(events_mutex);
+    events.clear();
+    events_next = 0;
+}
+
+json Trace::ChromeTrace()
+{
+    std::vector<Event> kept;
+    {
+        std::lock_guard<std::mutex> lock(events_mutex);
+        // oldest first
+        kept.reserve(events.size());
+        size_t start = events.size() < events_capacity ? 0 : events_next;
+        for (size_t i = 0; i < events.size(); i++) {
+            kept.push_back(events[(start + i) % events.size()]);
+        }
+    }
+
+    json trace_events = json::array();
+    for (auto &e : kept) {
+        json args = {{"promise", e.promise}};
+        if (e.async) {
+            // same id and category: nested on one async track
+            json begin = {{"name", e.name}, {"cat", e.category}, {"ph", "b"},
+                          {"id", e.promise}, {"ts", e.begin}, {"pid", 1}, {"tid", e.tid}, {"args", args}};
+            json end = {{"name", e.name}, {"cat", e.category}, {"ph", "e"},
+                        {"id", e.promise}, {"ts", e.end}, {"pid", 1}, {"tid", e.tid}};
+            trace_events.push_back(begin);
+            trace_events.push_back(end);
+        } else {
+            trace_events.push_back({{"name", e.name}, {"cat", e.category}, {"ph", "X"},
+                                    {"ts", e.begin}, {"dur", e.end - e.begin},
+                                    {"pid", 1}, {"tid", e.tid}, {"args", args}});
+        }
+    }
+    json result;
+    result["traceEvents"] = trace_events;
+    result["displayTimeUnit"] = "ms";
+    return result;
+}
+
+bool Trace::Export(const std::string &path, std::string *error)
+{
+    std::string content = ChromeTrace().dump();
+    GError *err = NULL;
+    if (!g_file_set_contents(path.c_str(), content.data(), (gssize)content.size(), &err)) {
+        *error = err->message;
+        g_clear_error(&err);
+        return false;
+    }
+    return true;
+}
+
+void Trace::Render(std::string *out)
+{
+    static const char *const phase_names[] = {"parse", "queue", "run", "total"};
+    Metrics::Family(out, "webstreamer_action_duration_seconds", "summary",
+                    "Phases of the promises by action: parse, queue, run and total.");
+    for (guint i = 0; i < ACTIONS; i++) {
+        Phases &phases = actions()[i];
+        if (phases.total.count() == 0) {
+            continue;
+        }
+        const Histogram *histograms[] = {&phases.parse, &phases.queue, &phases.run, &phases.total};
+        std::string action = "action=\"" + get_action_name((plugin_action_t)i) + "\"";
+        for (int p = 0; p < 4; p++) {
+            render_summary(out, "webstreamer_action_duration_seconds",
+                           action + ",phase=\"" + phase_names[p] + "\"", *histograms[p]);
+        }
+    }
+
+    Metrics::Family(out, "webstreamer_span_duration_seconds", "summary",
+                    "Traced steps of the calls.");
+    std::lock_guard<std::mutex> lock(spans_mutex);
+    for (auto &it : spans) {
+        if (it.second->count()) {
+            render_summary(out, "webstreamer_span_duration_seconds",
+                           "span=\"" + it.first + "\"", *it.second);
+        }
+    }
+}
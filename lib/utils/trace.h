@@ -0,0 +1,124 @@
+/*
+ * Copyright 2018 KEDACOM Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBWEBSTREAMER_UTILS_TRACE_H_
+#define _LIBWEBSTREAMER_UTILS_TRACE_H_
+
+#include <gst/gst.h>
+#include <plugin_interface.h>
+#include <nlohmann/json.hpp>
+#include <string>
+#include "metrics.h"
+
+/*
+ * Control plane tracing.
+ * A promise is stamped when it is received (before its json is parsed),
+ * created, queued to a main loop, dispatched there and settled. The
+ * phases go to lock free histograms per action: parse, queue, run
+ * (dispatch to response, deferred work included) and total.
+ * TRACE_SPAN times the sub steps of a call into histograms per span
+ * name, tagged with the promise the thread is dispatching.
+ * With the init option
+ *   "trace": {"events": 4096}
+ * the last promises and spans are kept as events as well, the "trace"
+ * action exports them in the Chrome trace format (chrome://tracing,
+ * Perfetto): spans as complete events on their thread, promises as
+ * async events with their queue and run phases nested.
+ */
+class Trace
+{
+ public:
+    struct Stamps
+    {
+        Stamps()
+            : id(0)
+            , received(0)
+            , created(0)
+            , queued(0)
+            , dispatched(0)
+            , settled(0)
+        {
+        }
+        guint32 id;
+        gint64 received;  // monotonic us, 0 if not reached
+        gint64 created;
+        gint64 queued;
+        gint64 dispatched;
+        gint64 settled;
+    };
+
+    static void Configure(const nlohmann::json &option);
+    static guint32 NextId();
+
+    static void Settled(plugin_action_t action, const Stamps &stamps);
+
+    // id of the promise the calling thread dispatches, 0 if none
+    static guint32 current();
+    class Scope
+    {
+     public:
+        explicit Scope(guint32 promise);
+        ~Scope();
+
+     private:
+        gpointer previous_;
+    };
+
+    static Histogram *SpanHistogram(const char *name);
+    // a span ending in another callback (or thread) than it began
+    static void Span(const char *name, Histogram *histogram, guint32 promise, gint64 begin, gint64 end);
+
+    class Timer
+    {
+     public:
+        Timer(const char *name, Histogram *histogram);
+        ~Timer() { Stop(); }
+        void Stop();
+
+     private:
+        Timer(const Timer &);
+        Timer &operator=(const Timer &);
+
+        const char *name_;
+        Histogram *histogram_;
+        guint32 promise_;
+        gint64 begin_;
+    };
+
+    // {"actions": {name: {phase: {count, mean_us, p50_us, p90_us, p99_us, max_us}}},
+    //  "spans": {name: {...}}, "events": {"capacity", "kept"}}
+    static nlohmann::json stats();
+    // {count, mean_us, p50_us, p90_us, p99_us, max_us}
+    static nlohmann::json Summary(const Histogram &histogram);
+    static void Reset();
+    static nlohmann::json ChromeTrace();
+    static bool Export(const std::string &path, std::string *error);
+    // prometheus summaries of the actions and spans
+    static void Render(std::string *out);
+
+ private:
+    Trace();
+
+    static void Record(const char *name, const char *category, bool async,
+                       guint32 promise, gint64 begin, gint64 end);
+};
+
+// times the rest of the scope, or up to var.Stop(), as span `name`
+#define TRACE_SPAN(var, name)                                            \
+    static Histogram *const var##_histogram = Trace::SpanHistogram(name); \
+    Trace::Timer var(name, var##_histogram)
+
+#endif  // _LIBWEBSTREAMER_UTILS_TRACE_H_
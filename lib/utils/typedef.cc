@@ -44,6 +44,33 @@ AudioEncodingType get_audio_encoding_type(const std::string &type)
 {
     return audio_encoding_type[type];
 }
+std::map<std::string, plugin_action_t> action_type = {{"create", PLUGIN_ACTION_CREATE},
+                                                     {"destroy", PLUGIN_ACTION_DESTROY},
+                                                     {"startup", PLUGIN_ACTION_STARTUP},
+                                                     {"stop", PLUGIN_ACTION_STOP},
+                                                     {"add_performer", PLUGIN_ACTION_ADD_PERFORMER},
+                                                     {"add_audience", PLUGIN_ACTION_ADD_AUDIENCE},
+                                                     {"remove_audience", PLUGIN_ACTION_REMOVE_AUDIENCE},
+                                                     {"remote_sdp", PLUGIN_ACTION_REMOTE_SDP},
+                                                     {"remote_candidate", PLUGIN_ACTION_REMOTE_CANDIDATE},
+                                                     {"snapshot", PLUGIN_ACTION_SNAPSHOT},
+                                                     {"remove_audiences", PLUGIN_ACTION_REMOVE_AUDIENCES},
+                                                     {"stats", PLUGIN_ACTION_STATS},
+                                                     {"trace", PLUGIN_ACTION_TRACE}};
+plugin_action_t get_action_type(const std::string &action)
+{
+    auto it = action_type.find(action);
+    return it == action_type.end() ? PLUGIN_ACTION_UNKNOWN : it->second;
+}
+std::string get_action_name(plugin_action_t action)
+{
+    for (auto &it : action_type) {
+        if (it.second == action) {
+            return it.first;
+        }
+    }
+    return "unknown";
+}
 
 std::string uppercase(const std::string target)
 {
@@ -18,6 +18,7 @@
 #define _LIBWEBSTREAMER_UTILS_TYPE_DEFINE_H_
 
 #include <string>
+#include <plugin_interface.h>
 enum EndpointType
 {
     RTSP_CLIENT = (1 << 0),
@@ -45,6 +46,8 @@ enum AudioEncodingType
 EndpointType get_endpoint_type(const std::string &type);
 VideoEncodingType get_video_encoding_type(const std::string &type);
 AudioEncodingType get_audio_encoding_type(const std::string &type);
+plugin_action_t get_action_type(const std::string &action);
+std::string get_action_name(plugin_action_t action);
 
 std::string uppercase(const std::string target);
 
@@ -19,6 +19,11 @@
 
 #include "nlohmann/json.hpp"
 #include "./webstreamer.h"
+#include <utils/elementfactory.h>
+#include <utils/launchrecipe.h>
+#include <utils/metrics.h>
+#include <utils/padstats.h>
+#include <utils/trace.h>
 
 void clear_global_webstreamer_instance();
 WebStreamer* get_webstreamer_instance();
@@ -103,6 +108,9 @@ WebStreamer::WebStreamer(plugin_interface_t* iface)
     , pool_clean_id_(0)
     , iface_(iface)
     , state_(State::IDLE)
+    , app_seq_(0)
+    , worker_threads_(1)
+    , sources_(this)
 {
     for (int i = 0; i < RTSPServer::SIZE; i++)
     {
@@ -128,12 +136,68 @@ void WebStreamer::Initialize(Promise* promise) {
 
 bool WebStreamer::Prepare(Promise* promise)
 {
+    // init main loop threads, apps are sharded across them by uname
+    const json& option = promise->data();
+    json::const_iterator rtsp_server = option.find("rtsp_server");
+    if (rtsp_server != option.cend() &&
+        rtsp_server->find("worker_threads") != rtsp_server->cend()) {
+        const json& threads = rtsp_server->at("worker_threads");
+        if (!threads.is_number_integer()) {
+            promise->reject("rtsp_server: invalid worker_threads.");
+            return false;
+        }
+        int n = threads;
+        worker_threads_ = (guint)CLAMP(n, 1, 64);
+    }
+    // default notify coalescing of apps, see NotifyScheduler
+    json::const_iterator notify = option.find("notify");
+    if (notify != option.cend()) {
+        notify_option_ = *notify;
+    }
+
+    contexts_.Startup(WebStreamer::main_context, worker_threads_,
+                      WebStreamer::OnCommand, WebStreamer::OnDropCommand, NULL);
+
+    // factories of the per viewer/session elements, resolved once
+    ElementFactory::Preload({"queue", "tee", "proxysink", "proxysrc", "fakesink",
+                             "rtspsrc", "rtph264depay", "rtph265depay", "h264parse", "h265parse",
+                             "rtppcmadepay", "rtppcmudepay", "rtpopusdepay",
+                             "webrtcbin", "rtph264pay", "rtph265pay", "rtppcmapay", "rtppcmupay",
+                             "rtpopuspay", "capsfilter", "hlssink2"});
+
+    json::const_iterator webrtc = option.find("webrtc");
+    if (webrtc != option.cend()) {
+        webrtc_pool_.Start(*webrtc);
+    }
+
     // init RTSP Server
     std::string err = InitRTSPServer(&promise->data());
     if (!err.empty()) {
+        contexts_.Shutdown();
+        webrtc_pool_.Stop();
         promise->reject(err);
         return false;
     }
+
+    // per action histograms are always on, events only when asked
+    json::const_iterator trace = option.find("trace");
+    Trace::Configure(trace != option.cend() ? *trace : json());
+    // buffer metas from ingest to egress, opt-in
+    json::const_iterator latency_trace = option.find("latency_trace");
+    LatencyTracer::Configure(latency_trace != option.cend() ? *latency_trace : json());
+
+    // prometheus endpoint, optional
+    json::const_iterator metrics = option.find("metrics");
+    if (metrics != option.cend()) {
+        err = metrics_.Start(*metrics, [this](std::string* out) { CollectMetrics(out); });
+        if (!err.empty()) {
+            DestroyRTSPServer();
+            contexts_.Shutdown();
+            webrtc_pool_.Stop();
+            promise->reject(err);
+            return false;
+        }
+    }
     state_ = State::RUNNING;
     promise->resolve();
     return true;
@@ -151,50 +215,159 @@ void WebStreamer::Terminate(Promise* promise)
 
 bool WebStreamer::Cleanup()
 {
+    // first, it reads the session pool and the command queues
+    metrics_.Stop();
     this->DestroyRTSPServer();
+    sources_.Clear();
+    contexts_.Shutdown();
+    webrtc_pool_.Stop();
+    LaunchRecipe::Clear();
+    ElementFactory::Clear();
     return true;
 }
 
-gboolean WebStreamer::OnPromise(gpointer user_data)
+void WebStreamer::CollectMetrics(std::string* out)
 {
-    Promise* promise = (Promise*)user_data;
-    WebStreamer* This = promise->webstreamer();
-    This->OnPromise(promise);
-    return G_SOURCE_REMOVE;
+    Metrics::Family(out, "webstreamer_command_queue_depth", "gauge",
+                    "Calls queued to a main loop and not dispatched yet.");
+    for (guint i = 0; i < contexts_.size(); i++) {
+        Metrics::Sample(out, "webstreamer_command_queue_depth",
+                        "loop=\"" + std::to_string(i) + "\"",
+                        (gint64)contexts_.queue(i)->depth());
+    }
+
+    if (rtsp_session_pool_) {
+        Metrics::Family(out, "webstreamer_rtsp_sessions", "gauge",
+                        "Sessions in the RTSP session pool.");
+        Metrics::Sample(out, "webstreamer_rtsp_sessions", "",
+                        (guint64)gst_rtsp_session_pool_get_n_sessions(rtsp_session_pool_));
+        Metrics::Family(out, "webstreamer_rtsp_sessions_max", "gauge",
+                        "Session limit of the RTSP session pool, 0 for none.");
+        Metrics::Sample(out, "webstreamer_rtsp_sessions_max", "",
+                        (guint64)gst_rtsp_session_pool_get_max_sessions(rtsp_session_pool_));
+    }
+
+    guint64 in = 0;
+    guint64 outgoing = 0;
+    PadStats::Totals(&in, &outgoing);
+    Metrics::Family(out, "webstreamer_bytes_total", "counter",
+                    "Bytes received from the performers and sent to the audiences.");
+    Metrics::Sample(out, "webstreamer_bytes_total", "direction=\"in\"", in);
+    Metrics::Sample(out, "webstreamer_bytes_total", "direction=\"out\"", outgoing);
+
+    Trace::Render(out);
 }
 
-void WebStreamer::Call(Promise* promise)
+void WebStreamer::OnCommand(MpscNode* node, gpointer user_data)
 {
-    GSource *source;
+    Promise* promise = static_cast<Promise*>(node);
+    promise->webstreamer()->OnPromise(promise);
+}
 
-    source = g_idle_source_new();
+void WebStreamer::OnDropCommand(MpscNode* node, gpointer user_data)
+{
+    Promise* promise = static_cast<Promise*>(node);
+    GST_WARNING("call %s dropped, terminating.", promise->action_name().c_str());
+    promise->reject("terminating");
+    delete promise;
+}
+
+CommandQueue* WebStreamer::GetPromiseQueue(Promise* promise)
+{
+    // dispatch to the main loop which the target app is pinned to,
+    // so that apps on different loops are processed in parallel.
+    if (promise->binary()) {
+        std::string uname = GetAppUname(promise->app_id());
+        if (!uname.empty()) {
+            return contexts_.queue(uname);
+        }
+    } else {
+        const json& j = promise->meta();
+        json::const_iterator name = j.find("name");
+        json::const_iterator type = j.find("type");
+        if (name != j.cend() && type != j.cend() &&
+            name->is_string() && type->is_string()) {
+            const std::string& n = *name;
+            const std::string& t = *type;
+            return contexts_.queue(n + "@" + t);
+        }
+    }
+    return contexts_.queue(0u);
+}
 
+void WebStreamer::Call(Promise* promise)
+{
     promise->SetWebStreamer(this);
-    g_source_set_callback(source, WebStreamer::OnPromise, promise, NULL);
-    g_source_set_priority(source, G_PRIORITY_DEFAULT);
-    g_source_attach(source, WebStreamer::main_context);
+    // the queues may be going away, Cleanup() raced check_running()
+    if (!contexts_.Enter()) {
+        OnDropCommand(promise, NULL);
+        return;
+    }
+    // stamped before, it may be dispatched and gone once pushed
+    promise->stamps_.queued = g_get_monotonic_time();
+    GetPromiseQueue(promise)->Push(promise);
+    contexts_.Leave();
 }
 
-void WebStreamer::OnPromise(Promise *promise)
+void WebStreamer::CallBatch(const std::vector<Promise*>& promises)
 {
-    const json& j = promise->meta();
+    bool open = contexts_.Enter();
+    // a loop is woken once when its queue turns non-empty and then
+    // drains the whole batch, no per-call source is allocated
+    gint64 now = g_get_monotonic_time();
+    for (auto promise : promises) {
+        promise->SetWebStreamer(this);
+        if (!open) {
+            OnDropCommand(promise, NULL);
+            continue;
+        }
+        promise->stamps_.queued = now;
+        GetPromiseQueue(promise)->Push(promise);
+    }
+    if (open) {
+        contexts_.Leave();
+    }
+}
 
-    std::string action = j["action"];
-    if (action == "create") {
-        CreateApp(promise);
-    } else if (action == "destroy") {
-        DestroyApp(promise);
-    } else {
-        const std::string& name = j["name"];
-        const std::string& type = j["type"];
-        IApp* app = GetApp(name, type);
-        if (!app) {
-            GST_ERROR("processor not exists (%s@%s).", name.c_str(), type.c_str());
-            promise->reject("processor not exists.");
-            return;
+void WebStreamer::OnPromise(Promise *promise)
+{
+    promise->stamps_.dispatched = g_get_monotonic_time();
+    // spans of this thread are tagged with the promise until it returns
+    Trace::Scope scope(promise->stamps_.id);
+    switch (promise->action()) {
+        case PLUGIN_ACTION_CREATE:
+            CreateApp(promise);
+            break;
+        case PLUGIN_ACTION_TRACE:
+            QueryTrace(promise);
+            break;
+        case PLUGIN_ACTION_DESTROY:
+            DestroyApp(promise);
+            break;
+        default: {
+            IApp* app = NULL;
+            std::string uname;
+            if (promise->binary()) {
+                uname = GetAppUname(promise->app_id());
+                app = GetApp(uname);
+            } else {
+                const json& j = promise->meta();
+                const std::string& name = j["name"];
+                const std::string& type = j["type"];
+                uname = name + "@" + type;
+                app = GetApp(name, type);
+            }
+            if (!app) {
+                GST_ERROR("processor not exists (%s).", uname.c_str());
+                promise->reject("processor not exists.");
+                break;
+            }
+            app->On(promise);
+            if (promise->deferred()) {
+                return;
+            }
+            break;
         }
-        app->On(promise);
-        return;
     }
     delete promise;
 }
@@ -202,6 +375,11 @@ void WebStreamer::OnPromise(Promise *promise)
 
 void WebStreamer::CreateApp(Promise* promise)
 {
+    if (promise->binary()) {
+        GST_ERROR("create is not supported by binary call.");
+        promise->reject("create is not supported by binary call.");
+        return;
+    }
     const json& j = promise->meta();
     std::string name = j["name"];
     std::string type = j["type"];
@@ -222,24 +400,68 @@ void WebStreamer::CreateApp(Promise* promise)
     }
 
 
-    if (app->Initialize(promise)) {
+    TRACE_SPAN(initialize_span, "app.initialize");
+    bool initialized = app->Initialize(promise);
+    initialize_span.Stop();
+    if (initialized) {
+        const json& d = promise->data();
+        json::const_iterator notify = d.find("notify");
+        app->notifier().Configure(notify != d.cend() ? *notify : notify_option_,
+                                  uname, app->context(),
+                                  [app](const json& data, const json& meta) {
+                                      app->NotifyNow(data, meta);
+                                  });
+
+        std::lock_guard<std::mutex> lock(apps_mutex_);
+        app->id() = ++app_seq_;
         apps_[uname] = app;
+        app_unames_[app->id()] = uname;
+        Metrics::AddApp(1);
     } else {
         delete app;
         GST_ERROR("app: %s initialize failed.", uname.c_str());
         promise->reject("app initialize failed.");
         return;
     }
-    GST_INFO("create an app: %s", uname.c_str());
-    promise->resolve();
+    GST_INFO("create an app: %s (id: %u)", uname.c_str(), app->id());
+    json result;
+    result["id"] = app->id();
+    promise->resolve(result);
+}
+
+void WebStreamer::QueryTrace(Promise* promise)
+{
+    const json& d = promise->data();
+    json result = Trace::stats();
+    json::const_iterator file = d.find("file");
+    if (file != d.cend() && file->is_string()) {
+        std::string error;
+        if (!Trace::Export(*file, &error)) {
+            GST_ERROR("trace export to %s failed: %s", file->get<std::string>().c_str(), error.c_str());
+            promise->reject("trace export failed: " + error);
+            return;
+        }
+        result["file"] = *file;
+    }
+    json::const_iterator reset = d.find("reset");
+    if (reset != d.cend() && reset->is_boolean() && reset->get<bool>()) {
+        Trace::Reset();
+    }
+    promise->resolve(result);
 }
+
 void WebStreamer::DestroyApp(Promise* promise) {
-    const json& j = promise->meta();
-    std::string name = j["name"];
-    std::string type = j["type"];
-    std::string uname = name + "@" + type;
+    std::string uname;
+    if (promise->binary()) {
+        uname = GetAppUname(promise->app_id());
+    } else {
+        const json& j = promise->meta();
+        std::string name = j["name"];
+        std::string type = j["type"];
+        uname = name + "@" + type;
+    }
 
-    IApp* app = GetApp(name, type);
+    IApp* app = GetApp(uname);
     if (!app)
     {
         GST_ERROR("%s: destroying a not existed app.", uname.c_str());
@@ -247,20 +469,37 @@ void WebStreamer::DestroyApp(Promise* promise) {
         return;
     }
 
+    // pending coalesced events are still delivered
+    app->notifier().Stop();
     if (!app->Destroy(promise)) {
-        delete app;
-        apps_.erase(uname);
+        RemoveApp(app);
 		GST_ERROR("%s: destroy app failed.", uname.c_str());
         promise->reject(uname + ": destroy app failed.");
         return;
     }
-    delete app;
-    apps_.erase(uname);
+    RemoveApp(app);
 
     GST_INFO("app: %s destroyed.", uname.c_str());
     promise->resolve();
 }
 
+void WebStreamer::RemoveApp(IApp* app)
+{
+    apps_mutex_.lock();
+    apps_.erase(app->uname());
+    app_unames_.erase(app->id());
+    apps_mutex_.unlock();
+    Metrics::AddApp(-1);
+    delete app;
+}
+
+std::string WebStreamer::GetAppUname(guint32 id)
+{
+    std::lock_guard<std::mutex> lock(apps_mutex_);
+    std::map<guint32, std::string>::iterator it = app_unames_.find(id);
+    return (it == app_unames_.end()) ? std::string() : it->second;
+}
+
 static gboolean pool_cleanup(GstRTSPSessionPool* *pool)
 {
     if (*pool)
@@ -308,6 +547,7 @@ std::string WebStreamer::InitRTSPServer(const nlohmann::json* option)
             error = "Initialize RTSP Server failed.";
             goto _failed;
         }
+        server->set_max_threads(worker_threads_);
         rtspserver_[RTSPServer::RFC7826] = server;
         GST_INFO("create RTSPServer::RFC7826 on port:%d", port);
     } else {
@@ -332,6 +572,7 @@ std::string WebStreamer::InitRTSPServer(const nlohmann::json* option)
             error = "Initialize Onvif RTSP Server failed.";
             goto _failed;
         }
+        server->set_max_threads(worker_threads_);
         rtspserver_[RTSPServer::ONVIF] = server;
     }
 
@@ -391,6 +632,8 @@ void WebStreamer::Notify(plugin_buffer_t* data, plugin_buffer_t* meta)
 {
     if (!this->iface_ || !this->iface_->notify || (!data && !meta))
     {
+        if (data && data->release) data->release(data);
+        if (meta && meta->release) meta->release(meta);
         return;
     }
 
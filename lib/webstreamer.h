@@ -25,8 +25,12 @@
 #include <app/livestream.h>
 #include <app/webrtctestclient.h>
 #include <app/hlstream.h>
+#include <app/sourceregistry.h>
+#include <endpoint/webrtcpool.h>
 #include <framework/rtspserver.h>
-
+#include <framework/contextpool.h>
+#include <framework/metricsserver.h>
+#include <mutex>  // NOLINT
 
 
 #define const_error_msg(type, msg) \
@@ -99,6 +103,9 @@ class WebStreamer {
 
     void Call(Promise* promise);
 
+    // submit several promises with one dispatch per main loop
+    void CallBatch(const std::vector<Promise*>& promises);
+
     void Notify(plugin_buffer_t* data, plugin_buffer_t* meta);
 
 
@@ -120,6 +127,18 @@ class WebStreamer {
         return rtspserver_[type];
     }
 
+    // the main context which the app (name@type) is pinned to
+    GMainContext* GetContext(const std::string& uname)
+    {
+        return contexts_.context(uname);
+    }
+
+    // shared rtsp ingests, one per url + codec
+    SourceRegistry& sources() { return sources_; }
+
+    // READY webrtc viewer pipelines, init option "webrtc"
+    WebRTCPool& webrtc_pool() { return webrtc_pool_; }
+
  protected:
     typedef AppFactory<RTSPTestServer,
                        ElementWatcher,
@@ -132,12 +151,20 @@ class WebStreamer {
     void MainLoop(Promise* promise);
     bool Prepare(Promise* promise);
     bool Cleanup();
+    // gauges of the webstreamer itself, on the metrics thread
+    void CollectMetrics(std::string* out);
 
     void CreateApp(Promise* promise);
+    // "trace" action: histograms by action and span, chrome trace export
+    void QueryTrace(Promise* promise);
     void DestroyApp(Promise* promise);
+    void RemoveApp(IApp* app);
+    std::string GetAppUname(guint32 id);
 
     void OnPromise(Promise* promise);
-    static gboolean OnPromise(gpointer user_data);
+    static void OnCommand(MpscNode* node, gpointer user_data);
+    static void OnDropCommand(MpscNode* node, gpointer user_data);
+    CommandQueue* GetPromiseQueue(Promise* promise);
 
     inline IApp* GetApp(const std::string& name, const std::string& type)
     {
@@ -146,6 +173,7 @@ class WebStreamer {
 
     inline IApp* GetApp(const std::string& uname)
     {
+        std::lock_guard<std::mutex> lock(apps_mutex_);
         std::map<std::string, IApp*>::iterator it = apps_.find(uname);
         return   (it == apps_.end()) ? NULL : it->second;
     }
@@ -158,6 +186,15 @@ class WebStreamer {
     plugin_interface_t* iface_;
     State               state_;
     Promise*            terminate_promise_;
+    std::map<guint32, std::string> app_unames_;  // interned app id
+    guint32             app_seq_;
+    std::mutex          apps_mutex_;  // apps live on several main loops
+    ContextPool         contexts_;
+    guint               worker_threads_;
+    nlohmann::json      notify_option_;
+    SourceRegistry      sources_;
+    WebRTCPool          webrtc_pool_;
+    MetricsServer       metrics_;
 };
 
 